@@ -0,0 +1,179 @@
+// Hedged request benchmark
+//
+// Runs sequential GETs against an in-process HTTP stand-in that answers most
+// requests within a few milliseconds but stalls a small share of them, and
+// compares the latency distribution with hedging off and on.
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run
+// ./box_bench_hedge [requests] [slow-percent] [slow-ms]
+
+#include "http.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+
+int main() {
+    std::cout << "box_bench_hedge needs POSIX sockets and curl; not supported on Windows" << std::endl;
+    return 0;
+}
+
+#else
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace box;
+
+namespace {
+
+// Minimal keep-alive HTTP/1.1 server with injected latency
+class StandIn {
+public:
+    StandIn(int slowPercent, int slowMs) : slowPercent(slowPercent), slowMs(slowMs) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+        listen(listenFd, 64);
+
+        socklen_t length = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &length);
+        port = ntohs(addr.sin_port);
+
+        acceptThread = std::thread([this]() { acceptLoop(); });
+    }
+
+    ~StandIn() {
+        stopping = true;
+        shutdown(listenFd, SHUT_RDWR);
+        close(listenFd);
+        acceptThread.join();
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(port) + "/modules/bench.json";
+    }
+
+private:
+    int listenFd = -1;
+    int port = 0;
+    int slowPercent;
+    int slowMs;
+    std::atomic<bool> stopping{false};
+    std::atomic<unsigned> seed{1};
+    std::thread acceptThread;
+
+    void acceptLoop() {
+        while (!stopping) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            unsigned connectionSeed = seed++;
+            std::thread([this, fd, connectionSeed]() { serve(fd, connectionSeed); }).detach();
+        }
+    }
+
+    void serve(int fd, unsigned connectionSeed) {
+        static const std::string body = "{\"name\":\"bench\",\"latest\":\"1.0.0\",\"versions\":{}}";
+        std::mt19937 rng(connectionSeed);
+        std::uniform_int_distribution<int> percent(0, 99);
+        std::uniform_int_distribution<int> baseMs(1, 5);
+
+        std::string pending;
+        char buffer[4096];
+        while (true) {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) break;
+            pending.append(buffer, (size_t)received);
+
+            size_t end;
+            while ((end = pending.find("\r\n\r\n")) != std::string::npos) {
+                pending.erase(0, end + 4);
+                int delay = percent(rng) < slowPercent ? slowMs : baseMs(rng);
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+                std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                       "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0) {
+                    close(fd);
+                    return;
+                }
+            }
+        }
+        close(fd);
+    }
+};
+
+struct Summary {
+    double p50, p95, p99, max;
+};
+
+Summary summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double q) { return samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))]; };
+    return Summary{at(0.50), at(0.95), at(0.99), samples.back()};
+}
+
+Summary run(const std::string& url, size_t requests, bool hedging, HttpStats& stats) {
+    HttpClient http;
+    http.setHedging(hedging);
+
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    for (size_t i = 0; i < requests; i++) {
+        HttpRequest request(url);
+        request.hedgeURL = url;
+        std::vector<HttpResponse> responses;
+
+        auto start = std::chrono::steady_clock::now();
+        http.getAll({request}, responses, 1);
+        latencies.push_back(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    stats = http.getStats();
+    return summarize(latencies);
+}
+
+void print(const char* label, const Summary& summary, const HttpStats& stats) {
+    std::cout << label << "  p50 " << summary.p50 << " ms  p95 " << summary.p95 << " ms  p99 "
+              << summary.p99 << " ms  max " << summary.max << " ms  (hedged " << stats.hedgesSent
+              << ", won " << stats.hedgesWon << ")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500;
+    int slowPercent = argc > 2 ? std::atoi(argv[2]) : 2;
+    int slowMs = argc > 3 ? std::atoi(argv[3]) : 1000;
+    if (requests == 0) requests = 1;
+
+    StandIn server(slowPercent, slowMs);
+    std::cout << requests << " sequential GETs, " << slowPercent << "% delayed by " << slowMs
+              << " ms" << std::endl;
+
+    HttpStats stats;
+    Summary plain = run(server.url(), requests, false, stats);
+    print("no hedging", plain, stats);
+
+    Summary hedged = run(server.url(), requests, true, stats);
+    print("hedging   ", hedged, stats);
+    return 0;
+}
+
+#endif
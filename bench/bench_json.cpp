@@ -0,0 +1,217 @@
+// Registry JSON parsing benchmark
+//
+// Compares the previous find()-based parsing of nur.json and module manifests
+// with the single-pass json::Reader used by Registry today, and a full
+// manifest parse with the lazy one installs use.
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run ./box_bench_json [modules] [versions]
+
+#include "registry.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace box;
+
+namespace {
+
+std::string makeIndex(size_t modules) {
+    std::string out = "{\"version\":\"1.0\",\"modules\":{";
+    for (size_t i = 0; i < modules; i++) {
+        if (i) out += ",";
+        std::string name = "module" + std::to_string(i);
+        out += "\"" + name + "\":\"./modules/" + name + ".json\"";
+    }
+    out += "}}";
+    return out;
+}
+
+std::string makeManifest(size_t versions) {
+    std::string out = "{\"name\":\"bench\",\"author\":\"box\",\"license\":\"MIT\","
+                      "\"latest\":\"1." + std::to_string(versions - 1) + ".0\",\"versions\":{";
+    for (size_t i = 0; i < versions; i++) {
+        if (i) out += ",";
+        std::string v = "1." + std::to_string(i) + ".0";
+        out += "\"" + v + "\":{\"description\":\"Release " + v + " with \\\"escapes\\\"\","
+               "\"entry-linux\":\"https://example.com/bin/" + v + "/bench.so\","
+               "\"entry-win\":\"https://example.com/bin/" + v + "/bench.dll\"";
+        // Only some versions carry git metadata, like real manifests
+        if (i % 10 == 0) {
+            out += ",\"git\":{\"url\":\"https://example.com/bench.git\",\"ref\":\"v" + v + "\"}";
+        }
+        out += "}";
+    }
+    out += "}}";
+    return out;
+}
+
+// Previous Registry::parseIndex()
+size_t legacyParseIndex(const std::string& content, const std::string& registryURL) {
+    std::map<std::string, std::string> moduleIndex;
+    size_t modulesPos = content.find("\"modules\"");
+    if (modulesPos == std::string::npos) return 0;
+    size_t openBrace = content.find('{', modulesPos);
+    if (openBrace == std::string::npos) return 0;
+
+    size_t pos = openBrace + 1;
+    while (pos < content.length()) {
+        size_t nameStart = content.find('"', pos);
+        if (nameStart == std::string::npos) break;
+        size_t nameEnd = content.find('"', nameStart + 1);
+        if (nameEnd == std::string::npos) break;
+        std::string moduleName = content.substr(nameStart + 1, nameEnd - nameStart - 1);
+        size_t urlStart = content.find('"', nameEnd + 1);
+        if (urlStart == std::string::npos) break;
+        size_t urlEnd = content.find('"', urlStart + 1);
+        if (urlEnd == std::string::npos) break;
+        std::string moduleURL = content.substr(urlStart + 1, urlEnd - urlStart - 1);
+        if (moduleURL[0] == '.') moduleURL = registryURL + moduleURL.substr(1);
+        moduleIndex[moduleName] = moduleURL;
+        pos = urlEnd + 1;
+        if (content.find('}', pos) < content.find('"', pos)) break;
+    }
+    return moduleIndex.size();
+}
+
+// Previous manifest parsing from Registry::fetchModuleMetadata()
+size_t legacyParseManifest(const std::string& content) {
+    ModuleMetadata metadata;
+    auto extractValue = [&content](const std::string& key, size_t startPos = 0) -> std::string {
+        std::string searchKey = "\"" + key + "\"";
+        size_t pos = content.find(searchKey, startPos);
+        if (pos == std::string::npos) return "";
+        size_t colonPos = content.find(':', pos);
+        if (colonPos == std::string::npos) return "";
+        size_t valueStart = content.find('"', colonPos);
+        if (valueStart == std::string::npos) return "";
+        size_t valueEnd = content.find('"', valueStart + 1);
+        if (valueEnd == std::string::npos) return "";
+        return content.substr(valueStart + 1, valueEnd - valueStart - 1);
+    };
+
+    metadata.description = extractValue("description");
+    metadata.author = extractValue("author");
+    metadata.license = extractValue("license");
+    metadata.repository = extractValue("repository");
+    metadata.latest = extractValue("latest");
+
+    size_t versionsPos = content.find("\"versions\"");
+    if (versionsPos == std::string::npos) return 0;
+    size_t versionObjStart = content.find('{', versionsPos);
+    if (versionObjStart == std::string::npos) return 0;
+
+    size_t pos = versionObjStart + 1;
+    size_t endOfVersions = content.length();
+    int braceCount = 1;
+    for (size_t i = versionObjStart + 1; i < content.length() && braceCount > 0; i++) {
+        if (content[i] == '{') braceCount++;
+        else if (content[i] == '}') {
+            braceCount--;
+            if (braceCount == 0) {
+                endOfVersions = i;
+                break;
+            }
+        }
+    }
+
+    while (pos < endOfVersions) {
+        size_t versionKeyStart = content.find('"', pos);
+        if (versionKeyStart == std::string::npos || versionKeyStart >= endOfVersions) break;
+        size_t versionKeyEnd = content.find('"', versionKeyStart + 1);
+        if (versionKeyEnd == std::string::npos) break;
+        std::string versionNum = content.substr(versionKeyStart + 1, versionKeyEnd - versionKeyStart - 1);
+        size_t versionObjStart2 = content.find('{', versionKeyEnd);
+        if (versionObjStart2 == std::string::npos) break;
+
+        VersionMetadata versionMeta;
+        versionMeta.description = extractValue("description", versionObjStart2);
+        versionMeta.entryLinux = extractValue("entry-linux", versionObjStart2);
+        versionMeta.entryWin = extractValue("entry-win", versionObjStart2);
+        versionMeta.entryMac = extractValue("entry-mac", versionObjStart2);
+
+        size_t gitPos = content.find("\"git\"", versionObjStart2);
+        if (gitPos != std::string::npos && gitPos < content.find('}', versionObjStart2)) {
+            size_t gitObjStart = content.find('{', gitPos);
+            if (gitObjStart != std::string::npos) {
+                versionMeta.git.url = extractValue("url", gitObjStart);
+                versionMeta.git.ref = extractValue("ref", gitObjStart);
+            }
+        }
+        metadata.versions[versionNum] = versionMeta;
+
+        int versionBraceCount = 1;
+        pos = versionObjStart2 + 1;
+        while (pos < endOfVersions && versionBraceCount > 0) {
+            if (content[pos] == '{') versionBraceCount++;
+            else if (content[pos] == '}') versionBraceCount--;
+            pos++;
+        }
+    }
+    return metadata.versions.size();
+}
+
+template <typename Fn>
+double timeMs(Fn&& fn, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+void report(const char* label, size_t bytes, double ms, size_t items) {
+    double mbPerSec = (bytes / (1024.0 * 1024.0)) / (ms / 1000.0);
+    std::cout << "  " << label << ": " << ms << " ms (" << mbPerSec << " MB/s, "
+              << items << " entries)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t modules = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t versions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000;
+    if (versions == 0) versions = 1;
+
+    std::string index = makeIndex(modules);
+    std::string manifest = makeManifest(versions);
+    const std::string registryURL = "https://example.com/nur";
+
+    std::cout << "nur.json: " << modules << " modules, " << index.size() << " bytes" << std::endl;
+    size_t legacyCount = 0, newCount = 0;
+    double legacyMs = timeMs([&]() { legacyCount = legacyParseIndex(index, registryURL); }, 3);
+    report("find()-based", index.size(), legacyMs, legacyCount);
+
+    // parseIndex prints a summary line; keep it out of the timing loop output
+    std::streambuf* saved = std::cout.rdbuf(nullptr);
+    Registry registry;
+    double newMs = timeMs([&]() { registry.parseIndex(index); }, 3);
+    newCount = registry.listModules().size();
+    std::cout.rdbuf(saved);
+    report("json::Reader", index.size(), newMs, newCount);
+    std::cout << "  speedup: " << legacyMs / newMs << "x" << std::endl;
+
+    std::cout << "manifest: " << versions << " versions, " << manifest.size() << " bytes" << std::endl;
+    legacyMs = timeMs([&]() { legacyCount = legacyParseManifest(manifest); }, 1);
+    report("find()-based", manifest.size(), legacyMs, legacyCount);
+    newMs = timeMs([&]() {
+        ModuleMetadata metadata;
+        Registry::parseManifest(manifest, metadata);
+        newCount = metadata.versions.size();
+    }, 5);
+    report("json::Reader", manifest.size(), newMs, newCount);
+    std::cout << "  speedup: " << legacyMs / newMs << "x" << std::endl;
+
+    // What an install parses: the version index plus the latest version
+    double lazyMs = timeMs([&]() {
+        LazyManifest lazy;
+        lazy.load(manifest);
+        VersionMetadata latest;
+        lazy.getVersion(lazy.getLatest(), latest);
+        newCount = lazy.listVersions().size();
+    }, 5);
+    report("lazy, latest", manifest.size(), lazyMs, newCount);
+    std::cout << "  speedup over full parse: " << newMs / lazyMs << "x" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Registry metadata memory benchmark
+//
+// Parses a synthetic registry's manifests into one ModuleMetadata per module
+// (std::string fields and std::map versions) and into a MetadataTable, and
+// reports heap bytes per module and allocations per manifest for each.
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run ./box_bench_metadata [modules] [versions]
+
+#include "metadata.h"
+#include "registry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace box;
+
+// Every heap allocation in the process goes through these counters
+static std::atomic<size_t> allocCount{0};
+static std::atomic<size_t> allocBytes{0};
+
+void* operator new(size_t size) {
+    allocCount++;
+    allocBytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+const char* LICENSES[] = {"MIT", "Apache-2.0", "BSD-3-Clause", "GPL-3.0"};
+const size_t LICENSE_COUNT = sizeof(LICENSES) / sizeof(LICENSES[0]);
+const size_t AUTHOR_COUNT = 50;
+const size_t DEP_POOL = 200;
+
+// Manifest shaped like the real ones: shared authors, licenses and
+// dependencies, per-version binaries and an occasional git source
+std::string makeManifest(size_t index, size_t versions) {
+    std::string name = "module" + std::to_string(index);
+    std::string out = "{\"name\":\"" + name + "\",\"description\":\"The " + name + " module\","
+                      "\"author\":\"author" + std::to_string(index % AUTHOR_COUNT) + "\","
+                      "\"license\":\"" + LICENSES[index % LICENSE_COUNT] + "\","
+                      "\"repository\":\"https://github.com/box-modules/" + name + "\","
+                      "\"latest\":\"1." + std::to_string(versions - 1) + ".0\",\"versions\":{";
+    for (size_t i = 0; i < versions; i++) {
+        if (i) out += ",";
+        std::string v = "1." + std::to_string(i) + ".0";
+        out += "\"" + v + "\":{\"description\":\"The " + name + " module\","
+               "\"entry-linux\":\"https://example.com/bin/" + name + "/" + v + "/" + name + ".so\","
+               "\"entry-win\":\"https://example.com/bin/" + name + "/" + v + "/" + name + ".dll\"";
+        if (i % 4 == 0) {
+            out += ",\"git\":{\"url\":\"https://github.com/box-modules/" + name + ".git\",\"ref\":\"v" + v + "\"}";
+        }
+        out += ",\"deps\":{";
+        for (size_t d = 0; d < 3; d++) {
+            if (d) out += ",";
+            out += "\"module" + std::to_string((index * 7 + d * 13) % DEP_POOL) + "\":\"^1.0.0\"";
+        }
+        out += "}}";
+    }
+    out += "}}";
+    return out;
+}
+
+struct Measurement {
+    size_t allocations = 0;
+    size_t bytes = 0;
+    double ms = 0;
+};
+
+template <typename Fn>
+Measurement measure(Fn&& fn) {
+    size_t count = allocCount;
+    size_t bytes = allocBytes;
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    Measurement m;
+    m.allocations = allocCount - count;
+    m.bytes = allocBytes - bytes;
+    m.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    return m;
+}
+
+void report(const char* label, const Measurement& m, size_t retained, size_t modules) {
+    std::cout << "  " << label << ": " << m.ms << " ms, "
+              << (double)m.allocations / modules << " allocations/manifest, "
+              << retained / modules << " bytes/module retained" << std::endl;
+}
+
+// Heap held by a ModuleMetadata: string buffers beyond SSO and map nodes
+size_t stringHeap(const std::string& s) {
+    return s.capacity() >= sizeof(std::string) ? s.capacity() + 1 : 0;
+}
+
+size_t metadataHeap(const ModuleMetadata& metadata) {
+    // Rough red-black tree node overhead: three pointers and a color
+    const size_t nodeOverhead = 4 * sizeof(void*);
+    size_t total = stringHeap(metadata.name) + stringHeap(metadata.description) + stringHeap(metadata.author) +
+                   stringHeap(metadata.license) + stringHeap(metadata.repository) + stringHeap(metadata.latest);
+    for (const auto& pair : metadata.versions) {
+        const VersionMetadata& v = pair.second;
+        total += nodeOverhead + sizeof(pair) + stringHeap(pair.first);
+        total += stringHeap(v.description) + stringHeap(v.entryLinux) + stringHeap(v.entryWin) +
+                 stringHeap(v.entryMac) + stringHeap(v.sha256Linux) +
+                 stringHeap(v.sha256Win) + stringHeap(v.sha256Mac) + stringHeap(v.git.url) + stringHeap(v.git.ref);
+        for (const auto& dep : v.deps) {
+            total += nodeOverhead + sizeof(dep) + stringHeap(dep.first) + stringHeap(dep.second);
+        }
+    }
+    return total;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t modules = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    size_t versions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20;
+    if (modules == 0) modules = 1;
+    if (versions == 0) versions = 1;
+
+    std::vector<std::string> names;
+    std::vector<std::string> manifests;
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < modules; i++) {
+        names.push_back("module" + std::to_string(i));
+        manifests.push_back(makeManifest(i, versions));
+        totalBytes += manifests.back().size();
+    }
+    std::cout << "registry: " << modules << " modules x " << versions << " versions, "
+              << totalBytes << " bytes of manifests" << std::endl;
+
+    // One ModuleMetadata per module, the way Registry::fetchModuleMetadata returns them
+    std::vector<ModuleMetadata> parsed(modules);
+    Measurement maps = measure([&]() {
+        for (size_t i = 0; i < modules; i++) {
+            Registry::parseManifest(manifests[i], parsed[i]);
+            parsed[i].name = names[i];
+        }
+    });
+    size_t mapHeap = modules * sizeof(ModuleMetadata);
+    for (const ModuleMetadata& metadata : parsed) mapHeap += metadataHeap(metadata);
+    report("ModuleMetadata", maps, mapHeap, modules);
+
+    MetadataTable table;
+    Measurement compact = measure([&]() {
+        for (size_t i = 0; i < modules; i++) {
+            table.addManifest(names[i], manifests[i]);
+        }
+    });
+    report("MetadataTable ", compact, table.memoryUsage(), modules);
+
+    std::cout << "  memory: " << (double)mapHeap / table.memoryUsage() << "x smaller, allocations: "
+              << (double)maps.allocations / (compact.allocations ? compact.allocations : 1) << "x fewer"
+              << std::endl;
+
+    // Lookups must agree with the map form
+    size_t mismatches = 0;
+    for (size_t i = 0; i < modules; i += 97) {
+        const CompactModule* module = table.find(names[i]);
+        ModuleMetadata expanded;
+        if (module) table.toMetadata(*module, expanded);
+        if (!module || expanded.versions.size() != parsed[i].versions.size() ||
+            expanded.latest != parsed[i].latest || expanded.author != parsed[i].author ||
+            expanded.versions.rbegin()->second.deps != parsed[i].versions.rbegin()->second.deps) {
+            mismatches++;
+        }
+    }
+    if (mismatches) {
+        std::cerr << mismatches << " modules differ between the two forms" << std::endl;
+        return 1;
+    }
+    return 0;
+}
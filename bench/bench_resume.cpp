@@ -0,0 +1,352 @@
+// Resumable download check
+//
+// Runs Registry::downloadToFile() against an in-process HTTP stand-in that
+// honours Range/If-Range but can cut responses short, ignore ranges or
+// ignore If-Range, and checks every case ends with the right bytes:
+//
+//   dropped      the connection drops partway; the rest is fetched with Range
+//   changed      a partial download is left behind, then the file and its
+//                ETag change; If-Range gets a 200 and the download restarts
+//   no-ranges    the server answers a range request with a 200 of everything
+//   stale-range  the server ignores If-Range and the file shrank below the
+//                kept bytes; the 416 drops them and the download starts over
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run ./box_bench_resume [kilobytes]
+// (exits 1 if any case ends with the wrong file)
+
+#include "registry.h"
+#include "sha256.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+
+int main() {
+    std::cout << "box_bench_resume needs POSIX sockets and curl; not supported on Windows" << std::endl;
+    return 0;
+}
+
+#else
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace box;
+
+namespace {
+
+// One response the stand-in sent
+struct Served {
+    int status;
+    size_t from;  // first byte of the body it started at
+    size_t sent;  // body bytes written before the response ended (or was cut)
+};
+
+// Minimal HTTP/1.1 server for one file, one connection per request
+class StandIn {
+public:
+    StandIn() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+        listen(listenFd, 16);
+
+        socklen_t length = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &length);
+        port = ntohs(addr.sin_port);
+
+        acceptThread = std::thread([this]() { acceptLoop(); });
+    }
+
+    ~StandIn() {
+        stopping = true;
+        shutdown(listenFd, SHUT_RDWR);
+        close(listenFd);
+        acceptThread.join();
+    }
+
+    std::string url(const std::string& name) const {
+        return "http://127.0.0.1:" + std::to_string(port) + "/bin/" + name;
+    }
+
+    // Serve new content under a new strong ETag
+    void publish(const std::string& content, const std::string& tag) {
+        std::lock_guard<std::mutex> lock(mutex);
+        body = content;
+        etag = tag;
+    }
+
+    // Cut the next `responses` responses after `bytes` body bytes
+    void cutNext(size_t responses, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cutResponses = responses;
+        cutAfter = bytes;
+    }
+
+    void setHonorRange(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        honorRange = enabled;
+    }
+
+    void setHonorIfRange(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        honorIfRange = enabled;
+    }
+
+    std::vector<Served> takeLog() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Served> out;
+        out.swap(log);
+        return out;
+    }
+
+private:
+    int listenFd = -1;
+    int port = 0;
+    bool stopping = false;
+    std::thread acceptThread;
+
+    std::mutex mutex;
+    std::string body;
+    std::string etag;
+    size_t cutResponses = 0;
+    size_t cutAfter = 0;
+    bool honorRange = true;
+    bool honorIfRange = true;
+    std::vector<Served> log;
+
+    void acceptLoop() {
+        while (!stopping) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            serve(fd);
+            close(fd);
+        }
+    }
+
+    static std::string header(const std::string& request, const std::string& name) {
+        std::string key = "\r\n" + name + ": ";
+        size_t start = request.find(key);
+        if (start == std::string::npos) return "";
+        start += key.size();
+        return request.substr(start, request.find("\r\n", start) - start);
+    }
+
+    void serve(int fd) {
+        std::string request;
+        char buffer[4096];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) return;
+            request.append(buffer, (size_t)received);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string range = header(request, "Range");
+        std::string ifRange = header(request, "If-Range");
+
+        int status = 200;
+        size_t from = 0;
+        if (!range.empty() && honorRange && (!honorIfRange || ifRange.empty() || ifRange == etag)) {
+            from = std::strtoull(range.c_str() + range.find('=') + 1, nullptr, 10);
+            status = from < body.size() ? 206 : 416;
+        }
+
+        std::string head;
+        size_t length = 0;
+        if (status == 416) {
+            head = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(body.size()) +
+                   "\r\nContent-Length: 0\r\n";
+        } else {
+            length = body.size() - from;
+            head = status == 206 ? "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(from) +
+                                       "-" + std::to_string(body.size() - 1) + "/" + std::to_string(body.size()) + "\r\n"
+                                 : "HTTP/1.1 200 OK\r\n";
+            head += "Content-Length: " + std::to_string(length) + "\r\n";
+        }
+        head += "ETag: " + etag + "\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n";
+        send(fd, head.data(), head.size(), MSG_NOSIGNAL);
+
+        size_t sent = length;
+        if (cutResponses > 0 && length > 0) {
+            cutResponses--;
+            sent = std::min(length, cutAfter);
+        }
+        send(fd, body.data() + from, sent, MSG_NOSIGNAL);
+        log.push_back(Served{status, from, sent});
+    }
+};
+
+std::string makeContent(size_t size, unsigned seed) {
+    std::string content(size, '\0');
+    uint32_t state = seed;
+    for (char& c : content) {
+        state = state * 1664525u + 1013904223u;
+        c = (char)(state >> 24);
+    }
+    return content;
+}
+
+std::string sha256Of(const std::string& data) {
+    Sha256 digest;
+    digest.update(data.data(), data.size());
+    return digest.finish();
+}
+
+std::string describe(const std::vector<Served>& log) {
+    std::string out;
+    for (const auto& served : log) {
+        if (!out.empty()) out += ", ";
+        out += std::to_string(served.status) + " @" + std::to_string(served.from) + " (" +
+               std::to_string(served.sent) + " bytes)";
+    }
+    return out;
+}
+
+class Checker {
+public:
+    explicit Checker(const std::string& dir) : dir(dir) {}
+
+    // Download url and compare the result with the published content
+    bool download(Registry& registry, const std::string& url, const std::string& expected) {
+        std::string path = dir + "/out-" + std::to_string(count++);
+        DownloadResult result;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = registry.downloadToFile(url, path, result);
+        elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::string digest;
+        return ok && result.sha256 == sha256Of(expected) && Sha256::hashFile(path, digest) &&
+               digest == result.sha256 && result.size == expected.size();
+    }
+
+    // Report a case; `shape` checks the responses the stand-in sent
+    bool report(const char* name, bool ok, const std::vector<Served>& log, bool shape) {
+        std::cout << (ok && shape ? "ok    " : "FAIL  ") << name << ": " << describe(log) << " in "
+                  << elapsedMs << " ms" << std::endl;
+        if (!ok) std::cout << "      wrong or missing file" << std::endl;
+        if (ok && !shape) std::cout << "      unexpected sequence of responses" << std::endl;
+        return ok && shape;
+    }
+
+private:
+    std::string dir;
+    size_t count = 0;
+    double elapsedMs = 0;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t kilobytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4096;
+    if (kilobytes < 4) kilobytes = 4;
+    size_t size = kilobytes * 1024;
+
+    // A private box home, so the cache and its partial downloads start empty
+    std::string home = (std::filesystem::temp_directory_path() / ("box-resume-" + std::to_string(getpid()))).string();
+    std::filesystem::create_directories(home);
+    setenv("HOME", home.c_str(), 1);
+    unsetenv("BOX_OFFLINE");
+    unsetenv("BOX_REGISTRY_URL");
+
+    StandIn server;
+    Checker checker(home);
+    bool allOk = true;
+    std::cout << "downloads of " << size << " bytes" << std::endl;
+
+    // dropped: cut 40% in, then resumed from exactly there
+    {
+        Registry registry;
+        std::string content = makeContent(size, 1);
+        server.publish(content, "\"d1\"");
+        server.cutNext(1, size * 2 / 5);
+        bool ok = checker.download(registry, server.url("dropped.so"), content);
+        auto log = server.takeLog();
+        bool shape = log.size() == 2 && log[0].status == 200 && log[1].status == 206 &&
+                     log[1].from == log[0].sent;
+        allOk &= checker.report("dropped", ok, log, shape);
+    }
+
+    // changed: every attempt is cut, so the partial download stays behind;
+    // the file then changes and If-Range must not splice the two together
+    {
+        std::string oldContent = makeContent(size, 2);
+        server.publish(oldContent, "\"c1\"");
+        server.cutNext(100, size / 8);
+        {
+            Registry registry;
+            DownloadResult ignored;
+            registry.downloadToFile(server.url("changed.so"), home + "/changed-partial", ignored);
+        }
+        auto partialLog = server.takeLog();
+
+        Registry registry;
+        std::string content = makeContent(size, 3);
+        server.publish(content, "\"c2\"");
+        server.cutNext(0, 0);
+        bool ok = checker.download(registry, server.url("changed.so"), content);
+        auto log = server.takeLog();
+        bool shape = partialLog.size() > 1 && partialLog.back().status == 206 && log.size() == 1 &&
+                     log[0].status == 200 && log[0].from == 0;
+        allOk &= checker.report("changed", ok, log, shape);
+    }
+
+    // no-ranges: the range request is answered with the whole file
+    {
+        Registry registry;
+        std::string content = makeContent(size, 4);
+        server.publish(content, "\"n1\"");
+        server.setHonorRange(false);
+        server.cutNext(1, size / 3);
+        bool ok = checker.download(registry, server.url("no-ranges.so"), content);
+        auto log = server.takeLog();
+        bool shape = log.size() == 2 && log[1].status == 200 && log[1].sent == size;
+        allOk &= checker.report("no-ranges", ok, log, shape);
+        server.setHonorRange(true);
+    }
+
+    // stale-range: a partial download of a large file, then the file shrinks
+    // and the server answers the range without looking at If-Range
+    {
+        std::string oldContent = makeContent(size, 5);
+        server.publish(oldContent, "\"s1\"");
+        server.cutNext(100, size / 4);
+        {
+            Registry registry;
+            DownloadResult ignored;
+            registry.downloadToFile(server.url("stale.so"), home + "/stale-partial", ignored);
+        }
+        server.takeLog();
+
+        Registry registry;
+        std::string content = makeContent(size / 4, 6);
+        server.publish(content, "\"s2\"");
+        server.setHonorIfRange(false);
+        server.cutNext(0, 0);
+        bool ok = checker.download(registry, server.url("stale.so"), content);
+        auto log = server.takeLog();
+        bool shape = log.size() == 2 && log[0].status == 416 && log[1].status == 200 && log[1].from == 0;
+        allOk &= checker.report("stale-range", ok, log, shape);
+        server.setHonorIfRange(true);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(home, ec);
+    return allOk ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Module search benchmark
+//
+// Compares lowercasing every name into a fresh std::string per query (how
+// search used to work) with SearchIndex, over a synthetic registry of
+// mixed-case names and descriptions: index build time, time per query,
+// names scanned per millisecond and heap allocations per query.
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run ./box_bench_search [modules]
+
+#include "search_index.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace box;
+
+// Every heap allocation in the process goes through these counters
+static std::atomic<size_t> allocCount{0};
+
+void* operator new(size_t size) {
+    allocCount++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+const char* WORDS[] = {"Json", "http", "Base64", "crypto", "Zip", "sql", "Image", "yaml", "Net", "regex",
+                       "Log", "utf8", "Time", "math", "Xml", "uuid", "Csv", "hash", "Socket", "color"};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+std::string toLower(const std::string& value) {
+    std::string lower = value;
+    for (char& c : lower) c = (char)std::tolower((unsigned char)c);
+    return lower;
+}
+
+// Legacy search: a lowercased copy of every name, every query
+size_t legacySearch(const std::vector<std::string>& names, const std::string& query) {
+    std::string lowerQuery = toLower(query);
+    size_t found = 0;
+    for (const auto& name : names) {
+        if (toLower(name).find(lowerQuery) != std::string::npos) found++;
+    }
+    return found;
+}
+
+template <typename Fn>
+double timeMs(Fn&& fn, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t modules = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    if (modules == 0) modules = 1;
+
+    std::vector<std::pair<std::string, std::string>> registry;
+    registry.reserve(modules);
+    uint64_t seed = 42;
+    auto next = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (size_t)(seed >> 33);
+    };
+    for (size_t i = 0; i < modules; i++) {
+        std::string name = std::string(WORDS[next() % WORD_COUNT]) + "-" + WORDS[next() % WORD_COUNT] +
+                           std::to_string(i);
+        std::string description = std::string("A ") + WORDS[next() % WORD_COUNT] + " library for " +
+                                  WORDS[next() % WORD_COUNT] + " and " + WORDS[next() % WORD_COUNT] + " data";
+        registry.emplace_back(std::move(name), std::move(description));
+    }
+
+    // Modules in generation order, then in name order as the registry adds them
+    std::vector<std::string> names;
+    names.reserve(modules);
+    for (const auto& module : registry) names.push_back(module.first);
+
+    double shuffledMs = timeMs([&]() {
+        SearchIndex shuffled;
+        for (const auto& module : registry) shuffled.add(module.first, module.second);
+        shuffled.build();
+    }, 1);
+
+    std::sort(registry.begin(), registry.end(), [](const auto& a, const auto& b) {
+        return toLower(a.first) < toLower(b.first);
+    });
+    SearchIndex index;
+    double buildMs = timeMs([&]() {
+        for (const auto& module : registry) index.add(module.first, module.second);
+        index.build();
+    }, 1);
+    std::cout << modules << " modules, index built in " << buildMs << " ms (" << shuffledMs
+              << " ms out of name order)" << std::endl;
+
+    const char* queries[] = {"zi", "JSON-H", "base64-yaml12", "qqqq", "library for regex", "sockt-colr7"};
+    for (const char* query : queries) {
+        size_t legacyFound = 0;
+        double legacyMs = timeMs([&]() { legacyFound = legacySearch(names, query); }, 1);
+
+        // The first query is timed on its own, as a CLI search only ever runs one
+        size_t found = 0;
+        double firstMs = timeMs([&]() { found = index.search(query, 20).size(); }, 1);
+        size_t allocations = allocCount;
+        double ms = timeMs([&]() { found = index.search(query, 20).size(); }, 5);
+        allocations = (allocCount - allocations) / 5;
+
+        std::cout << "\"" << query << "\": legacy " << legacyMs << " ms (" << legacyFound << " names, "
+                  << modules / legacyMs << " names/ms); index " << ms << " ms, first " << firstMs
+                  << " ms (top " << found << ", " << modules / ms << " names/ms, " << allocations
+                  << " allocations)" << std::endl;
+    }
+    return 0;
+}
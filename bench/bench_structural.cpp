@@ -0,0 +1,224 @@
+// Structural indexing benchmark
+//
+// Builds one large registry dump ({"modules":{"<name>":<manifest>,...}}, the
+// shape a mirror sweep reads) and measures the stage-1 structural index with
+// each classifier, then json::Reader with its SIMD scans and with plain byte
+// loops, both parsing everything and skipping each manifest as a raw value.
+// Both reader paths must hand the handler the same event stream, on the dump
+// and on strings whose backslash runs straddle 64-byte blocks; a difference
+// exits 1, so ctest runs this with a small dump.
+//
+// Build with -DBOX_BUILD_BENCHMARKS=ON and run ./box_bench_structural [megabytes]
+
+#include "json.h"
+#include "structural.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace box;
+
+namespace {
+
+std::string makeManifest(size_t index, size_t versions) {
+    std::string name = "module" + std::to_string(index);
+    std::string out = "{\"name\":\"" + name + "\",\"description\":\"The " + name + " module, \\\"quoted\\\"\","
+                      "\"author\":\"author" + std::to_string(index % 50) + "\",\"license\":\"MIT\","
+                      "\"latest\":\"1." + std::to_string(versions - 1) + ".0\",\"versions\":{";
+    for (size_t i = 0; i < versions; i++) {
+        if (i) out += ",";
+        std::string v = "1." + std::to_string(i) + ".0";
+        out += "\"" + v + "\":{\"description\":\"Release " + v + " of " + name + "\","
+               "\"entry-linux\":\"https://example.com/bin/" + name + "/" + v + "/" + name + ".so\","
+               "\"entry-win\":\"https://example.com/bin/" + name + "/" + v + "/" + name + ".dll\","
+               "\"deps\":{\"neutron\":\">=1.0.0\",\"module" + std::to_string(i % 97) + "\":\"^1.0.0\"}";
+        if (i % 4 == 0) {
+            out += ",\"git\":{\"url\":\"https://github.com/box-modules/" + name + ".git\",\"ref\":\"v" + v + "\"}";
+        }
+        out += "}";
+    }
+    out += "}}";
+    return out;
+}
+
+// Counts events so the parse can't be optimized away
+class CountingHandler : public json::Handler {
+public:
+    explicit CountingHandler(bool skipManifests) : skipManifests(skipManifests) {}
+
+    bool startObject() override { depth++; events++; return true; }
+    bool endObject() override { depth--; return true; }
+    bool startArray() override { depth++; events++; return true; }
+    bool endArray() override { depth--; return true; }
+    bool key(std::string_view name) override { bytes += name.size(); return true; }
+    bool string(std::string_view value) override { bytes += value.size(); events++; return true; }
+    bool number(std::string_view) override { events++; return true; }
+    bool skipValue() override { return skipManifests && depth == 2; }
+    bool raw(std::string_view text) override { bytes += text.size(); events++; return true; }
+
+    size_t events = 0;
+    size_t bytes = 0;
+
+private:
+    bool skipManifests;
+    int depth = 0;
+};
+
+// Hashes every event (kind plus text) so two parses can be compared in full
+class StreamHandler : public json::Handler {
+public:
+    explicit StreamHandler(bool skipManifests) : skipManifests(skipManifests) {}
+
+    bool startObject() override { depth++; add('{'); return true; }
+    bool endObject() override { depth--; add('}'); return true; }
+    bool startArray() override { depth++; add('['); return true; }
+    bool endArray() override { depth--; add(']'); return true; }
+    bool key(std::string_view name) override { add('k', name); return true; }
+    bool string(std::string_view value) override { add('s', value); return true; }
+    bool number(std::string_view raw) override { add('n', raw); return true; }
+    bool boolean(bool value) override { add(value ? 't' : 'f'); return true; }
+    bool null() override { add('0'); return true; }
+    bool skipValue() override { return skipManifests && depth == 2; }
+    bool raw(std::string_view text) override { add('r', text); return true; }
+
+    bool operator==(const StreamHandler& other) const { return events == other.events && hash == other.hash; }
+    bool operator!=(const StreamHandler& other) const { return !(*this == other); }
+
+    size_t events = 0;
+
+private:
+    void mix(unsigned char byte) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+
+    // FNV-1a over the kind, the text length and the text
+    void add(char kind, std::string_view text = {}) {
+        events++;
+        mix(static_cast<unsigned char>(kind));
+        for (size_t n = text.size(); ; n >>= 8) {
+            mix(static_cast<unsigned char>(n));
+            if (n < 256) break;
+        }
+        for (char c : text) mix(static_cast<unsigned char>(c));
+    }
+
+    bool skipManifests;
+    int depth = 0;
+    unsigned long long hash = 1469598103934665603ull;
+};
+
+// Parses input with the SIMD scans and with byte loops and compares the streams
+bool sameStreams(std::string_view input, bool skip, std::string* error) {
+    StreamHandler streams[2] = {StreamHandler(skip), StreamHandler(skip)};
+    for (bool vectorized : {false, true}) {
+        json::Reader reader(input);
+        reader.setVectorized(vectorized);
+        if (!reader.parse(streams[vectorized])) {
+            *error = (vectorized ? "simd: " : "byte loop: ") + reader.getError();
+            return false;
+        }
+    }
+    if (streams[0] != streams[1]) {
+        *error = "event streams differ (" + std::to_string(streams[0].events) + " vs " +
+                 std::to_string(streams[1].events) + " events)";
+        return false;
+    }
+    return true;
+}
+
+// Strings, keys and skipped values with backslash runs of every length up to
+// two blocks, each shifted through every offset of a 64-byte block
+std::vector<std::string> makeEscapeInputs() {
+    std::vector<std::string> inputs;
+    for (size_t run = 1; run <= 130; run++) {
+        for (size_t pad = 0; pad < 64; pad++) {
+            // An odd run ends by escaping a quote, an even one is all escaped backslashes
+            std::string text = std::string(pad, 'a') + std::string(run, '\\') + (run % 2 ? "\"" : "") + "z";
+            inputs.push_back("{\"modules\":{\"" + text + "\":{\"description\":\"" + text + "\","
+                             "\"versions\":[\"" + text + "\",\"" + text + "\"]},\"tail\":\"" + text + "\"}}");
+        }
+    }
+    return inputs;
+}
+
+template <typename Fn>
+double timeMs(Fn&& fn, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+void report(const std::string& label, size_t bytes, double ms) {
+    double gbPerSec = (bytes / 1e9) / (ms / 1000.0);
+    std::cout << "  " << label << ": " << ms << " ms (" << gbPerSec << " GB/s)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    if (megabytes == 0) megabytes = 1;
+    size_t target = megabytes * 1024 * 1024;
+
+    std::string corpus = "{\"modules\":{";
+    corpus.reserve(target + (1 << 20));
+    size_t modules = 0;
+    while (corpus.size() < target) {
+        if (modules) corpus += ",";
+        corpus += "\"module" + std::to_string(modules) + "\":" + makeManifest(modules, 5 + modules % 40);
+        modules++;
+    }
+    corpus += "}}";
+    std::cout << "corpus: " << modules << " manifests, " << corpus.size() << " bytes" << std::endl;
+
+    std::string error;
+    std::vector<std::string> escapes = makeEscapeInputs();
+    for (const auto& input : escapes) {
+        for (bool skip : {false, true}) {
+            if (!sameStreams(input, skip, &error)) {
+                std::cerr << "Escape input " << input << (skip ? " (skipped)" : "") << ": " << error << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "event streams match on " << escapes.size() << " escape inputs" << std::endl;
+
+    std::cout << "stage 1 (best: " << json::StructuralIndex::kernelName(json::StructuralIndex::Kernel::AUTO)
+              << ")" << std::endl;
+    json::StructuralIndex index;
+    for (auto kernel : {json::StructuralIndex::Kernel::SCALAR, json::StructuralIndex::Kernel::SSE2,
+                        json::StructuralIndex::Kernel::AVX2}) {
+        if (!json::StructuralIndex::isSupported(kernel)) {
+            std::cout << "  " << json::StructuralIndex::kernelName(kernel) << ": not supported" << std::endl;
+            continue;
+        }
+        index.build(corpus, kernel);  // warm up (and size the position buffer)
+        double ms = timeMs([&]() { index.build(corpus, kernel); }, 3);
+        report(json::StructuralIndex::kernelName(kernel), corpus.size(), ms);
+    }
+    std::cout << "  " << index.size() << " structural positions" << std::endl;
+
+    for (bool skip : {false, true}) {
+        std::cout << (skip ? "reader, manifests skipped as raw values" : "reader, full parse") << std::endl;
+        double ms[2] = {0, 0};
+        for (bool vectorized : {false, true}) {
+            json::Reader reader(corpus);
+            reader.setVectorized(vectorized);
+            ms[vectorized] = timeMs([&]() {
+                CountingHandler handler(skip);
+                if (!reader.parse(handler)) std::cerr << reader.getError() << std::endl;
+            }, 3);
+            report(vectorized ? "simd" : "byte loop", corpus.size(), ms[vectorized]);
+        }
+        if (!sameStreams(corpus, skip, &error)) {
+            std::cerr << "Corpus: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "  speedup: " << ms[0] / ms[1] << "x" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef BOX_BLOOM_H
+#define BOX_BLOOM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * Bloom filter over module names (~/.box/cache/index.bloom)
+ *
+ * Built from the index whenever Box parses one, at about 10 bits per name
+ * (under 1% false positives). A name the filter rejects is certainly not
+ * in that index, so such lookups are answered without parsing it. The
+ * file records which cached nur.json it was built from.
+ */
+class BloomFilter {
+public:
+    BloomFilter();
+
+    /**
+     * Clear the filter and size it for a number of names
+     * @param expectedNames Names that will be added
+     */
+    void reset(size_t expectedNames);
+
+    /**
+     * Add a name
+     */
+    void add(std::string_view name);
+
+    /**
+     * Check a name
+     * @return false if the name was certainly never added
+     */
+    bool mightContain(std::string_view name) const;
+
+    /**
+     * Check if the filter holds any bits (reset() or read() was called)
+     */
+    bool empty() const;
+
+    /**
+     * Write the filter to a file
+     * @param path Output file
+     * @param source URL of the index it was built from
+     * @param generation Cache generation of that index's body
+     * @param serial Index serial, 0 if unknown
+     * @return true if successful
+     */
+    bool write(const std::string& path, const std::string& source, uint64_t generation, uint32_t serial) const;
+
+    /**
+     * Read a filter file
+     * @param path Filter file
+     * @param source Receives the URL of the index it was built from
+     * @param generation Receives the cache generation of that index's body
+     * @param serial Receives the index serial
+     * @return true if the file exists and is valid
+     */
+    bool read(const std::string& path, std::string& source, uint64_t& generation, uint32_t& serial);
+
+private:
+    std::vector<uint64_t> bits;
+    uint32_t hashCount = 0;
+};
+
+} // namespace box
+
+#endif // BOX_BLOOM_H
@@ -0,0 +1,72 @@
+#ifndef BOX_BUNDLE_H
+#define BOX_BUNDLE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * Registry-published archive of every module manifest (nur.bundle)
+ *
+ * Layout: a fixed header, an offset table sorted by manifest SHA-256, and
+ * the manifests themselves, each stored raw or as its own zstd frame. Only
+ * the header and table are read on open; a manifest is read with one seek
+ * when it is asked for, so the archive never has to be extracted.
+ * Manifests are looked up by the hash the index publishes for them and
+ * checked against it after decoding.
+ */
+class ManifestBundle {
+public:
+    ManifestBundle();
+    ~ManifestBundle();
+
+    ManifestBundle(const ManifestBundle&) = delete;
+    ManifestBundle& operator=(const ManifestBundle&) = delete;
+
+    /**
+     * Open a bundle file and read its offset table
+     * @param path Bundle file
+     * @return true if the file exists and is a valid bundle
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Close the file
+     */
+    void close();
+
+    /**
+     * Check if a bundle is open
+     */
+    bool isOpen() const;
+
+    /**
+     * Get the number of manifests in the bundle
+     */
+    size_t size() const;
+
+    /**
+     * Read one manifest
+     * @param sha256 Hex digest the index publishes for the manifest
+     * @param content Receives the decoded manifest
+     * @return true if the bundle holds a manifest with that digest (and,
+     *         for zstd entries, Box was built with zstd)
+     */
+    bool read(const std::string& sha256, std::string& content);
+
+private:
+    std::ifstream file;
+    uint64_t fileSize = 0;
+    size_t count = 0;
+    std::vector<unsigned char> table;  // count entries, sorted by digest
+    std::string buffer;                // compressed bytes of the entry being read
+    void* decompressor = nullptr;      // ZSTD_DCtx*, created on first use
+};
+
+} // namespace box
+
+#endif // BOX_BUNDLE_H
@@ -0,0 +1,199 @@
+#ifndef BOX_CACHE_H
+#define BOX_CACHE_H
+
+#include <string>
+#include <functional>
+#include <cstddef>
+
+namespace box {
+
+/**
+ * Cached HTTP response together with its validators
+ */
+struct CacheEntry {
+    std::string url;
+    std::string body;
+    std::string etag;          // ETag response header
+    std::string lastModified;  // Last-Modified response header
+    long long fetchedAt = 0;   // Unix time of the last successful (re)validation
+    std::string encoding;      // how the body is kept on disk: "zstd", or empty for raw
+    long long generation = 0;  // changes whenever store() rewrites the body, 0 if unknown
+};
+
+/**
+ * On-disk cache for registry documents (~/.box/cache)
+ *
+ * Each entry is stored as a body file plus a small ".meta" file holding
+ * the validators used for conditional revalidation. When Box is built with
+ * zstd (BOX_HAVE_ZSTD) bodies are written zstd-compressed to ".body.zst"
+ * and decompressed on load; otherwise, or when compression doesn't pay,
+ * they are written raw to ".body". Interrupted binary
+ * downloads are kept under downloads/ with the same kind of ".meta" file,
+ * so they can be resumed with a Range request.
+ */
+class Cache {
+public:
+    Cache();
+
+    /**
+     * Create a cache rooted at a specific directory
+     * @param dir Cache directory
+     */
+    explicit Cache(const std::string& dir);
+
+    /**
+     * Load a cached entry
+     * @param url URL the entry was fetched from
+     * @param entry Filled with the cached body and validators
+     * @return true if the entry exists
+     */
+    bool load(const std::string& url, CacheEntry& entry) const;
+
+    /**
+     * Load only the validators of a cached entry (body is left empty)
+     * @param url URL the entry was fetched from
+     * @param entry Filled with the cached validators
+     * @return true if the entry exists
+     */
+    bool loadMeta(const std::string& url, CacheEntry& entry) const;
+
+    /**
+     * Read a cached entry's body in chunks instead of loading it whole
+     * @param url URL the entry was fetched from
+     * @param entry Filled with the cached validators (body is left empty)
+     * @param onData Called with each chunk of the decoded body; returning
+     *               false stops reading
+     * @return true if the entry exists and was read to the end
+     */
+    bool stream(const std::string& url, CacheEntry& entry,
+                const std::function<bool(const char* data, size_t size)>& onData) const;
+
+    /**
+     * Store an entry, replacing any previous one for the same URL
+     * @param entry Entry to store (entry.url is the key)
+     * @return true if successful
+     */
+    bool store(const CacheEntry& entry) const;
+
+    /**
+     * Store an entry whose body was streamed to a file
+     * The file is compressed chunk by chunk (or moved in raw), so memory
+     * use doesn't grow with its size.
+     * @param entry Validators to store (entry.url is the key; entry.body is ignored)
+     * @param bodyPath File holding the body; it is consumed either way
+     * @return true if successful
+     */
+    bool storeFile(const CacheEntry& entry, const std::string& bodyPath) const;
+
+    /**
+     * Mark an entry as freshly revalidated (after a 304 response)
+     * @param entry Entry to update
+     * @return true if successful
+     */
+    bool touch(CacheEntry& entry) const;
+
+    /**
+     * Get the cache directory
+     * @return Path to the cache directory
+     */
+    std::string getCacheDir() const;
+
+    /**
+     * Get the on-disk path used for a URL (without extension)
+     * @param url URL of the entry
+     * @return Base path of the body and meta files
+     */
+    std::string pathFor(const std::string& url) const;
+
+    /**
+     * Get the path of the (possibly partial) download file for a URL
+     * @param url URL being downloaded
+     * @return Path under the downloads/ directory
+     */
+    std::string partialPathFor(const std::string& url) const;
+
+    /**
+     * Get a temp file name next to a path that no other box process picks
+     * Files are written under it and renamed into place, so concurrent
+     * writers (a detached refresh and a foreground command) never share one.
+     * @param path Final path of the file
+     * @return path plus a ".<pid>-<random>.tmp" suffix
+     */
+    static std::string tempPathFor(const std::string& path);
+
+    /**
+     * Load the validators of a partial download (body is left empty)
+     * @param url URL being downloaded
+     * @param entry Filled with the validators the partial data came with
+     * @param size Receives the number of bytes already downloaded
+     * @return true if a resumable partial download exists
+     */
+    bool loadPartial(const std::string& url, CacheEntry& entry, size_t& size) const;
+
+    /**
+     * Record the validators of a partial download so it can be resumed
+     * @param entry Validators of the partial data (entry.url is the key)
+     * @return true if successful
+     */
+    bool storePartial(const CacheEntry& entry) const;
+
+    /**
+     * Forget a partial download's validators
+     * @param url URL being downloaded
+     * @param removeData Also delete the downloaded bytes
+     */
+    void dropPartial(const std::string& url, bool removeData) const;
+
+    /**
+     * Take a lock file (<cache>/<name>.lock) shared by all box processes
+     * A lock older than maxAge seconds is assumed abandoned and taken over.
+     * @param name Lock name
+     * @param maxAge Seconds after which the lock no longer counts
+     * @return true if this process now holds the lock
+     */
+    bool lock(const std::string& name, long long maxAge) const;
+
+    /**
+     * Check whether another process holds a lock taken with lock()
+     */
+    bool isLocked(const std::string& name, long long maxAge) const;
+
+    /**
+     * Release a lock taken with lock()
+     */
+    void unlock(const std::string& name) const;
+
+private:
+    std::string cacheDir;
+
+    /**
+     * Read a ".meta" file, checking it belongs to url
+     */
+    bool readMeta(const std::string& metaPath, const std::string& url, CacheEntry& entry) const;
+
+    /**
+     * Read a body file, decoding it according to encoding
+     */
+    static bool readBody(const std::string& base, const std::string& encoding, std::string& body);
+
+    /**
+     * Write a ".meta" file atomically
+     */
+    bool writeMeta(const CacheEntry& entry, const std::string& metaPath) const;
+
+    /**
+     * Get the validators store() writes for an entry, with a new generation
+     */
+    static CacheEntry metaFor(const CacheEntry& entry);
+
+    /**
+     * Move a finished body file into place and write its ".meta"
+     * @param meta Validators and encoding of the body
+     * @param tmpPath Body file, next to its final location
+     */
+    bool installBody(const CacheEntry& meta, const std::string& tmpPath) const;
+};
+
+} // namespace box
+
+#endif // BOX_CACHE_H
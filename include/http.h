@@ -0,0 +1,192 @@
+#ifndef BOX_HTTP_H
+#define BOX_HTTP_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <utility>
+#include <atomic>
+
+namespace box {
+
+/**
+ * Result of a single HTTP GET
+ */
+struct HttpResponse {
+    long status = 0;
+    std::string body;
+    std::string etag;
+    std::string lastModified;
+    size_t size = 0;     // bytes written when the body was streamed to a file
+    std::string sha256;  // hex digest of the streamed body
+    double firstByteTime = 0.0;  // seconds from the start of the request to the first response byte
+    bool fromHedge = false;      // answered by the hedged duplicate (HttpRequest::hedgeURL)
+    bool connectFailed = false;  // the server could not be resolved or connected to
+    std::string contentEncoding; // Content-Encoding the body arrived in (already decoded)
+};
+
+/**
+ * A GET request to run as part of a batch
+ *
+ * Built from a URL, headers and output path; the less common options
+ * (resumeFrom, hedgeURL, onBody) are then set by name.
+ */
+struct HttpRequest {
+    HttpRequest() = default;
+
+    /**
+     * @param url URL to GET
+     * @param headers Extra request headers ("Name: value")
+     * @param outputPath File to stream the body to, or empty to buffer it
+     */
+    explicit HttpRequest(std::string url, std::vector<std::string> headers = {}, std::string outputPath = "")
+        : url(std::move(url)), headers(std::move(headers)), outputPath(std::move(outputPath)) {}
+
+    std::string url;
+    std::vector<std::string> headers;  // extra request headers ("Name: value")
+    std::string outputPath;  // if set, stream the body to this file instead of HttpResponse::body
+    size_t resumeFrom = 0;   // keep this many bytes of outputPath if the server answers 206;
+                             // the caller sends the matching Range/If-Range headers
+    std::string hedgeURL;    // buffered requests only: if no byte arrives within the hedge
+                             // delay, also GET this URL (may equal url) and keep the first answer
+    std::function<bool(const char* data, size_t size)> onBody;
+                             // streamed requests without resumeFrom only: also called with each
+                             // chunk of a 2xx body as it is written; returning false aborts
+};
+
+/**
+ * Connection usage counters for an HttpClient
+ */
+struct HttpStats {
+    size_t requests = 0;
+    size_t connectionsOpened = 0;  // transfers that needed a new connection
+    size_t connectionsReused = 0;  // transfers served over an existing connection
+    size_t hedgesSent = 0;         // duplicate requests sent for slow first bytes
+    size_t hedgesWon = 0;          // duplicates that answered before the original
+    size_t wireBytes = 0;          // response bytes as received: headers plus encoded bodies
+    size_t bodyBytes = 0;          // decoded body bytes handed to callers
+};
+
+/**
+ * Long-lived HTTP client with a connection pool
+ *
+ * On Unix the client owns a curl multi handle (connection cache, HTTP/2
+ * multiplexing), a share handle for DNS and TLS session caches, and a set
+ * of idle easy handles that are recycled between requests. On Windows a
+ * single WinINet session is kept open for the lifetime of the client.
+ *
+ * Responses may be gzip, deflate, brotli or zstd encoded (whatever the
+ * library was built with) and are decoded before they reach the caller.
+ * Resumed downloads ask for the identity encoding, because a byte range of
+ * an encoded body can't be appended to decoded data.
+ */
+class HttpClient {
+public:
+    HttpClient();
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    /**
+     * Perform an HTTP GET
+     * @param url URL to fetch
+     * @param headers Extra request headers ("Name: value")
+     * @param response Filled with status, body and validators
+     * @return true if the transfer completed (any status code)
+     */
+    bool get(const std::string& url, const std::vector<std::string>& headers, HttpResponse& response);
+
+    /**
+     * Perform an HTTP GET, streaming the body straight to a file
+     * The file is preallocated from Content-Length where supported and
+     * hashed as it is written, so memory use doesn't grow with its size.
+     * @param url URL to fetch
+     * @param headers Extra request headers ("Name: value")
+     * @param outputPath File to create (truncated if it exists)
+     * @param response Filled with status, validators, size and SHA-256
+     * @return true if the transfer completed and the file was written;
+     *         on failure whatever arrived is left in outputPath
+     */
+    bool download(const std::string& url, const std::vector<std::string>& headers,
+                  const std::string& outputPath, HttpResponse& response);
+
+    /**
+     * Perform several GETs concurrently over the shared connection pool
+     * @param requests Requests to run
+     * @param responses Filled with one response per request, in request order
+     * @param maxConcurrent Maximum number of transfers in flight at once
+     * @return Per-request flag telling whether the transfer completed
+     */
+    std::vector<bool> getAll(const std::vector<HttpRequest>& requests,
+                             std::vector<HttpResponse>& responses,
+                             size_t maxConcurrent);
+
+    /**
+     * Get connection usage counters
+     */
+    const HttpStats& getStats() const;
+
+    /**
+     * Enable or disable hedged requests (on by default; curl only)
+     */
+    void setHedging(bool enabled);
+
+    /**
+     * Get how long a buffered request may wait for its first byte before
+     * it is hedged: the p95 of recent first-byte times, or a default until
+     * enough requests have been seen
+     * @return Delay in seconds
+     */
+    double getHedgeDelay() const;
+
+    /**
+     * Abort the transfers in flight and fail every later request
+     * May be called from another thread than the one running requests.
+     * WinINet requests can't be interrupted; the one in flight finishes.
+     */
+    void cancel();
+
+    /**
+     * Check whether cancel() was called
+     */
+    bool isCancelled() const;
+
+private:
+    // Opaque library handles so callers don't need curl/WinINet headers
+    void* multi = nullptr;   // CURLM* / unused on Windows
+    void* share = nullptr;   // CURLSH* / HINTERNET session
+    std::vector<void*> idleHandles;  // CURL* ready for reuse
+    HttpStats stats;
+    bool hedging = true;
+    std::atomic<bool> cancelled{false};
+    std::vector<double> firstByteSamples;  // recent first-byte times of buffered requests (ring)
+    size_t nextSample = 0;
+
+    /**
+     * Add a first-byte time to the samples the hedge delay is taken from
+     */
+    void recordFirstByte(double seconds);
+
+    /**
+     * Take an easy handle from the pool (or create one)
+     */
+    void* acquireHandle();
+
+    /**
+     * Return an easy handle to the pool
+     */
+    void releaseHandle(void* handle);
+
+#ifdef _WIN32
+    /**
+     * Perform one blocking WinINet request
+     */
+    bool fetchOne(const HttpRequest& request, HttpResponse& response);
+#endif
+};
+
+} // namespace box
+
+#endif // BOX_HTTP_H
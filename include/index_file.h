@@ -0,0 +1,127 @@
+#ifndef BOX_INDEX_FILE_H
+#define BOX_INDEX_FILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * Module entry read from a compiled index
+ *
+ * Views point into the memory-mapped file and stay valid while it is open.
+ */
+struct IndexEntry {
+    std::string_view name;
+    std::string_view url;          // absolute manifest URL
+    std::string_view latest;       // empty if the manifest wasn't cached
+    std::string_view description;  // empty if the manifest wasn't cached
+    std::string_view hash;         // manifest SHA-256 from the index, if published
+};
+
+/**
+ * Module entry to write into a compiled index
+ */
+struct IndexSourceEntry {
+    std::string name;
+    std::string url;
+    std::string latest;
+    std::string description;
+    std::string hash;
+};
+
+/**
+ * Validators of the nur.json a compiled index was built from
+ */
+struct IndexSource {
+    std::string url;
+    std::string etag;
+    std::string lastModified;
+    uint32_t serial = 0;  // index serial, 0 if the registry doesn't publish one
+};
+
+/**
+ * Compiled, memory-mapped registry index (~/.box/cache/index.bin)
+ *
+ * Layout: a fixed header, a minimal perfect hash (one seed per bucket plus
+ * one slot per module), a name-sorted entry table, and a string pool the
+ * entries point into. Lookups hash the name, read two table cells and
+ * compare one string: no parsing and no allocation.
+ */
+class CompiledIndex {
+public:
+    CompiledIndex();
+    ~CompiledIndex();
+
+    CompiledIndex(const CompiledIndex&) = delete;
+    CompiledIndex& operator=(const CompiledIndex&) = delete;
+
+    /**
+     * Build and write a compiled index
+     * @param path Output file
+     * @param source Validators of the nur.json the entries came from
+     * @param entries Modules to include (order doesn't matter)
+     * @return true if successful
+     */
+    static bool write(const std::string& path, const IndexSource& source,
+                      std::vector<IndexSourceEntry> entries);
+
+    /**
+     * Map a compiled index file
+     * @param path Index file
+     * @return true if the file exists and is a valid index
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Unmap the file
+     */
+    void close();
+
+    /**
+     * Check if an index is mapped
+     */
+    bool isOpen() const;
+
+    /**
+     * Find a module by exact name
+     * @param name Module name
+     * @param entry Filled on success
+     * @return true if the module is in the index
+     */
+    bool lookup(std::string_view name, IndexEntry& entry) const;
+
+    /**
+     * Get the number of modules
+     */
+    size_t size() const;
+
+    /**
+     * Get a module by position in name order
+     * @param index Position, less than size()
+     */
+    IndexEntry at(size_t index) const;
+
+    /**
+     * Get the nur.json URL and validators this index was built from
+     */
+    std::string_view getSourceURL() const;
+    std::string_view getSourceETag() const;
+    std::string_view getSourceLastModified() const;
+    uint32_t getSourceSerial() const;
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    void* mapping = nullptr;  // Windows file mapping handle
+
+    std::string_view stringAt(uint32_t offset, uint32_t size) const;
+    uint32_t readU32(size_t offset) const;
+};
+
+} // namespace box
+
+#endif // BOX_INDEX_FILE_H
@@ -2,6 +2,7 @@
 #define BOX_INSTALLER_H
 
 #include "registry.h"
+#include "store.h"
 #include <string>
 #include <vector>
 
@@ -22,6 +23,15 @@ public:
      */
     bool install(const std::string& moduleName, bool global = true);
 
+    /**
+     * Download manifests and prebuilt binaries for several modules in parallel
+     * Subsequent install() calls for these modules are served from memory.
+     * @param moduleSpecs Modules to prefetch ("name" or "name@version")
+     * @param maxConcurrent Maximum number of downloads in flight
+     * @return true if the registry index could be loaded
+     */
+    bool prefetch(const std::vector<std::string>& moduleSpecs, size_t maxConcurrent);
+
     /**
      * Uninstall a module
      * @param moduleName Name of the module to uninstall
@@ -60,11 +70,31 @@ public:
      */
     std::string getInstallDir(bool global = true);
 
+    /**
+     * Get the registry client used by this installer
+     * @return Registry shared by every install of this installer
+     */
+    Registry& getRegistry();
+
 private:
     Registry registry;
+    Store store;                   // ~/.box/store/, shared by global and local installs
     std::string globalModulesDir;  // ~/.box/modules/
     std::string localModulesDir;   // ./box/
 
+    /**
+     * Link the artifact recorded for a key into place
+     * @param key Store key of the artifact
+     * @param dest Path of the installed library
+     * @return true if the store had it
+     */
+    bool installFromStore(const std::string& key, const std::string& dest);
+
+    /**
+     * Add a freshly installed library to the store under a key
+     */
+    void addToStore(const std::string& file, const std::string& sha256, const std::string& key);
+
     /**
      * Download and install module binary
      */
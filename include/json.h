@@ -0,0 +1,101 @@
+#ifndef BOX_JSON_H
+#define BOX_JSON_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace box {
+namespace json {
+
+/**
+ * Receives parse events from Reader
+ *
+ * String views point into the input buffer when the string has no escapes,
+ * otherwise into a scratch buffer that is only valid during the callback.
+ * Returning false from a callback stops parsing.
+ */
+class Handler {
+public:
+    virtual ~Handler() = default;
+
+    virtual bool startObject() { return true; }
+    virtual bool endObject() { return true; }
+    virtual bool startArray() { return true; }
+    virtual bool endArray() { return true; }
+    virtual bool key(std::string_view /*name*/) { return true; }
+    virtual bool string(std::string_view /*value*/) { return true; }
+    virtual bool number(std::string_view /*raw*/) { return true; }
+    virtual bool boolean(bool /*value*/) { return true; }
+    virtual bool null() { return true; }
+
+    /**
+     * Asked after each object key: return true to receive the key's value
+     * through raw() as unparsed text instead of as events. The value is
+     * only scanned for its end, so it is checked when it is parsed later.
+     */
+    virtual bool skipValue() { return false; }
+    virtual bool raw(std::string_view /*text*/) { return true; }
+};
+
+/**
+ * Single-pass, SAX-style JSON reader
+ *
+ * Walks the input exactly once and reports every token to a Handler. No
+ * per-token allocations are made except when decoding escaped strings.
+ * Strings and skipped values are crossed with StructuralIndex's SIMD
+ * scans rather than byte by byte.
+ */
+class Reader {
+public:
+    /**
+     * @param input JSON text; must outlive the reader
+     */
+    explicit Reader(std::string_view input);
+
+    /**
+     * Parse the whole input
+     * @param handler Receives parse events
+     * @return true if the input is valid JSON and no callback stopped parsing
+     */
+    bool parse(Handler& handler);
+
+    /**
+     * Get a description of the last error
+     */
+    const std::string& getError() const;
+
+    /**
+     * Get the byte offset at which parsing stopped
+     */
+    size_t getOffset() const;
+
+    /**
+     * Choose between the SIMD scans (the default) and plain byte loops
+     */
+    void setVectorized(bool enabled);
+
+private:
+    std::string_view input;
+    size_t pos = 0;
+    size_t depth = 0;
+    std::string scratch;  // decoded escaped strings
+    std::string error;
+    bool vectorized = true;
+
+    bool parseValue(Handler& handler);
+    bool parseObject(Handler& handler);
+    bool parseArray(Handler& handler);
+    bool parseString(std::string_view& out);
+    bool parseNumber(std::string_view& out);
+    bool parseLiteral(std::string_view literal);
+    bool skipRaw();
+    bool decodeEscapes(size_t start);
+    void skipWhitespace();
+    bool fail(const char* message);
+};
+
+} // namespace json
+} // namespace box
+
+#endif // BOX_JSON_H
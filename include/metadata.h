@@ -0,0 +1,332 @@
+#ifndef BOX_METADATA_H
+#define BOX_METADATA_H
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * Version-specific metadata
+ */
+struct GitMetadata {
+    std::string url;
+    std::string ref;  // branch, tag, or commit hash
+};
+
+/**
+ * Version-specific metadata
+ */
+struct VersionMetadata {
+    std::string description;
+    std::string entryLinux;
+    std::string entryWin;
+    std::string entryMac;
+    std::string sha256Linux;  // published digests of the entry binaries, if any
+    std::string sha256Win;
+    std::string sha256Mac;
+    GitMetadata git;
+    std::map<std::string, std::string> deps;
+};
+
+/**
+ * Module metadata from module.json
+ */
+struct ModuleMetadata {
+    std::string name;
+    std::string description;
+    std::string author;
+    std::string license;
+    std::string repository;
+    std::string latest;
+    std::map<std::string, VersionMetadata> versions;
+};
+
+/**
+ * Append-only storage for interned strings
+ *
+ * Strings are copied into large blocks and deduplicated through an
+ * open-addressing table, so a license, author or git URL repeated across
+ * thousands of versions is stored once. Views stay valid until clear().
+ */
+class StringArena {
+public:
+    StringArena();
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    /**
+     * Get the stored copy of a string, adding it if needed
+     * @return View into the arena (empty strings are not stored)
+     */
+    std::string_view intern(std::string_view value);
+
+    /**
+     * Copy a string that is unlikely to repeat, skipping the lookup table
+     * @return View into the arena (empty strings are not stored)
+     */
+    std::string_view store(std::string_view value);
+
+    /**
+     * Drop every string; views handed out before become invalid
+     */
+    void clear();
+
+    /**
+     * Get the number of distinct strings stored
+     */
+    size_t size() const;
+
+    /**
+     * Get the bytes held by the blocks and the lookup table
+     */
+    size_t memoryUsage() const;
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    size_t blockCapacity = 0;
+    size_t blockBytes = 0;                // total size of all blocks
+    std::vector<std::string_view> slots;  // power-of-two table, empty view = free
+    size_t count = 0;
+
+    std::string_view copy(std::string_view value);
+    void grow();
+};
+
+/**
+ * Contiguous run of table rows (what std::span would be in C++20)
+ */
+template <typename T>
+struct MetadataRange {
+    const T* first = nullptr;
+    size_t count = 0;
+
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return first[i]; }
+};
+
+/**
+ * Dependency of a compact version
+ */
+struct CompactDep {
+    std::string_view name;
+    std::string_view constraint;
+};
+
+/**
+ * VersionMetadata with every string interned in a MetadataTable
+ */
+struct CompactVersion {
+    std::string_view version;
+    std::string_view description;
+    std::string_view entryLinux;
+    std::string_view entryWin;
+    std::string_view entryMac;
+    std::string_view sha256Linux;
+    std::string_view sha256Win;
+    std::string_view sha256Mac;
+    std::string_view gitURL;
+    std::string_view gitRef;
+    uint32_t firstDep = 0;  // deps are rows [firstDep, firstDep + depCount) of the table
+    uint32_t depCount = 0;
+};
+
+/**
+ * ModuleMetadata with every string interned in a MetadataTable
+ */
+struct CompactModule {
+    std::string_view name;
+    std::string_view description;
+    std::string_view author;
+    std::string_view license;
+    std::string_view repository;
+    std::string_view latest;
+    uint32_t firstVersion = 0;  // versions are rows [firstVersion, firstVersion + versionCount)
+    uint32_t versionCount = 0;
+};
+
+/**
+ * Metadata of many modules in a few flat arrays
+ *
+ * Manifests are parsed straight into one StringArena and three vectors
+ * (modules, versions sorted by version string per module, and deps), so
+ * parsing a manifest costs no per-field or per-version allocations. Used
+ * where whole registries are scanned, such as compiling the index;
+ * toMetadata() expands a module into the usual ModuleMetadata.
+ */
+class MetadataTable {
+public:
+    MetadataTable();
+
+    MetadataTable(const MetadataTable&) = delete;
+    MetadataTable& operator=(const MetadataTable&) = delete;
+
+    /**
+     * Parse a manifest and add it as a module
+     * @param name Module name (should be unique within the table)
+     * @param content Manifest document
+     * @return true if the manifest is valid JSON
+     */
+    bool addManifest(std::string_view name, std::string_view content);
+
+    /**
+     * Get the number of modules
+     */
+    size_t size() const;
+
+    /**
+     * Get a module by position (in the order they were added)
+     */
+    const CompactModule& at(size_t index) const;
+
+    /**
+     * Find a module by name
+     * @return The module, or nullptr if the table doesn't have it
+     */
+    const CompactModule* find(std::string_view name) const;
+
+    /**
+     * Get the versions of a module, sorted by version string
+     */
+    MetadataRange<CompactVersion> versionsOf(const CompactModule& module) const;
+
+    /**
+     * Find one version of a module
+     * @return The version, or nullptr if the module doesn't have it
+     */
+    const CompactVersion* findVersion(const CompactModule& module, std::string_view version) const;
+
+    /**
+     * Get the dependencies of a version, sorted by name
+     */
+    MetadataRange<CompactDep> depsOf(const CompactVersion& version) const;
+
+    /**
+     * Expand a module into a ModuleMetadata
+     */
+    void toMetadata(const CompactModule& module, ModuleMetadata& metadata) const;
+
+    /**
+     * Drop every module
+     */
+    void clear();
+
+    /**
+     * Get the bytes held by the table, its arena included
+     */
+    size_t memoryUsage() const;
+
+private:
+    StringArena strings;
+    std::vector<CompactModule> modules;
+    std::vector<CompactVersion> versions;
+    std::vector<CompactDep> deps;
+    mutable std::vector<uint32_t> byName;  // module rows sorted by name, rebuilt by find()
+    mutable size_t byNameCount = 0;        // modules covered by byName
+};
+
+/**
+ * Module manifest whose versions are parsed on first use
+ *
+ * load() reads the top-level fields and records where each version's
+ * object lies in the document without parsing it; getVersion() parses one
+ * version when asked and keeps the result. Installing one version of a
+ * module with hundreds of releases then parses just that one.
+ *
+ * A version may also live in a file of its own, written as a path
+ * ("1.2.0": "./base64/1.2.0.json") or {"path": ..., "hash": <sha256>}.
+ * Registry::fetchVersion() downloads only the file it needs.
+ */
+class LazyManifest {
+public:
+    LazyManifest();
+
+    /**
+     * Take a manifest document and index its versions
+     * @param content Manifest document
+     * @return true if the document is valid JSON (version bodies are
+     *         checked when they are parsed)
+     */
+    bool load(std::string content);
+
+    const std::string& getDescription() const;
+    const std::string& getAuthor() const;
+    const std::string& getLicense() const;
+    const std::string& getRepository() const;
+    const std::string& getLatest() const;
+
+    /**
+     * Check if the manifest lists a version
+     */
+    bool hasVersion(const std::string& version) const;
+
+    /**
+     * Get every version, sorted by version string
+     */
+    std::vector<std::string> listVersions() const;
+
+    /**
+     * Get a version written inline in the manifest, parsing it on first use
+     * @param version Version key
+     * @param metadata Filled with the version's fields
+     * @return false if the version is missing, invalid or kept in its own file
+     */
+    bool getVersion(const std::string& version, VersionMetadata& metadata);
+
+    /**
+     * Check if a version lives in a file of its own
+     * @param version Version key
+     * @param path Receives the path as written (relative to the manifest)
+     * @param hash Receives the file's SHA-256, empty if not published
+     * @return true if the version is kept in a separate file
+     */
+    bool getVersionFile(const std::string& version, std::string& path, std::string& hash);
+
+    /**
+     * Parse a single version object (an inline body or a version file)
+     * @param content Version document
+     * @param metadata Filled with the version's fields
+     * @return true if the document is valid JSON
+     */
+    static bool parseVersion(std::string_view content, VersionMetadata& metadata);
+
+private:
+    struct VersionSlot {
+        std::string version;
+        size_t offset = 0;  // raw value in content
+        size_t length = 0;
+    };
+
+    struct ParsedVersion {
+        bool valid = false;
+        VersionMetadata metadata;
+        std::string file;  // set if the version lives in its own file
+        std::string hash;
+    };
+
+    std::string content;
+    std::string description;
+    std::string author;
+    std::string license;
+    std::string repository;
+    std::string latest;
+    std::vector<VersionSlot> versions;          // sorted by version
+    std::map<std::string, ParsedVersion> parsed;  // versions touched so far
+
+    const VersionSlot* findSlot(const std::string& version) const;
+    const ParsedVersion* touch(const std::string& version);
+};
+
+} // namespace box
+
+#endif // BOX_METADATA_H
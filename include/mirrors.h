@@ -0,0 +1,126 @@
+#ifndef BOX_MIRRORS_H
+#define BOX_MIRRORS_H
+
+#include "http.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace box {
+
+/**
+ * One registry mirror and what it has served this session
+ */
+struct Mirror {
+    std::string url;        // registry base URL (the directory holding nur.json)
+    double latency = -1.0;  // seconds to the first byte of the probe, -1 if not probed
+    size_t requests = 0;    // requests sent to this mirror
+    size_t failures = 0;    // requests that failed or stalled
+};
+
+/**
+ * Ordered list of registry mirrors serving the same tree
+ *
+ * The list comes from BOX_REGISTRY_URL (comma-separated) or the "mirrors"
+ * (or "registry") key of ~/.box/config.json. The first entry is the
+ * canonical registry: index paths are resolved against it and cache entries
+ * are keyed by it, so switching mirrors keeps the cache valid. Requests are
+ * rewritten to the active mirror, which is chosen by a latency probe and
+ * remembered in the cache directory for a while.
+ */
+class Mirrors {
+public:
+    /**
+     * Load the mirror list from the environment or ~/.box/config.json
+     */
+    Mirrors();
+
+    /**
+     * Use an explicit mirror list (first entry is canonical)
+     * @param urls Registry base URLs or nur.json URLs
+     */
+    explicit Mirrors(const std::vector<std::string>& urls);
+
+    /**
+     * Get the canonical registry base URL
+     */
+    const std::string& getCanonicalURL() const;
+
+    /**
+     * Get all mirrors with their counters
+     */
+    const std::vector<Mirror>& getMirrors() const;
+
+    /**
+     * Get the index of the mirror requests go to first
+     */
+    size_t getActive() const;
+
+    /**
+     * Pick the active mirror: reuse a recent choice from statePath, else
+     * probe every mirror concurrently and keep the fastest healthy one.
+     * When no mirror answers, mirrors are tried in configured order (and
+     * the probe runs again on the next call if it connected to none).
+     * Does nothing once a choice is made, or with a single mirror.
+     * @param http Client to probe with
+     * @param statePath File remembering the choice between runs
+     */
+    void select(HttpClient& http, const std::string& statePath);
+
+    /**
+     * Check whether a URL lives under the canonical registry
+     */
+    bool isMirrored(const std::string& url) const;
+
+    /**
+     * Rewrite a canonical URL to point at a mirror
+     * @param url Canonical URL
+     * @param mirror Mirror index
+     * @return URL on that mirror (unchanged if it isn't under the registry)
+     */
+    std::string resolve(const std::string& url, size_t mirror) const;
+
+    /**
+     * Mirror indices in the order to try them: active first, then the rest
+     * in configured order
+     */
+    std::vector<size_t> order() const;
+
+    /**
+     * Count a request sent to a mirror
+     * @param mirror Mirror index
+     * @param ok Whether the mirror answered usefully
+     */
+    void record(size_t mirror, bool ok);
+
+    /**
+     * Move away from a mirror that failed, if it is the active one
+     * @param mirror Mirror that failed
+     */
+    void failover(size_t mirror);
+
+    /**
+     * Normalize a registry URL: strip a trailing "/nur.json" and slashes
+     */
+    static std::string normalize(const std::string& url);
+
+private:
+    std::vector<Mirror> mirrors;
+    size_t active = 0;
+    bool selected = false;
+    std::string statePath;
+
+    /**
+     * Read the mirror list from ~/.box/config.json
+     */
+    static std::vector<std::string> loadConfig();
+
+    /**
+     * Remember the active mirror in statePath
+     */
+    void saveChoice() const;
+};
+
+} // namespace box
+
+#endif // BOX_MIRRORS_H
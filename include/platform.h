@@ -2,6 +2,7 @@
 #define BOX_PLATFORM_H
 
 #include <string>
+#include <vector>
 
 namespace box {
 
@@ -53,6 +54,37 @@ public:
      * Check if running on macOS
      */
     static bool isMacOS();
+
+    /**
+     * Check if the CPU and OS support AVX2 (always false off x86-64)
+     */
+    static bool hasAVX2();
+
+    /**
+     * Get the current user's home directory
+     * @return Home directory path or empty string if unknown
+     */
+    static std::string getHomeDir();
+
+    /**
+     * Get the Box home directory
+     * @return Path to ~/.box
+     */
+    static std::string getBoxHome();
+
+    /**
+     * Get the path of the running executable
+     * @return Absolute path or empty string if unknown
+     */
+    static std::string getExecutablePath();
+
+    /**
+     * Start a program detached from this process (no console, stdio
+     * discarded) and return without waiting for it
+     * @param args Program path followed by its arguments
+     * @return true if the program was started
+     */
+    static bool spawnDetached(const std::vector<std::string>& args);
 };
 
 } // namespace box
@@ -1,43 +1,60 @@
 #ifndef BOX_REGISTRY_H
 #define BOX_REGISTRY_H
 
+#include "bloom.h"
+#include "bundle.h"
+#include "cache.h"
+#include "http.h"
+#include "index_file.h"
+#include "metadata.h"
+#include "mirrors.h"
+#include "search_index.h"
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <cstdint>
 
 namespace box {
 
 /**
- * Version-specific metadata
+ * Module entry of the registry index
  */
-struct GitMetadata {
-    std::string url;
-    std::string ref;  // branch, tag, or commit hash
+struct IndexRecord {
+    std::string url;   // absolute manifest URL
+    std::string hash;  // manifest SHA-256, empty for plain "name": "path" entries
 };
 
 /**
- * Version-specific metadata
+ * One entry of the registry's changes log
  */
-struct VersionMetadata {
-    std::string description;
-    std::string entryLinux;
-    std::string entryWin;
-    std::string entryMac;
-    GitMetadata git;
-    std::map<std::string, std::string> deps;
+struct IndexChange {
+    uint32_t serial = 0;   // index serial this change produced
+    std::string name;
+    IndexRecord record;    // new entry (unused when removed)
+    bool removed = false;
 };
 
 /**
- * Module metadata from module.json
+ * Changes log (nur.changes.json): the index changes from serial `since`
+ * up to `serial`
  */
-struct ModuleMetadata {
-    std::string name;
-    std::string description;
-    std::string author;
-    std::string license;
-    std::string repository;
-    std::string latest;
-    std::map<std::string, VersionMetadata> versions;
+struct IndexChanges {
+    uint32_t serial = 0;
+    uint32_t since = 0;
+    std::vector<IndexChange> entries;
+};
+
+/**
+ * A file downloaded by Registry::downloadToFile()
+ */
+struct DownloadResult {
+    std::string path;    // where the file was written
+    size_t size = 0;     // file size in bytes
+    std::string sha256;  // hex digest of the file contents
 };
 
 /**
@@ -46,13 +63,83 @@ struct ModuleMetadata {
 class Registry {
 public:
     Registry();
+    ~Registry();
+
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
 
     /**
      * Fetch the NUR index (nur.json)
+     * Waits for a fetch started by startIndexFetch() instead of starting
+     * another one. The index is loaded once per Registry: later calls (and
+     * fetchIndexFor()) reuse that snapshot without going back to the
+     * registry, so installing several modules costs one index fetch.
      * @return true if successful
      */
     bool fetchIndex();
 
+    /**
+     * Start loading the index on a background thread
+     * Checks whether the registry publishes a sparse index and, if it
+     * doesn't, fetches nur.json, so the work overlaps whatever the caller
+     * does next. The next fetchIndex() or fetchIndexFor() call waits for
+     * it; no other method but waitIndexFetch() and cancelIndexFetch() may
+     * be called before then. Offline mode must be set beforehand.
+     */
+    void startIndexFetch();
+
+    /**
+     * Wait for a fetch started by startIndexFetch() to finish, e.g. before
+     * printing, so its output and the caller's don't interleave
+     */
+    void waitIndexFetch();
+
+    /**
+     * Abandon a fetch started by startIndexFetch() and wait for its thread
+     * Transfers in flight are aborted and nothing is retried, so an early
+     * exit doesn't wait for a whole nur.json download. Every later request
+     * of this Registry fails; only call it when the session is ending.
+     */
+    void cancelIndexFetch();
+
+    /**
+     * Make the index entries of some modules available
+     * Registries that publish a sparse index (index/config.json) are asked
+     * for just those modules' shards, so the cost doesn't grow with the
+     * registry. Others fall back to fetchIndex().
+     * @param moduleNames Modules about to be looked up
+     * @return true if successful (modules the registry lacks are not an error)
+     */
+    bool fetchIndexFor(const std::vector<std::string>& moduleNames);
+
+    /**
+     * Get the path of a module's shard in a sparse index, relative to the
+     * registry root (e.g. "index/ba/se/base64")
+     * @return Shard path, or empty string for names that can't be sharded
+     */
+    static std::string getShardPath(const std::string& moduleName);
+
+    /**
+     * Compile the cached index and manifests into ~/.box/cache/index.bin
+     * Later fetchIndex() calls map that file instead of parsing nur.json
+     * as long as the registry reports the index unchanged.
+     * @return true if successful
+     */
+    bool compileIndex();
+
+    /**
+     * Get the path of the compiled index file
+     */
+    std::string getCompiledIndexPath() const;
+
+    /**
+     * Download the manifest bundle named by the loaded index, unless the
+     * same bundle is already cached. Manifests are then read from it
+     * instead of being requested one by one.
+     * @return true if a bundle matching the index is available locally
+     */
+    bool fetchBundle();
+
     /**
      * Get module metadata URL from the index
      * @param moduleName Name of the module
@@ -67,13 +154,59 @@ public:
      */
     ModuleMetadata fetchModuleMetadata(const std::string& moduleName);
 
+    /**
+     * Fetch a module manifest without parsing its versions
+     * @param moduleName Name of the module
+     * @param manifest Receives the manifest; versions are parsed on use
+     * @return true if the manifest was fetched and is valid
+     */
+    bool fetchManifest(const std::string& moduleName, LazyManifest& manifest);
+
+    /**
+     * Get one version of a fetched manifest
+     * Inline versions are parsed on first use; a version kept in its own
+     * file is fetched (or read from the cache) on its own.
+     * @param moduleName Name of the module
+     * @param manifest Manifest from fetchManifest()
+     * @param version Version to get
+     * @param metadata Filled with the version's fields
+     * @return true if the version exists and could be read
+     */
+    bool fetchVersion(const std::string& moduleName, LazyManifest& manifest, const std::string& version,
+                      VersionMetadata& metadata);
+
     /**
      * Search for modules by name
      * @param query Search query
-     * @return List of matching module names
+     * @return List of matching module names, best matches first
      */
     std::vector<std::string> search(const std::string& query);
 
+    /**
+     * Ranked search over module names and cached descriptions
+     * @param query Search query (case-insensitive)
+     * @param limit Maximum number of results (0 for no limit)
+     * @return Results ranked exact > prefix > substring > description > fuzzy
+     */
+    std::vector<SearchResult> searchModules(const std::string& query, size_t limit);
+
+    /**
+     * Search nur.json as it arrives, without loading the index
+     * The document is scanned chunk by chunk straight from the network or
+     * the cache and only the best `limit` matches are kept, so memory
+     * doesn't grow with the registry. When a compiled index matches the
+     * cached nur.json, that is searched instead (it has descriptions).
+     * @param query Search query (case-insensitive)
+     * @param limit Maximum number of results (0 for no limit)
+     * @param onMatch Called with each match that makes the top results so
+     *                far, as it is found
+     * @param results Filled with the final results, ranked like searchModules()
+     * @return true if the index could be read
+     */
+    bool streamSearch(const std::string& query, size_t limit,
+                      const std::function<void(const SearchResult&)>& onMatch,
+                      std::vector<SearchResult>& results);
+
     /**
      * List all available modules
      * @return List of all module names
@@ -87,14 +220,386 @@ public:
      */
     std::string download(const std::string& url);
 
-private:
-    std::string registryURL;
-    std::map<std::string, std::string> moduleIndex; // name -> metadata URL
+    /**
+     * Download a URL straight to disk
+     * The body is streamed into a preallocated file under the cache's
+     * downloads/ directory, hashed on the way, and moved to outputPath once
+     * complete, so memory use stays constant whatever the file size.
+     * Interrupted transfers are kept with their validators and resumed
+     * with a Range/If-Range request, here and on later runs.
+     * @param url URL to download from
+     * @param outputPath Destination file
+     * @param result Filled with the final path, size and SHA-256
+     * @return true if successful
+     */
+    bool downloadToFile(const std::string& url, const std::string& outputPath, DownloadResult& result);
 
     /**
-     * Parse nur.json content
+     * Fetch the metadata of several modules concurrently
+     * Results are kept for this session, so later fetchModuleMetadata()
+     * calls for these modules don't touch the network.
+     * @param moduleNames Modules to fetch (index must already be loaded)
+     * @param maxConcurrent Maximum number of transfers in flight
+     * @return Number of manifests fetched successfully
+     */
+    size_t prefetchModuleMetadata(const std::vector<std::string>& moduleNames, size_t maxConcurrent);
+
+    /**
+     * Download several URLs concurrently to temporary files
+     * Later downloadToFile() calls for these URLs move the finished files
+     * into place instead of downloading again.
+     * @param urls URLs to download
+     * @param maxConcurrent Maximum number of transfers in flight
+     * @return Number of URLs downloaded successfully
+     */
+    size_t prefetch(const std::vector<std::string>& urls, size_t maxConcurrent);
+
+    /**
+     * Parse nur.json content into the module index
+     * @param content Index document
+     * @return true if at least one module was loaded
      */
     bool parseIndex(const std::string& content);
+
+    /**
+     * Parse a changes log
+     * @param content nur.changes.json document
+     * @param changes Filled with the serial range and the changes
+     * @return true if the document is valid and has a serial
+     */
+    bool parseChanges(const std::string& content, IndexChanges& changes);
+
+    /**
+     * Parse a module manifest in a single pass
+     * @param content Manifest document
+     * @param metadata Filled with top-level fields and every version
+     * @return true if the manifest is valid JSON
+     */
+    static bool parseManifest(std::string_view content, ModuleMetadata& metadata);
+
+    /**
+     * Get connection usage counters for this registry's HTTP client
+     * @return Request and connection reuse counters
+     */
+    const HttpStats& getHttpStats() const;
+
+    /**
+     * Get the registry mirrors and their per-mirror counters
+     */
+    const Mirrors& getMirrors() const;
+
+    /**
+     * Serve everything from the local cache without any network access
+     * (also enabled by BOX_OFFLINE, and automatically once no registry
+     * mirror can be reached). Anything not cached fails immediately.
+     * @param enabled Whether to stay offline
+     */
+    void setOffline(bool enabled);
+
+    /**
+     * Check whether the registry is working from the local cache only
+     */
+    bool isOffline() const;
+
+    /**
+     * Answer from cached registry documents (index, shards, manifests)
+     * checked less than maxAge seconds ago without contacting the registry.
+     * Copies older than a minute are revalidated afterwards by a detached
+     * `box index refresh`, so the next call sees fresh data.
+     * @param maxAge Staleness bound in seconds, 0 to always revalidate
+     */
+    void setMaxStale(long long maxAge);
+
+    /**
+     * Revalidate the cached index, plus the index entries and manifests of
+     * some modules; does nothing while another refresh holds the lock
+     * @param moduleNames Modules whose entries to refresh as well
+     * @return true if successful or another refresh is running
+     */
+    bool refreshIndex(const std::vector<std::string>& moduleNames);
+
+private:
+    Mirrors mirrors;
+    std::string registryURL;  // canonical registry base URL (first mirror)
+    bool offline = false;     // no network: answer from the cache or fail
+    long long maxStale = 0;   // serve cached documents checked this recently (seconds)
+    bool refreshPending = false;  // something was served stale; refresh it on exit
+    std::vector<std::string> staleModules;  // modules whose entries were served stale
+    std::map<std::string, IndexRecord> moduleIndex; // name -> manifest URL and hash
+    uint32_t indexSerial = 0;  // serial of the loaded index, 0 if unknown
+    bool indexLoaded = false;    // nur.json was loaded this session; it isn't fetched again
+    bool indexDeferred = false;  // cached nur.json is current but parsed only when a lookup needs it
+    BloomFilter nameFilter;      // names in the cached nur.json (see loadNameFilter())
+    long long nameFilterGeneration = 0;  // cache generation nameFilter was built from, 0 if none
+    IndexRecord bundleRecord;  // manifest bundle named by the index, if any
+    ManifestBundle bundle;
+    bool bundleChecked = false;  // looked for a cached bundle already
+    bool sparseChecked = false;  // asked whether the registry publishes a sparse index
+    bool sparse = false;         // it does: look modules up shard by shard
+    Cache cache;
+    HttpClient http;  // pooled connections shared by every fetch
+    CompiledIndex compiled;
+    bool useCompiled = false;  // answer lookups from the compiled index instead of moduleIndex
+    std::unique_ptr<SearchIndex> searchIndex;  // built on first search
+    std::shared_future<bool> indexFetch;  // started by startIndexFetch(): true if nur.json was loaded
+    std::map<std::string, std::string> prefetched; // URL -> manifest fetched by prefetchModuleMetadata()
+    struct PrefetchedFile {
+        DownloadResult file;  // temp file written by prefetch(), then the first destination
+        bool taken = false;   // moved to a caller's destination; later callers copy it
+    };
+    std::map<std::string, PrefetchedFile> prefetchedFiles; // URL -> file written by prefetch()
+
+    /**
+     * Perform GETs against the registry mirrors
+     * URLs under the registry go to the active mirror; requests that fail,
+     * stall or get a 429/5xx are retried with jittered exponential backoff,
+     * on the next mirror if there is one, as long as nothing was written to
+     * their output file yet. Buffered requests are hedged on a second mirror
+     * (or connection) when their first byte is late. Other URLs are fetched
+     * as they are, with the same retries.
+     * @param requests Requests with canonical URLs
+     * @param responses Filled with one response per request, in request order
+     * @param maxConcurrent Maximum number of transfers in flight at once
+     * @return Per-request flag telling whether the transfer completed
+     */
+    std::vector<bool> fetchAll(const std::vector<HttpRequest>& requests,
+                               std::vector<HttpResponse>& responses,
+                               size_t maxConcurrent);
+
+    /**
+     * Switch to offline mode after finding the registry unreachable
+     */
+    void goOffline();
+
+    /**
+     * Get a cached body without revalidating it, reporting a miss
+     * @return Cached content or empty string if not cached
+     */
+    std::string loadOffline(const std::string& url);
+
+    /**
+     * Fetch and load nur.json (the work behind fetchIndex())
+     */
+    bool loadIndex();
+
+    /**
+     * Wait for a fetch started by startIndexFetch()
+     * Its result stands for the session: a failed fetch isn't retried.
+     * @param loaded Receives whether it loaded nur.json
+     * @return true if there was one to wait for
+     */
+    bool joinIndexFetch(bool& loaded);
+
+    /**
+     * Use the cached index as it is if it was checked within maxStale
+     * @return true if the index is loaded
+     */
+    bool loadStaleIndex(const std::string& indexURL);
+
+    /**
+     * Get a cached body checked within maxStale, without revalidating it
+     * @param url URL of the document
+     * @param moduleName Module the document belongs to, refreshed later
+     * @param content Receives the cached body
+     * @return true if the cached copy may be used
+     */
+    bool loadStale(const std::string& url, const std::string& moduleName, std::string& content);
+
+    /**
+     * Start a detached `box index refresh` for what was served stale
+     */
+    void startRefresh();
+
+    /**
+     * Perform a single GET against the registry mirrors (see fetchAll())
+     */
+    bool fetch(const std::string& url, const std::vector<std::string>& headers, HttpResponse& response);
+
+    /**
+     * Download content through the on-disk cache, revalidating with
+     * If-None-Match/If-Modified-Since when a cached copy exists
+     * @param url URL to download from
+     * @param notModified If given, set when the cached copy was still current
+     * @return Current content or empty string on failure
+     */
+    std::string downloadCached(const std::string& url, bool* notModified = nullptr);
+
+    /**
+     * Check if downloadCached() would go to the registry for a URL, rather
+     * than answer from a prefetched copy, a local file or (offline) the cache
+     */
+    bool needsRequest(const std::string& url) const;
+
+    /**
+     * Build a streamed request for a URL, resuming a cached partial
+     * download with Range/If-Range when one exists
+     */
+    HttpRequest resumableRequest(const std::string& url);
+
+    /**
+     * Record the outcome of a streamed request in the partial-download cache
+     * @return true if request.outputPath now holds the complete file
+     */
+    bool finishResumable(const HttpRequest& request, bool completed, const HttpResponse& httpResponse);
+
+    /**
+     * Get the URL of nur.json for the current registry
+     */
+    std::string getIndexURL() const;
+
+    /**
+     * Get the URL of the registry's changes log
+     */
+    std::string getChangesURL() const;
+
+    /**
+     * Bring the locally cached index up to date from the changes log
+     * Only the entries that changed since the local serial are applied,
+     * and only cached manifests whose hash changed are refetched.
+     * @param indexURL URL of nur.json
+     * @param parsedCached Set when the cached nur.json was parsed into the
+     *        module index along the way
+     * @return true if the index is loaded and current; false if the
+     *         registry has no changes log or a full fetch is needed
+     */
+    bool updateFromChanges(const std::string& indexURL, bool& parsedCached);
+
+    /**
+     * Check that the compiled index was built from the cached nur.json
+     * (mapping it if needed)
+     */
+    bool compiledMatches(const std::string& indexURL, const CacheEntry& indexEntry);
+
+    /**
+     * Replace the loaded index with the entries of the compiled index
+     */
+    void loadFromCompiled();
+
+    /**
+     * Write the loaded index (plus cached manifest fields) to index.bin
+     * @param indexURL URL of nur.json
+     * @param incremental Reuse the open compiled index's fields for entries
+     *        whose manifest hash is unchanged instead of rescanning the cache
+     */
+    bool writeCompiledIndex(const std::string& indexURL, bool incremental);
+
+    /**
+     * Store the loaded index as the cached nur.json
+     */
+    bool saveIndex(const std::string& indexURL);
+
+    /**
+     * Get the path of the cached name filter
+     */
+    std::string getNameFilterPath() const;
+
+    /**
+     * Load the name filter if it was built from exactly the cached nur.json
+     * @param indexURL URL of nur.json
+     * @param serial Receives the serial of that index
+     * @return true if nameFilter describes the cached index
+     */
+    bool loadNameFilter(const std::string& indexURL, uint32_t& serial);
+
+    /**
+     * Rebuild the name filter from the loaded index, which must be the
+     * cached nur.json (skipped if the filter already describes it)
+     */
+    void saveNameFilter(const std::string& indexURL);
+
+    /**
+     * Leave the cached nur.json unparsed until a lookup the name filter
+     * can't answer needs it
+     * @param serial Serial of the cached index
+     */
+    void deferIndex(uint32_t serial);
+
+    /**
+     * Parse the cached nur.json if deferIndex() postponed it
+     * @return true if moduleIndex is loaded
+     */
+    bool ensureIndex();
+
+    /**
+     * Remember for a while that the registry has no document at url
+     * (a cached copy with content is never replaced)
+     */
+    void rememberMissing(const std::string& url);
+
+    /**
+     * Check whether a cache entry is a recent "not found" answer
+     */
+    static bool knownMissing(const CacheEntry& entry, bool haveCached);
+
+    /**
+     * Get the published manifest hash of a module
+     * @return Lowercase hex SHA-256, or empty string if not published
+     */
+    std::string getManifestHash(const std::string& moduleName);
+
+    /**
+     * Load a cached (or bundled) manifest if it matches the published hash
+     * @return true if content holds a manifest that needs no revalidation
+     */
+    bool loadVerifiedManifest(const std::string& url, const std::string& hash, std::string& content);
+
+    /**
+     * Get a module's manifest document from the session, the cache or the registry
+     * @return The manifest, or empty string if it couldn't be fetched
+     */
+    std::string fetchManifestContent(const std::string& moduleName);
+
+    /**
+     * Find out (once per session) whether the registry publishes a sparse
+     * index; the answer is cached for an hour
+     */
+    bool checkSparse();
+
+    /**
+     * Read one sparse index shard into moduleIndex
+     */
+    bool parseShard(const std::string& moduleName, const std::string& content);
+
+    /**
+     * Get the directory holding the cached manifest bundle
+     */
+    std::string getBundleDir() const;
+
+    /**
+     * Open the cached manifest bundle, if there is one (once per session)
+     * @return true if a bundle is open
+     */
+    bool openBundle();
+
+    /**
+     * Modules whose cached manifest no longer matches the published hash
+     */
+    std::vector<std::string> staleManifests();
+
+    /**
+     * Revalidate nur.json and switch to the compiled index if it's current
+     * @param indexURL URL of nur.json
+     * @param content Receives the new index body if the registry sent one
+     * @return true if lookups are now served from the compiled index
+     */
+    bool useCompiledIndex(const std::string& indexURL, std::string& content);
+
+    /**
+     * Build the search index from the loaded index
+     */
+    void buildSearchIndex();
+
+    /**
+     * Build If-None-Match/If-Modified-Since headers for a cached entry
+     */
+    static std::vector<std::string> conditionalHeaders(const CacheEntry& entry, bool haveCached);
+
+    /**
+     * Resolve a (possibly 304) response against the cache and store new content
+     * @return Current content or empty string on failure
+     */
+    std::string finishCached(const std::string& url, CacheEntry& entry, bool haveCached,
+                             HttpResponse& httpResponse);
 };
 
 } // namespace box
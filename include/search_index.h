@@ -0,0 +1,164 @@
+#ifndef BOX_SEARCH_INDEX_H
+#define BOX_SEARCH_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * How a search result matched the query, best first
+ */
+enum class MatchKind {
+    EXACT,        // name equals the query
+    PREFIX,       // name starts with the query
+    SUBSTRING,    // name contains the query
+    DESCRIPTION,  // description contains the query
+    FUZZY         // name is within a small edit distance of the query
+};
+
+/**
+ * A ranked search hit
+ */
+struct SearchResult {
+    std::string name;
+    std::string description;
+    MatchKind match = MatchKind::EXACT;
+    int distance = 0;  // edit distance for FUZZY matches
+};
+
+/**
+ * Local search index over module names and descriptions
+ *
+ * Names and descriptions are lowercased once and stored back to back in
+ * one buffer per field with an offset array, so a substring query is a
+ * single SIMD scan over contiguous memory (first and last byte of the
+ * query compared 16 or 32 positions at a time, candidates verified in
+ * place) rather than a string per module. Modules are sorted by name, so
+ * exact and prefix matches are a binary search. Fuzzy matching needs no
+ * table of its own: module ids are also grouped by name length, and only
+ * names within the edit bound of the query's length are compared.
+ */
+class SearchIndex {
+public:
+    SearchIndex();
+
+    /**
+     * Add a module; call build() once all modules are added
+     * @param name Module name
+     * @param description Module description (may be empty)
+     */
+    void add(std::string_view name, std::string_view description);
+
+    /**
+     * Sort the modules by name
+     */
+    void build();
+
+    /**
+     * Search the index
+     * @param query Search query (case-insensitive)
+     * @param limit Maximum number of results (0 for no limit)
+     * @return Results ranked exact > prefix > substring > description > fuzzy,
+     *         then by name
+     */
+    std::vector<SearchResult> search(std::string_view query, size_t limit) const;
+
+    /**
+     * Get the number of indexed modules
+     */
+    size_t size() const;
+
+private:
+    // One field of every module, each value followed by a '\0';
+    // offsets[id] is where module id's value starts and offsets.back() the
+    // end of the text
+    struct TextColumn {
+        std::string text;
+        std::vector<uint32_t> offsets = {0};
+
+        std::string_view at(uint32_t id) const {
+            return std::string_view(text.data() + offsets[id], offsets[id + 1] - offsets[id] - 1);
+        }
+        void append(std::string_view value, bool lowercase);
+    };
+
+    // Sorted by lowerNames after build()
+    TextColumn names;
+    TextColumn lowerNames;
+    TextColumn descriptions;
+    TextColumn lowerDescriptions;
+    std::vector<uint32_t> byLength;      // module ids ordered by name length
+    std::vector<uint32_t> lengthStarts;  // names of length n are byLength[lengthStarts[n], lengthStarts[n + 1])
+    bool built = false;
+
+    /**
+     * Find the modules whose names start with a prefix
+     * @return Range of sorted module ids [first, second)
+     */
+    std::pair<uint32_t, uint32_t> findPrefix(std::string_view prefix) const;
+};
+
+/**
+ * Ranked search over modules as they stream past
+ *
+ * Ranks like SearchIndex without building one: each module is matched on
+ * its own and only the best `limit` results are kept, in a bounded heap,
+ * so memory depends on the limit rather than the registry.
+ */
+class StreamingSearch {
+public:
+    /**
+     * @param query Search query (case-insensitive)
+     * @param limit Maximum number of results (0 for no limit)
+     */
+    StreamingSearch(std::string_view query, size_t limit);
+
+    /**
+     * Match one module
+     * @param name Module name
+     * @param description Module description (may be empty)
+     * @param entered Filled with the module's result if it made the top results
+     * @return true if it did; later modules may still push it out
+     */
+    bool add(std::string_view name, std::string_view description, SearchResult& entered);
+
+    /**
+     * Get the results, ranked as SearchIndex::search() ranks them
+     */
+    std::vector<SearchResult> results() const;
+
+    /**
+     * Forget every module added so far
+     */
+    void clear();
+
+private:
+    struct Entry {
+        SearchResult result;
+        std::string lowerName;
+    };
+
+    std::string query;      // lowercased
+    size_t limit;
+    std::vector<Entry> heap;  // worst result on top once full
+    Entry candidate;          // scratch for the module being matched
+    std::string lowerName;
+    std::string lowerText;
+    std::vector<int> previous, current;  // edit distance rows
+
+    /**
+     * Check if text contains the query, ignoring case
+     */
+    bool containsLower(std::string_view text);
+
+    static bool ranksBefore(const Entry& a, const Entry& b);
+};
+
+} // namespace box
+
+#endif // BOX_SEARCH_INDEX_H
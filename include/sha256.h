@@ -0,0 +1,49 @@
+#ifndef BOX_SHA256_H
+#define BOX_SHA256_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+
+/**
+ * Incremental SHA-256 digest
+ */
+class Sha256 {
+public:
+    Sha256();
+
+    /**
+     * Feed more data into the digest
+     * @param data Bytes to hash
+     * @param size Number of bytes
+     */
+    void update(const void* data, size_t size);
+
+    /**
+     * Finish the digest; the object must not be updated afterwards
+     * @return Lowercase hex digest
+     */
+    std::string finish();
+
+    /**
+     * Hash a whole file
+     * @param path File to hash
+     * @param digest Receives the lowercase hex digest
+     * @return true if the file could be read
+     */
+    static bool hashFile(const std::string& path, std::string& digest);
+
+private:
+    uint32_t state[8];
+    uint64_t totalBytes = 0;
+    unsigned char buffer[64];
+    size_t bufferSize = 0;
+
+    void transform(const unsigned char* block);
+};
+
+} // namespace box
+
+#endif // BOX_SHA256_H
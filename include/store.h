@@ -0,0 +1,109 @@
+#ifndef BOX_STORE_H
+#define BOX_STORE_H
+
+#include <string>
+#include <map>
+
+namespace box {
+
+/**
+ * How an artifact was placed into an install directory
+ */
+enum class LinkMode {
+    HARDLINK,  // same inode as the store copy
+    REFLINK,   // copy-on-write clone of the store copy
+    COPY       // plain copy (different filesystem, no CoW support)
+};
+
+/**
+ * Content-addressed artifact store (~/.box/store)
+ *
+ * Every built or downloaded library is kept once per machine as
+ * <store>/<sha256>/<file> and linked into global and project install
+ * directories. Keys (a binary's published digest or URL, or a repository +
+ * commit + platform for source builds) are mapped to digests under <store>/keys/, so an artifact
+ * that is already in the store is neither downloaded nor rebuilt.
+ */
+class Store {
+public:
+    Store();
+
+    /**
+     * Create a store rooted at a specific directory
+     * @param dir Store directory
+     */
+    explicit Store(const std::string& dir);
+
+    /**
+     * Get the store directory
+     */
+    std::string getStoreDir() const;
+
+    /**
+     * Find an artifact in the store
+     * @param sha256 Hex digest of the artifact
+     * @param fileName File name it was stored under
+     * @return Path of the stored file, or empty string if absent
+     */
+    std::string find(const std::string& sha256, const std::string& fileName) const;
+
+    /**
+     * Add a file to the store (hard-linked when possible, copied otherwise)
+     * The file itself is left in place.
+     * @param file File to add
+     * @param sha256 Hex digest of the file
+     * @param fileName Name to store it under
+     * @param storedPath Receives the path of the stored file
+     * @return true if successful
+     */
+    bool add(const std::string& file, const std::string& sha256, const std::string& fileName,
+             std::string& storedPath) const;
+
+    /**
+     * Look up the artifact recorded for a key
+     * The stored file is only returned if it still matches the digest
+     * recorded for the key; it is hashed the first time it is looked up.
+     * @param key Artifact key (e.g. "url:<url>" or "sha256:<digest>")
+     * @param storedPath Receives the path of the stored file
+     * @return true if the key is known and its artifact is still in the store, intact
+     */
+    bool lookup(const std::string& key, std::string& storedPath) const;
+
+    /**
+     * Record which artifact a key produces
+     * @param key Artifact key
+     * @param sha256 Hex digest of the artifact
+     * @param fileName File name it is stored under
+     * @return true if successful
+     */
+    bool record(const std::string& key, const std::string& sha256, const std::string& fileName) const;
+
+    /**
+     * Place a stored artifact at dest, trying a hard link, then a reflink,
+     * then a copy. An existing file at dest is replaced.
+     * @param storedPath Path of the stored file
+     * @param dest Destination path
+     * @param mode Receives how the file was placed
+     * @return true if successful
+     */
+    static bool materialize(const std::string& storedPath, const std::string& dest, LinkMode& mode);
+
+private:
+    std::string storeDir;
+    mutable std::map<std::string, bool> verified;  // stored file -> whether it matched its digest this session
+
+    /**
+     * Check that a stored file still has the digest it is stored under
+     * (hashed on the first call for a path, then remembered)
+     */
+    bool intact(const std::string& path, const std::string& sha256) const;
+
+    /**
+     * Get the file recording a key's artifact
+     */
+    std::string keyPath(const std::string& key) const;
+};
+
+} // namespace box
+
+#endif // BOX_STORE_H
@@ -0,0 +1,113 @@
+#ifndef BOX_STRUCTURAL_H
+#define BOX_STRUCTURAL_H
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace box {
+namespace json {
+
+/**
+ * Stage-1 structural index of a JSON document
+ *
+ * Classifies the input 64 bytes at a time (quotes, backslashes, the
+ * structural characters {}[]:, and control characters) with AVX2 or SSE2
+ * where the CPU has them, works out which bytes are inside strings with
+ * bit arithmetic instead of a byte loop, and records the offset of every
+ * structural character outside strings plus both quotes of every string.
+ *
+ * Reader doesn't walk the positions (registry documents have one every
+ * few bytes, and a branch per position costs more than the byte loop
+ * does). It skips values with skipValue(), which runs on the same
+ * block masks, and scans strings with findStringEnd(). build() is for
+ * sweeps that want every position.
+ */
+class StructuralIndex {
+public:
+    /**
+     * Block classifier; AUTO picks the best one the CPU supports
+     */
+    enum class Kernel { AUTO, SCALAR, SSE2, AVX2 };
+
+    StructuralIndex();
+
+    /**
+     * Index a document
+     * @param input JSON text, smaller than 4 GB
+     * @param kernel Classifier to use
+     * @return false if the input is too large or the kernel isn't supported
+     */
+    bool build(std::string_view input, Kernel kernel = Kernel::AUTO);
+
+    /**
+     * Get the number of indexed positions
+     */
+    size_t size() const;
+
+    /**
+     * Get an indexed position (ascending)
+     */
+    uint32_t operator[](size_t i) const { return positions[i]; }
+
+    /**
+     * Find a control character inside a string (invalid JSON)
+     * @param begin Start of the range to check
+     * @param end End of the range
+     * @return Offset of the first one in [begin, end), or npos
+     */
+    size_t findControl(size_t begin, size_t end) const;
+
+    /**
+     * Check if the document ends inside a string
+     */
+    bool endsInString() const;
+
+    /**
+     * Find the end of a string, object or array 64 bytes at a time,
+     * without tracking anything but strings and nesting
+     * @param input JSON text
+     * @param offset Offset of the value's opening quote or bracket
+     * @param kernel Classifier to use
+     * @return Offset just past the value, or npos if it doesn't end
+     */
+    static size_t skipValue(std::string_view input, size_t offset, Kernel kernel = Kernel::AUTO);
+
+    /**
+     * Find the next quote, backslash or control character, which ends
+     * the plain run of a string
+     * @param input JSON text
+     * @param offset Where to start (inside a string)
+     * @return Its offset, or input.size() if there is none
+     */
+    static size_t findStringEnd(std::string_view input, size_t offset);
+
+    /**
+     * Get the best classifier this CPU supports
+     */
+    static Kernel bestKernel();
+
+    /**
+     * Check if this build and CPU can run a classifier
+     */
+    static bool isSupported(Kernel kernel);
+
+    /**
+     * Get a classifier's name ("avx2", "sse2", "scalar")
+     */
+    static const char* kernelName(Kernel kernel);
+
+    static const size_t npos = (size_t)-1;
+
+private:
+    std::vector<uint32_t> positions;
+    size_t count = 0;
+    std::vector<uint32_t> controls;  // control characters inside strings
+    bool unterminated = false;
+};
+
+} // namespace json
+} // namespace box
+
+#endif // BOX_STRUCTURAL_H
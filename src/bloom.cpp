@@ -0,0 +1,160 @@
+#include "bloom.h"
+#include "cache.h"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+namespace box {
+
+// File layout (integers are little-endian):
+//
+//   magic       8 bytes
+//   hashCount   u32
+//   serial      u32
+//   generation  u64
+//   wordCount   u32, 64-bit words of bits
+//   sourceSize  u32
+//   source      sourceSize bytes
+//   bits        wordCount x u64
+static const char BLOOM_MAGIC[8] = {'B', 'O', 'X', 'B', 'L', 'M', '0', '1'};
+
+// ~10 bits and 7 probes per name: about 0.8% false positives
+static const size_t BITS_PER_NAME = 10;
+static const uint32_t HASH_COUNT = 7;
+
+// Anything larger than this is a corrupt file, not a registry
+static const uint32_t MAX_WORDS = 1u << 26;
+
+// FNV-1a over the name
+static uint64_t hashName(std::string_view name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Second, independent hash for double hashing (splitmix64 finalizer)
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static void putLE(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out += (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint64_t getLE(const unsigned char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+BloomFilter::BloomFilter() {
+}
+
+void BloomFilter::reset(size_t expectedNames) {
+    size_t bitCount = std::max<size_t>(expectedNames * BITS_PER_NAME, 64);
+    bits.assign((bitCount + 63) / 64, 0);
+    hashCount = HASH_COUNT;
+}
+
+void BloomFilter::add(std::string_view name) {
+    if (bits.empty()) return;
+    uint64_t h1 = hashName(name);
+    uint64_t h2 = mix(h1) | 1;
+    uint64_t bitCount = (uint64_t)bits.size() * 64;
+    for (uint32_t i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % bitCount;
+        bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool BloomFilter::mightContain(std::string_view name) const {
+    if (bits.empty()) return true;
+    uint64_t h1 = hashName(name);
+    uint64_t h2 = mix(h1) | 1;
+    uint64_t bitCount = (uint64_t)bits.size() * 64;
+    for (uint32_t i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % bitCount;
+        if (!(bits[bit / 64] & (1ULL << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+bool BloomFilter::empty() const {
+    return bits.empty();
+}
+
+bool BloomFilter::write(const std::string& path, const std::string& source, uint64_t generation,
+                        uint32_t serial) const {
+    std::string out(BLOOM_MAGIC, sizeof(BLOOM_MAGIC));
+    putLE(out, hashCount, 4);
+    putLE(out, serial, 4);
+    putLE(out, generation, 8);
+    putLE(out, bits.size(), 4);
+    putLE(out, source.size(), 4);
+    out += source;
+    out.reserve(out.size() + bits.size() * 8);
+    for (uint64_t word : bits) {
+        putLE(out, word, 8);
+    }
+
+    // Write beside the target and rename, like the compiled index; the temp
+    // name is per process, as a detached refresh may write the filter too
+    std::string tmpPath = Cache::tempPathFor(path);
+    std::ofstream file(tmpPath, std::ios::binary);
+    if (!file) return false;
+    file.write(out.data(), out.size());
+    file.close();
+
+    std::error_code ec;
+    if (file) std::filesystem::rename(tmpPath, path, ec);
+    if (!file || ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool BloomFilter::read(const std::string& path, std::string& source, uint64_t& generation, uint32_t& serial) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    unsigned char header[32];
+    if (!file.read((char*)header, sizeof(header)) || std::memcmp(header, BLOOM_MAGIC, sizeof(BLOOM_MAGIC)) != 0) {
+        return false;
+    }
+    uint32_t hashes = (uint32_t)getLE(header + 8, 4);
+    uint32_t words = (uint32_t)getLE(header + 24, 4);
+    uint32_t sourceSize = (uint32_t)getLE(header + 28, 4);
+    if (hashes == 0 || hashes > 32 || words == 0 || words > MAX_WORDS || sourceSize > 65536) return false;
+
+    std::string url(sourceSize, '\0');
+    if (sourceSize > 0 && !file.read(&url[0], sourceSize)) return false;
+
+    std::vector<unsigned char> raw((size_t)words * 8);
+    if (!file.read((char*)raw.data(), raw.size())) return false;
+
+    bits.resize(words);
+    for (size_t i = 0; i < words; i++) {
+        bits[i] = getLE(raw.data() + i * 8, 8);
+    }
+    hashCount = hashes;
+    serial = (uint32_t)getLE(header + 12, 4);
+    generation = getLE(header + 16, 8);
+    source = std::move(url);
+    return true;
+}
+
+} // namespace box
@@ -0,0 +1,175 @@
+#include "bundle.h"
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef BOX_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+namespace box {
+
+// File layout (integers are little-endian):
+//
+//   header   32 bytes: magic, entry count (u32), entry size (u32), reserved
+//   table    count x ENTRY_SIZE, sorted by digest:
+//              sha256      32 bytes, digest of the decoded manifest
+//              offset      u64, from the start of the file
+//              stored      u32, bytes in the file
+//              size        u32, bytes once decoded
+//              encoding    u32, ENCODING_RAW or ENCODING_ZSTD
+//              reserved    u32
+//   data     the stored manifests, in any order
+static const char BUNDLE_MAGIC[8] = {'N', 'U', 'R', 'B', 'D', 'L', '0', '1'};
+static const size_t HEADER_SIZE = 32;
+static const size_t HEADER_COUNT = 8;
+static const size_t HEADER_ENTRY_SIZE = 12;
+static const size_t ENTRY_SIZE = 56;
+static const size_t ENTRY_OFFSET = 32;
+static const size_t ENTRY_STORED = 40;
+static const size_t ENTRY_SIZE_DECODED = 44;
+static const size_t ENTRY_ENCODING = 48;
+static const uint32_t ENCODING_RAW = 0;
+static const uint32_t ENCODING_ZSTD = 1;
+
+// Manifests are small; anything bigger is a corrupt table
+static const uint32_t MAX_MANIFEST_SIZE = 64u << 20;
+
+static uint64_t getLE(const unsigned char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static bool parseDigest(const std::string& hex, unsigned char digest[32]) {
+    if (hex.size() != 64) return false;
+    for (size_t i = 0; i < 32; i++) {
+        int value = 0;
+        for (size_t j = 0; j < 2; j++) {
+            char c = hex[2 * i + j];
+            int nibble;
+            if (c >= '0' && c <= '9') nibble = c - '0';
+            else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+            else return false;
+            value = value * 16 + nibble;
+        }
+        digest[i] = (unsigned char)value;
+    }
+    return true;
+}
+
+ManifestBundle::ManifestBundle() {
+}
+
+ManifestBundle::~ManifestBundle() {
+    close();
+#ifdef BOX_HAVE_ZSTD
+    ZSTD_freeDCtx((ZSTD_DCtx*)decompressor);
+#endif
+}
+
+bool ManifestBundle::open(const std::string& path) {
+    close();
+
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    unsigned char header[HEADER_SIZE];
+    if (!file.read((char*)header, HEADER_SIZE) || std::memcmp(header, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 ||
+        getLE(header + HEADER_ENTRY_SIZE, 4) != ENTRY_SIZE) {
+        close();
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    fileSize = (uint64_t)file.tellg();
+    count = (size_t)getLE(header + HEADER_COUNT, 4);
+    if (HEADER_SIZE + (uint64_t)count * ENTRY_SIZE > fileSize) {
+        close();
+        return false;
+    }
+
+    table.resize(count * ENTRY_SIZE);
+    file.seekg(HEADER_SIZE);
+    if (count > 0 && !file.read((char*)table.data(), table.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ManifestBundle::close() {
+    if (file.is_open()) file.close();
+    file.clear();
+    table.clear();
+    count = 0;
+    fileSize = 0;
+}
+
+bool ManifestBundle::isOpen() const {
+    return file.is_open();
+}
+
+size_t ManifestBundle::size() const {
+    return count;
+}
+
+bool ManifestBundle::read(const std::string& sha256, std::string& content) {
+    unsigned char digest[32];
+    if (!isOpen() || !parseDigest(sha256, digest)) return false;
+
+    // Binary search the digest-sorted table
+    size_t low = 0, high = count;
+    const unsigned char* entry = nullptr;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const unsigned char* candidate = table.data() + mid * ENTRY_SIZE;
+        int order = std::memcmp(candidate, digest, 32);
+        if (order == 0) {
+            entry = candidate;
+            break;
+        }
+        if (order < 0) low = mid + 1;
+        else high = mid;
+    }
+    if (!entry) return false;
+
+    uint64_t offset = getLE(entry + ENTRY_OFFSET, 8);
+    uint32_t stored = (uint32_t)getLE(entry + ENTRY_STORED, 4);
+    uint32_t size = (uint32_t)getLE(entry + ENTRY_SIZE_DECODED, 4);
+    uint32_t encoding = (uint32_t)getLE(entry + ENTRY_ENCODING, 4);
+    if (offset > fileSize || stored > fileSize - offset || size > MAX_MANIFEST_SIZE) return false;
+
+    file.clear();
+    file.seekg((std::streamoff)offset);
+    if (encoding == ENCODING_RAW) {
+        if (stored != size) return false;
+        content.resize(size);
+        if (size > 0 && !file.read(&content[0], size)) return false;
+    } else if (encoding == ENCODING_ZSTD) {
+#ifdef BOX_HAVE_ZSTD
+        buffer.resize(stored);
+        if (stored > 0 && !file.read(&buffer[0], stored)) return false;
+        if (!decompressor && !(decompressor = ZSTD_createDCtx())) return false;
+
+        content.resize(size);
+        size_t written = ZSTD_decompressDCtx((ZSTD_DCtx*)decompressor, &content[0], content.size(),
+                                             buffer.data(), buffer.size());
+        if (ZSTD_isError(written) || written != size) return false;
+#else
+        // Needs a build with zstd; the caller falls back to the registry
+        return false;
+#endif
+    } else {
+        return false;
+    }
+
+    Sha256 hasher;
+    hasher.update(content.data(), content.size());
+    return hasher.finish() == sha256;
+}
+
+} // namespace box
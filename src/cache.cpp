@@ -0,0 +1,502 @@
+#include "cache.h"
+#include "platform.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <memory>
+#include <random>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <process.h>
+    #include <sys/stat.h>
+#else
+    #include <unistd.h>
+#endif
+#include <fcntl.h>
+
+#ifdef BOX_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+namespace box {
+
+// Bodies smaller than this are kept raw; a frame header would eat the savings
+static const size_t MIN_COMPRESSED_SIZE = 512;
+
+// zstd level for cache bodies: cheap to write, decompresses at memory speed
+static const int CACHE_COMPRESSION_LEVEL = 3;
+
+// FNV-1a, used to turn URLs into stable file names
+static uint64_t hashURL(const std::string& url) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : url) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool readFile(const std::string& path, std::string& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        fclose(file);
+        return false;
+    }
+    data.resize((size_t)size);
+    bool ok = fread(&data[0], 1, data.size(), file) == data.size();
+    fclose(file);
+    return ok;
+}
+
+#ifdef BOX_HAVE_ZSTD
+
+namespace {
+
+// zstd contexts and the compressed-bytes buffer, reused by every cache read
+// and write on this thread
+struct ZstdScratch {
+    ZSTD_CCtx* compressor = nullptr;
+    ZSTD_DCtx* decompressor = nullptr;
+    std::string buffer;
+
+    ~ZstdScratch() {
+        ZSTD_freeCCtx(compressor);
+        ZSTD_freeDCtx(decompressor);
+    }
+};
+
+thread_local ZstdScratch zstdScratch;
+
+} // namespace
+
+// Compress into the scratch buffer; false if it wouldn't be smaller
+static bool compressBody(const std::string& body) {
+    ZstdScratch& scratch = zstdScratch;
+    if (!scratch.compressor && !(scratch.compressor = ZSTD_createCCtx())) return false;
+
+    scratch.buffer.resize(ZSTD_compressBound(body.size()));
+    size_t size = ZSTD_compressCCtx(scratch.compressor, &scratch.buffer[0], scratch.buffer.size(),
+                                    body.data(), body.size(), CACHE_COMPRESSION_LEVEL);
+    if (ZSTD_isError(size) || size >= body.size()) return false;
+    scratch.buffer.resize(size);
+    return true;
+}
+
+// Decompress a file's frame straight into body, sized from the frame header
+static bool decompressBody(const std::string& path, std::string& body) {
+    ZstdScratch& scratch = zstdScratch;
+    if (!readFile(path, scratch.buffer)) return false;
+    if (!scratch.decompressor && !(scratch.decompressor = ZSTD_createDCtx())) return false;
+
+    unsigned long long size = ZSTD_getFrameContentSize(scratch.buffer.data(), scratch.buffer.size());
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) return false;
+
+    body.resize((size_t)size);
+    size_t written = ZSTD_decompressDCtx(scratch.decompressor, &body[0], body.size(),
+                                         scratch.buffer.data(), scratch.buffer.size());
+    return !ZSTD_isError(written) && written == body.size();
+}
+
+// Compress a file into outPath chunk by chunk; false if it wouldn't be smaller
+static bool compressFile(const std::string& inPath, const std::string& outPath) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(inPath, ec);
+    if (ec || size < MIN_COMPRESSED_SIZE) return false;
+
+    ZstdScratch& scratch = zstdScratch;
+    if (!scratch.compressor && !(scratch.compressor = ZSTD_createCCtx())) return false;
+    ZSTD_CCtx_reset(scratch.compressor, ZSTD_reset_session_and_parameters);
+    ZSTD_CCtx_setParameter(scratch.compressor, ZSTD_c_compressionLevel, CACHE_COMPRESSION_LEVEL);
+    // Loading sizes the body from the frame header, so it must carry the size
+    ZSTD_CCtx_setPledgedSrcSize(scratch.compressor, (unsigned long long)size);
+
+    FILE* in = fopen(inPath.c_str(), "rb");
+    if (!in) return false;
+    FILE* out = fopen(outPath.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    std::string input(ZSTD_CStreamInSize(), '\0');
+    scratch.buffer.resize(ZSTD_CStreamOutSize());
+    size_t total = 0;
+    bool ok = true;
+    while (ok) {
+        size_t count = fread(&input[0], 1, input.size(), in);
+        if (ferror(in)) {
+            ok = false;
+            break;
+        }
+        ZSTD_EndDirective mode = feof(in) ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer source = {input.data(), count, 0};
+        bool done = false;
+        while (ok && !done) {
+            ZSTD_outBuffer target = {&scratch.buffer[0], scratch.buffer.size(), 0};
+            size_t remaining = ZSTD_compressStream2(scratch.compressor, &target, &source, mode);
+            ok = !ZSTD_isError(remaining) && fwrite(target.dst, 1, target.pos, out) == target.pos;
+            total += target.pos;
+            done = mode == ZSTD_e_end ? remaining == 0 : source.pos == source.size;
+        }
+        if (mode == ZSTD_e_end) break;
+    }
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok && total < size;
+}
+
+// Decompress a file chunk by chunk. Uses its own context: onData may load
+// other cache entries in the meantime.
+static bool decompressFile(const std::string& path,
+                           const std::function<bool(const char*, size_t)>& onData) {
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> decompressor(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (!decompressor) return false;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    std::string input(ZSTD_DStreamInSize(), '\0');
+    std::string output(ZSTD_DStreamOutSize(), '\0');
+    size_t remaining = 1;  // nonzero until a frame is complete
+    bool ok = true;
+    size_t count;
+    while (ok && (count = fread(&input[0], 1, input.size(), file)) > 0) {
+        ZSTD_inBuffer source = {input.data(), count, 0};
+        while (ok && source.pos < source.size) {
+            ZSTD_outBuffer target = {&output[0], output.size(), 0};
+            remaining = ZSTD_decompressStream(decompressor.get(), &target, &source);
+            ok = !ZSTD_isError(remaining) && (target.pos == 0 || onData(output.data(), target.pos));
+        }
+    }
+    if (ferror(file)) ok = false;
+    fclose(file);
+    return ok && remaining == 0;
+}
+
+#endif
+
+// Read a raw body file chunk by chunk
+static bool streamFile(const std::string& path, const std::function<bool(const char*, size_t)>& onData) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    std::string buffer(65536, '\0');
+    bool ok = true;
+    size_t count;
+    while (ok && (count = fread(&buffer[0], 1, buffer.size(), file)) > 0) {
+        ok = onData(buffer.data(), count);
+    }
+    if (ferror(file)) ok = false;
+    fclose(file);
+    return ok;
+}
+
+Cache::Cache() {
+    cacheDir = Platform::getBoxHome() + "/cache";
+}
+
+Cache::Cache(const std::string& dir) : cacheDir(dir) {
+}
+
+std::string Cache::getCacheDir() const {
+    return cacheDir;
+}
+
+std::string Cache::pathFor(const std::string& url) const {
+    // Keep the last path component so entries stay recognizable (e.g. "...-nur.json")
+    std::string baseName = url;
+    size_t slash = baseName.find_last_of('/');
+    if (slash != std::string::npos) baseName = baseName.substr(slash + 1);
+    for (char& c : baseName) {
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '_';
+        if (!safe) c = '_';
+    }
+    if (baseName.size() > 64) baseName = baseName.substr(0, 64);
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hashURL(url));
+    return cacheDir + "/" + hex + "-" + baseName;
+}
+
+std::string Cache::partialPathFor(const std::string& url) const {
+    std::string base = pathFor(url);
+    return cacheDir + "/downloads/" + base.substr(cacheDir.size() + 1);
+}
+
+std::string Cache::tempPathFor(const std::string& path) {
+#ifdef _WIN32
+    long pid = (long)_getpid();
+#else
+    long pid = (long)getpid();
+#endif
+    static thread_local std::mt19937_64 random(std::random_device{}());
+    char suffix[40];
+    snprintf(suffix, sizeof(suffix), ".%ld-%08x.tmp", pid, (unsigned)random());
+    return path + suffix;
+}
+
+bool Cache::loadMeta(const std::string& url, CacheEntry& entry) const {
+    return readMeta(pathFor(url) + ".meta", url, entry);
+}
+
+bool Cache::readMeta(const std::string& metaPath, const std::string& url, CacheEntry& entry) const {
+    std::ifstream meta(metaPath);
+    if (!meta.is_open()) return false;
+
+    CacheEntry loaded;
+    std::string line;
+    while (std::getline(meta, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+
+        if (key == "url") loaded.url = value;
+        else if (key == "etag") loaded.etag = value;
+        else if (key == "last-modified") loaded.lastModified = value;
+        else if (key == "fetched-at") loaded.fetchedAt = std::atoll(value.c_str());
+        else if (key == "encoding") loaded.encoding = value;
+        else if (key == "generation") loaded.generation = std::atoll(value.c_str());
+    }
+
+    // Guard against hash collisions
+    if (loaded.url != url) return false;
+
+    entry = std::move(loaded);
+    return true;
+}
+
+bool Cache::readBody(const std::string& base, const std::string& encoding, std::string& body) {
+    if (encoding.empty()) return readFile(base + ".body", body);
+#ifdef BOX_HAVE_ZSTD
+    if (encoding == "zstd") return decompressBody(base + ".body.zst", body);
+#endif
+    // Written by a build that could compress; treat it as a miss
+    return false;
+}
+
+bool Cache::stream(const std::string& url, CacheEntry& entry,
+                   const std::function<bool(const char* data, size_t size)>& onData) const {
+    CacheEntry loaded;
+    if (!loadMeta(url, loaded)) return false;
+
+    std::string base = pathFor(url);
+    bool ok = false;
+    if (loaded.encoding.empty()) {
+        ok = streamFile(base + ".body", onData);
+    }
+#ifdef BOX_HAVE_ZSTD
+    else if (loaded.encoding == "zstd") {
+        ok = decompressFile(base + ".body.zst", onData);
+    }
+#endif
+    if (!ok) return false;
+
+    entry = std::move(loaded);
+    return true;
+}
+
+bool Cache::load(const std::string& url, CacheEntry& entry) const {
+    CacheEntry loaded;
+    if (!loadMeta(url, loaded)) return false;
+    if (!readBody(pathFor(url), loaded.encoding, loaded.body)) return false;
+
+    entry = std::move(loaded);
+    return true;
+}
+
+bool Cache::writeMeta(const CacheEntry& entry, const std::string& metaPath) const {
+    std::string tmpPath = tempPathFor(metaPath);
+
+    std::ofstream meta(tmpPath);
+    if (!meta) return false;
+    meta << "url=" << entry.url << "\n";
+    meta << "etag=" << entry.etag << "\n";
+    meta << "last-modified=" << entry.lastModified << "\n";
+    meta << "fetched-at=" << entry.fetchedAt << "\n";
+    meta << "encoding=" << entry.encoding << "\n";
+    meta << "generation=" << entry.generation << "\n";
+    meta.close();
+
+    std::error_code ec;
+    if (meta) {
+        std::filesystem::rename(tmpPath, metaPath, ec);
+        if (!ec) return true;
+    }
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+}
+
+CacheEntry Cache::metaFor(const CacheEntry& entry) {
+    CacheEntry meta;
+    meta.url = entry.url;
+    meta.etag = entry.etag;
+    meta.lastModified = entry.lastModified;
+    meta.fetchedAt = entry.fetchedAt;
+    meta.generation = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return meta;
+}
+
+bool Cache::installBody(const CacheEntry& meta, const std::string& tmpPath) const {
+    // Each encoding has its own body file, so a reader still holding the old
+    // ".meta" finds the old body rather than one it would misread
+    std::string base = pathFor(meta.url);
+    std::string bodyPath = base + (meta.encoding.empty() ? ".body" : ".body.zst");
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, bodyPath, ec);
+    if (ec) return false;
+
+    if (!writeMeta(meta, base + ".meta")) return false;
+    std::filesystem::remove(base + (meta.encoding.empty() ? ".body.zst" : ".body"), ec);
+    return true;
+}
+
+bool Cache::store(const CacheEntry& entry) const {
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+    if (ec) {
+        std::cerr << "Error creating cache directory " << cacheDir << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    const std::string* data = &entry.body;
+    CacheEntry meta = metaFor(entry);
+#ifdef BOX_HAVE_ZSTD
+    if (entry.body.size() >= MIN_COMPRESSED_SIZE && compressBody(entry.body)) {
+        data = &zstdScratch.buffer;
+        meta.encoding = "zstd";
+    }
+#endif
+
+    // Write to a temp file and rename so concurrent box processes never see a torn body
+    std::string tmpPath = tempPathFor(pathFor(entry.url) + (meta.encoding.empty() ? ".body" : ".body.zst"));
+    std::ofstream body(tmpPath, std::ios::binary);
+    if (!body) return false;
+    body.write(data->data(), data->size());
+    body.close();
+    if (body && installBody(meta, tmpPath)) return true;
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+}
+
+bool Cache::storeFile(const CacheEntry& entry, const std::string& bodyPath) const {
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+    if (ec) {
+        std::cerr << "Error creating cache directory " << cacheDir << ": " << ec.message() << std::endl;
+        std::filesystem::remove(bodyPath, ec);
+        return false;
+    }
+
+    CacheEntry meta = metaFor(entry);
+#ifdef BOX_HAVE_ZSTD
+    std::string tmpPath = tempPathFor(pathFor(entry.url) + ".body.zst");
+    if (compressFile(bodyPath, tmpPath)) {
+        std::filesystem::remove(bodyPath, ec);
+        meta.encoding = "zstd";
+        if (installBody(meta, tmpPath)) return true;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    std::filesystem::remove(tmpPath, ec);
+#endif
+
+    // Downloads are kept inside the cache directory, so this is a rename
+    if (installBody(meta, bodyPath)) return true;
+    std::filesystem::remove(bodyPath, ec);
+    return false;
+}
+
+bool Cache::touch(CacheEntry& entry) const {
+    // The body may have been rewritten in another encoding since entry was loaded
+    CacheEntry current;
+    if (loadMeta(entry.url, current)) {
+        entry.encoding = current.encoding;
+        entry.generation = current.generation;
+    }
+    entry.fetchedAt = (long long)std::time(nullptr);
+    return writeMeta(entry, pathFor(entry.url) + ".meta");
+}
+
+bool Cache::loadPartial(const std::string& url, CacheEntry& entry, size_t& size) const {
+    std::string path = partialPathFor(url);
+    CacheEntry loaded;
+    if (!readMeta(path + ".meta", url, loaded)) return false;
+
+    // Without a validator there is no safe way to ask for the rest
+    if (loaded.etag.empty() && loaded.lastModified.empty()) return false;
+
+    std::error_code ec;
+    uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec || fileSize == 0) return false;
+
+    size = (size_t)fileSize;
+    entry = std::move(loaded);
+    return true;
+}
+
+bool Cache::storePartial(const CacheEntry& entry) const {
+    return writeMeta(entry, partialPathFor(entry.url) + ".meta");
+}
+
+void Cache::dropPartial(const std::string& url, bool removeData) const {
+    std::string path = partialPathFor(url);
+    std::error_code ec;
+    std::filesystem::remove(path + ".meta", ec);
+    if (removeData) std::filesystem::remove(path, ec);
+}
+
+bool Cache::isLocked(const std::string& name, long long maxAge) const {
+    std::error_code ec;
+    auto takenAt = std::filesystem::last_write_time(cacheDir + "/" + name + ".lock", ec);
+    if (ec) return false;
+    auto age = std::filesystem::file_time_type::clock::now() - takenAt;
+    return age < std::chrono::seconds(maxAge);
+}
+
+bool Cache::lock(const std::string& name, long long maxAge) const {
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+    std::string path = cacheDir + "/" + name + ".lock";
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        // O_EXCL makes creating the file the atomic test-and-set
+#ifdef _WIN32
+        int fd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY, _S_IREAD | _S_IWRITE);
+        if (fd >= 0) {
+            _close(fd);
+            return true;
+        }
+#else
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd >= 0) {
+            close(fd);
+            return true;
+        }
+#endif
+
+        // Held by a live process; an old lock was left by one that died
+        if (isLocked(name, maxAge)) return false;
+        std::filesystem::remove(path, ec);
+    }
+    return false;
+}
+
+void Cache::unlock(const std::string& name) const {
+    std::error_code ec;
+    std::filesystem::remove(cacheDir + "/" + name + ".lock", ec);
+}
+
+} // namespace box
@@ -0,0 +1,755 @@
+#include "http.h"
+#include "sha256.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <chrono>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <wininet.h>
+    #pragma comment(lib, "wininet.lib")
+#else
+    #include <curl/curl.h>
+#endif
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace box {
+
+// Idle easy handles kept around for reuse
+static const size_t MAX_IDLE_HANDLES = 16;
+
+// Give up on a connection attempt after this long
+static const long CONNECT_TIMEOUT_SECONDS = 15;
+
+// A transfer that moves no data for this long has stalled
+static const long STALL_TIMEOUT_SECONDS = 30;
+
+// Hedging: wait this long for a first byte until enough samples have been seen,
+// then the p95 of the last HEDGE_SAMPLES first-byte times (never less than MIN_HEDGE_DELAY)
+static const double DEFAULT_HEDGE_DELAY = 0.5;
+static const double MIN_HEDGE_DELAY = 0.02;
+static const size_t HEDGE_SAMPLES = 64;
+static const size_t MIN_HEDGE_SAMPLES = 8;
+
+static std::string trimHeaderValue(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    size_t last = value.find_last_not_of(" \t\r\n");
+    return value.substr(first, last - first + 1);
+}
+
+// Record the validators and encoding we care about; header names are case-insensitive
+static void recordHeader(const std::string& line, HttpResponse& response) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return;
+
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name == "etag") {
+        response.etag = trimHeaderValue(line.substr(colon + 1));
+    } else if (name == "last-modified") {
+        response.lastModified = trimHeaderValue(line.substr(colon + 1));
+    } else if (name == "content-encoding") {
+        response.contentEncoding = trimHeaderValue(line.substr(colon + 1));
+    }
+}
+
+namespace {
+
+// Destination of a body streamed to disk: written and hashed chunk by chunk
+struct FileSink {
+    std::string path;
+    FILE* file = nullptr;
+    Sha256 hasher;
+    size_t written = 0;
+    size_t resumedFrom = 0;  // bytes kept from an earlier partial download
+    bool started = false;    // first body chunk seen
+    bool failed = false;
+    void* handle = nullptr;  // CURL* the sink belongs to (unused on Windows)
+    const std::function<bool(const char*, size_t)>* onBody = nullptr;  // HttpRequest::onBody
+    bool passBody = false;   // the response is a 2xx, so chunks go to onBody too
+
+    // Open the file, keeping (and hashing) its first resumeFrom bytes
+    bool open(const std::string& filePath, size_t resumeFrom) {
+        path = filePath;
+        if (resumeFrom > 0 && (file = fopen(path.c_str(), "r+b")) != nullptr) {
+            char buffer[65536];
+            size_t remaining = resumeFrom;
+            while (remaining > 0) {
+                size_t count = fread(buffer, 1, std::min(remaining, sizeof(buffer)), file);
+                if (count == 0) break;
+                hasher.update(buffer, count);
+                remaining -= count;
+            }
+            if (remaining == 0 && fseek(file, (long)resumeFrom, SEEK_SET) == 0) {
+                written = resumeFrom;
+                resumedFrom = resumeFrom;
+                return true;
+            }
+            fclose(file);
+            hasher = Sha256();
+        }
+        file = fopen(path.c_str(), "wb");
+        return file != nullptr;
+    }
+
+    // Throw away kept bytes when the server sent the whole body instead of a range
+    bool restart() {
+        fclose(file);
+        file = fopen(path.c_str(), "wb");
+        hasher = Sha256();
+        written = 0;
+        resumedFrom = 0;
+        if (!file) failed = true;
+        return file != nullptr;
+    }
+
+    // Called before the first chunk with the response status and body length
+    bool begin(long status, long long length) {
+        started = true;
+        passBody = onBody && *onBody && status >= 200 && status < 300;
+        if (resumedFrom > 0 && status != 206 && !restart()) return false;
+#ifdef __linux__
+        // Reserve the blocks up front so the file isn't extended write by write
+        if (length > 0) {
+            posix_fallocate(fileno(file), (off_t)written, (off_t)length);
+        }
+#else
+        (void)length;
+#endif
+        return true;
+    }
+
+    bool write(const void* data, size_t size) {
+        if (fwrite(data, 1, size, file) != size) {
+            failed = true;
+            return false;
+        }
+        hasher.update(data, size);
+        written += size;
+        if (passBody && !(*onBody)((const char*)data, size)) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool close(HttpResponse& response) {
+        if (!file) return false;
+        // An empty non-206 answer to a range request still replaces the kept bytes
+        if (!started && resumedFrom > 0 && response.status != 0 && response.status != 206 &&
+            !restart()) return false;
+        if (fflush(file) != 0) failed = true;
+#ifdef __linux__
+        // Drop any preallocated tail the server didn't fill
+        if (ftruncate(fileno(file), (off_t)written) != 0) failed = true;
+#endif
+        if (fclose(file) != 0) failed = true;
+        file = nullptr;
+        response.size = written;
+        response.sha256 = hasher.finish();
+        return !failed;
+    }
+};
+
+} // namespace
+
+#ifdef _WIN32
+
+HttpClient::HttpClient() {
+    share = InternetOpenA("Box/1.0", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
+    if (share) {
+        DWORD connectTimeout = CONNECT_TIMEOUT_SECONDS * 1000;
+        DWORD receiveTimeout = STALL_TIMEOUT_SECONDS * 1000;
+        InternetSetOptionA((HINTERNET)share, INTERNET_OPTION_CONNECT_TIMEOUT, &connectTimeout, sizeof(connectTimeout));
+        InternetSetOptionA((HINTERNET)share, INTERNET_OPTION_RECEIVE_TIMEOUT, &receiveTimeout, sizeof(receiveTimeout));
+
+        // Let WinINet decode gzip/deflate bodies we asked for
+        BOOL decode = TRUE;
+        InternetSetOptionA((HINTERNET)share, INTERNET_OPTION_HTTP_DECODING, &decode, sizeof(decode));
+    }
+}
+
+HttpClient::~HttpClient() {
+    if (share) InternetCloseHandle((HINTERNET)share);
+}
+
+void* HttpClient::acquireHandle() {
+    return nullptr;
+}
+
+void HttpClient::releaseHandle(void* handle) {
+}
+
+// WinINet has no multi interface, so batches run one request at a time
+std::vector<bool> HttpClient::getAll(const std::vector<HttpRequest>& requests,
+                                     std::vector<HttpResponse>& responses,
+                                     size_t maxConcurrent) {
+    std::vector<bool> completed(requests.size(), false);
+    responses.assign(requests.size(), HttpResponse());
+    for (size_t i = 0; i < requests.size() && !cancelled; i++) {
+        completed[i] = fetchOne(requests[i], responses[i]);
+    }
+    return completed;
+}
+
+void HttpClient::cancel() {
+    cancelled = true;
+}
+
+bool HttpClient::fetchOne(const HttpRequest& request, HttpResponse& response) {
+    if (!share) return false;
+    stats.requests++;
+
+    std::string headerBlock;
+    for (const auto& header : request.headers) {
+        headerBlock += header + "\r\n";
+    }
+    if (request.resumeFrom == 0) {
+        headerBlock += "Accept-Encoding: gzip, deflate\r\n";
+    }
+
+    // WinINet pools connections per session internally
+    auto started = std::chrono::steady_clock::now();
+    HINTERNET hUrl = InternetOpenUrlA((HINTERNET)share, request.url.c_str(),
+                                      headerBlock.empty() ? NULL : headerBlock.c_str(),
+                                      (DWORD)headerBlock.size(),
+                                      INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
+    if (!hUrl) {
+        DWORD error = GetLastError();
+        response.connectFailed = error == ERROR_INTERNET_NAME_NOT_RESOLVED ||
+                                 error == ERROR_INTERNET_CANNOT_CONNECT ||
+                                 error == ERROR_INTERNET_TIMEOUT;
+        return false;
+    }
+    response.firstByteTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    DWORD status = 0;
+    DWORD statusSize = sizeof(status);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &statusSize, NULL)) {
+        response.status = (long)status;
+    }
+
+    char value[512];
+    DWORD valueSize = sizeof(value);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_ETAG, value, &valueSize, NULL)) {
+        response.etag = std::string(value, valueSize);
+    }
+    valueSize = sizeof(value);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_LAST_MODIFIED, value, &valueSize, NULL)) {
+        response.lastModified = std::string(value, valueSize);
+    }
+    valueSize = sizeof(value);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_ENCODING, value, &valueSize, NULL)) {
+        response.contentEncoding = std::string(value, valueSize);
+    }
+
+    // Content-Length is the encoded size; WinINet only exposes the decoded body
+    DWORD headerSize = 0;
+    HttpQueryInfoA(hUrl, HTTP_QUERY_RAW_HEADERS_CRLF, NULL, &headerSize, NULL);
+    DWORD wireLength = 0;
+    DWORD wireLengthSize = sizeof(wireLength);
+    if (!HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER, &wireLength, &wireLengthSize, NULL)) {
+        wireLength = 0;
+    }
+
+    std::unique_ptr<FileSink> sink;
+    if (!request.outputPath.empty()) {
+        sink.reset(new FileSink());
+        if (!sink->open(request.outputPath, request.resumeFrom)) {
+            std::cerr << "Cannot write " << request.outputPath << std::endl;
+            InternetCloseHandle(hUrl);
+            return false;
+        }
+        sink->onBody = &request.onBody;
+
+        DWORD length = 0;
+        DWORD lengthSize = sizeof(length);
+        if (!HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER, &length, &lengthSize, NULL)) {
+            length = 0;
+        }
+        if (!sink->begin(response.status, (long long)length)) {
+            InternetCloseHandle(hUrl);
+            sink->close(response);
+            return false;
+        }
+    }
+
+    char buffer[65536];
+    DWORD bytesRead;
+    size_t bodyBytes = 0;
+    bool ok = true;
+    while (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
+        bodyBytes += bytesRead;
+        if (sink) {
+            if (!sink->write(buffer, bytesRead)) {
+                ok = false;
+                break;
+            }
+        } else {
+            response.body.append(buffer, bytesRead);
+        }
+    }
+    InternetCloseHandle(hUrl);
+    stats.wireBytes += headerSize + (wireLength > 0 ? wireLength : bodyBytes);
+    stats.bodyBytes += bodyBytes;
+
+    if (sink && !sink->close(response)) {
+        std::cerr << "Failed to write " << request.outputPath << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+#else
+
+// Callback for curl to write data
+static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    userp->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+// Callback for curl to stream data into a file
+static size_t FileWriteCallback(void* contents, size_t size, size_t nmemb, FileSink* sink) {
+    // A short count makes curl abort the transfer with CURLE_WRITE_ERROR
+    if (!sink->started) {
+        long status = 0;
+        curl_off_t length = -1;
+        curl_easy_getinfo((CURL*)sink->handle, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_getinfo((CURL*)sink->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        if (!sink->begin(status, (long long)length)) return 0;
+    }
+    return sink->write(contents, size * nmemb) ? size * nmemb : 0;
+}
+
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, HttpResponse* response) {
+    std::string line(buffer, size * nitems);
+    // A new status line means a redirect hop; only keep the final response's headers
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        response->etag.clear();
+        response->lastModified.clear();
+        response->contentEncoding.clear();
+    }
+    recordHeader(line, *response);
+    return size * nitems;
+}
+
+static std::once_flag curlInitFlag;
+
+HttpClient::HttpClient() {
+    std::call_once(curlInitFlag, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    // DNS results and TLS sessions are shared by every handle of this client
+    CURLSH* sh = curl_share_init();
+    if (sh) {
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    share = sh;
+
+    // The multi handle owns the connection cache, so connections outlive
+    // individual transfers and HTTP/2 streams can be multiplexed on them
+    CURLM* m = curl_multi_init();
+    if (m) {
+        curl_multi_setopt(m, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+    multi = m;
+}
+
+HttpClient::~HttpClient() {
+    for (void* handle : idleHandles) {
+        curl_easy_cleanup((CURL*)handle);
+    }
+    idleHandles.clear();
+    if (multi) curl_multi_cleanup((CURLM*)multi);
+    if (share) curl_share_cleanup((CURLSH*)share);
+}
+
+void* HttpClient::acquireHandle() {
+    CURL* curl;
+    if (!idleHandles.empty()) {
+        curl = (CURL*)idleHandles.back();
+        idleHandles.pop_back();
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) return nullptr;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, (CURLSH*)share);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    // Fail stalled transfers instead of waiting forever, so callers can retry elsewhere
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, CONNECT_TIMEOUT_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, STALL_TIMEOUT_SECONDS);
+
+    // Prefer HTTP/2 over TLS when libcurl was built with it
+    curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    if (info && (info->features & CURL_VERSION_HTTP2)) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    return curl;
+}
+
+void HttpClient::releaseHandle(void* handle) {
+    if (!handle) return;
+    if (idleHandles.size() < MAX_IDLE_HANDLES) {
+        idleHandles.push_back(handle);
+    } else {
+        curl_easy_cleanup((CURL*)handle);
+    }
+}
+
+std::vector<bool> HttpClient::getAll(const std::vector<HttpRequest>& requests,
+                                     std::vector<HttpResponse>& responses,
+                                     size_t maxConcurrent) {
+    std::vector<bool> completed(requests.size(), false);
+    responses.assign(requests.size(), HttpResponse());
+    if (!multi) return completed;
+    if (maxConcurrent == 0) maxConcurrent = 1;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Transfer {
+        size_t index;
+        struct curl_slist* headerList;
+        std::unique_ptr<FileSink> sink;       // set when the body goes to a file
+        std::unique_ptr<HttpResponse> hedge;  // set on a hedged duplicate, which buffers its own response
+        Clock::time_point started;
+        double behind = 0.0;                  // hedged duplicate: seconds after the original it started
+        CURL* twin = nullptr;                 // the other copy of a hedged request while both run
+        bool hedgeDecided = false;            // already hedged, or the first byte arrived in time
+    };
+
+    CURLM* m = (CURLM*)multi;
+    std::map<CURL*, Transfer> active;
+    size_t next = 0;
+    size_t inFlight = 0;  // requests in flight, not counting hedged duplicates
+    double hedgeAfter = getHedgeDelay();
+
+    // Configure a handle for url and add it to the multi handle
+    auto launch = [&](const std::string& url, struct curl_slist* headerList, FileSink* sink,
+                      HttpResponse& response, bool freshConnection, bool compressed) -> CURL* {
+        CURL* curl = (CURL*)acquireHandle();
+        if (!curl) return nullptr;
+        stats.requests++;
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        if (sink) {
+            sink->handle = curl;
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, FileWriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, sink);
+        } else {
+            // No overall time limit: a large nur.json on a slow link may take a
+            // while, and a transfer that stops moving is cut by the stall timeout
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        }
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+        if (compressed) {
+            // Offer every encoding this libcurl can decode (gzip, deflate, br, zstd)
+            curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        }
+        if (freshConnection) {
+            curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+        }
+
+        // Transfers go through the multi handle so they share its connection cache
+        curl_multi_add_handle(m, curl);
+        return curl;
+    };
+
+    auto buildHeaders = [](const HttpRequest& request) {
+        struct curl_slist* headerList = nullptr;
+        for (const auto& header : request.headers) {
+            headerList = curl_slist_append(headerList, header.c_str());
+        }
+        return headerList;
+    };
+
+    auto start = [&](size_t index) -> bool {
+        const HttpRequest& request = requests[index];
+        std::unique_ptr<FileSink> sink;
+        if (!request.outputPath.empty()) {
+            sink.reset(new FileSink());
+            if (!sink->open(request.outputPath, request.resumeFrom)) {
+                std::cerr << "Cannot write " << request.outputPath << std::endl;
+                return false;
+            }
+            sink->onBody = &request.onBody;
+        }
+
+        struct curl_slist* headerList = buildHeaders(request);
+        CURL* curl = launch(request.url, headerList, sink.get(), responses[index], false,
+                            request.resumeFrom == 0);
+        if (!curl) {
+            curl_slist_free_all(headerList);
+            if (sink) sink->close(responses[index]);
+            return false;
+        }
+
+        active[curl] = Transfer{index, headerList, std::move(sink), nullptr, Clock::now()};
+        inFlight++;
+        return true;
+    };
+
+    // Send a duplicate of a request that is still waiting for its first byte
+    auto startHedge = [&](CURL* primary) {
+        Transfer& first = active[primary];
+        first.hedgeDecided = true;
+        const HttpRequest& request = requests[first.index];
+
+        // Same URL: use a new connection rather than queueing behind the slow one
+        std::unique_ptr<HttpResponse> response(new HttpResponse());
+        struct curl_slist* headerList = buildHeaders(request);
+        CURL* curl = launch(request.hedgeURL, headerList, nullptr, *response,
+                            request.hedgeURL == request.url, true);
+        if (!curl) {
+            curl_slist_free_all(headerList);
+            return;
+        }
+
+        stats.hedgesSent++;
+        first.twin = curl;
+        Transfer& copy = active[curl];
+        copy.index = first.index;
+        copy.headerList = headerList;
+        copy.hedge = std::move(response);
+        copy.started = Clock::now();
+        copy.behind = std::chrono::duration<double>(copy.started - first.started).count();
+        copy.twin = primary;
+        copy.hedgeDecided = true;
+    };
+
+    auto drop = [&](CURL* curl) {
+        auto it = active.find(curl);
+        if (it == active.end()) return;
+
+        // Count what crossed the wire, including cancelled hedges
+        curl_off_t bodySize = 0;
+        long headerSize = 0;
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bodySize);
+        curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &headerSize);
+        stats.wireBytes += (size_t)bodySize + (size_t)headerSize;
+
+        curl_multi_remove_handle(m, curl);
+        curl_slist_free_all(it->second.headerList);
+        active.erase(it);
+        releaseHandle(curl);
+    };
+
+    auto finish = [&](CURL* curl, CURLcode result) {
+        auto it = active.find(curl);
+        if (it == active.end()) return;
+        Transfer& transfer = it->second;
+        size_t index = transfer.index;
+        HttpResponse& response = transfer.hedge ? *transfer.hedge : responses[index];
+
+        // One copy of a hedged request failed: the other one decides the outcome
+        if (result != CURLE_OK && transfer.twin) {
+            auto twin = active.find(transfer.twin);
+            if (twin != active.end()) twin->second.twin = nullptr;
+            drop(curl);
+            return;
+        }
+
+        // First copy of a hedged request to finish wins; cancel the other
+        if (transfer.twin) {
+            drop(transfer.twin);
+            transfer.twin = nullptr;
+            if (transfer.hedge) stats.hedgesWon++;
+        }
+
+        if (result == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+
+            curl_off_t firstByte = 0;
+            curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+            response.firstByteTime = (double)firstByte / 1000000.0;
+
+            // Sampled as the caller saw it: a hedge that won is timed from the
+            // original's start, so slow originals keep counting toward the p95
+            if (!transfer.sink) recordFirstByte(transfer.behind + response.firstByteTime);
+
+            long newConnections = 0;
+            curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &newConnections);
+            if (newConnections > 0) {
+                stats.connectionsOpened++;
+            } else {
+                stats.connectionsReused++;
+            }
+            completed[index] = true;
+        } else {
+            if (!cancelled) {
+                std::cerr << "HTTP request failed for " << requests[index].url << ": "
+                          << curl_easy_strerror(result) << std::endl;
+            }
+            response.body.clear();
+
+            // Tell "server unreachable" apart from failures of an established transfer
+            curl_off_t connectTime = 0;
+            curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectTime);
+            response.connectFailed = result == CURLE_COULDNT_RESOLVE_HOST ||
+                                     result == CURLE_COULDNT_RESOLVE_PROXY ||
+                                     result == CURLE_COULDNT_CONNECT ||
+                                     (result == CURLE_OPERATION_TIMEDOUT && connectTime == 0);
+        }
+
+        FileSink* sink = transfer.sink.get();
+        if (sink && !sink->close(response) && result == CURLE_OK) {
+            std::cerr << "Failed to write " << requests[index].outputPath << std::endl;
+            completed[index] = false;
+        }
+        stats.bodyBytes += sink ? sink->written - sink->resumedFrom : response.body.size();
+
+        if (transfer.hedge) {
+            responses[index] = std::move(*transfer.hedge);
+            responses[index].fromHedge = true;
+        }
+        drop(curl);
+        inFlight--;
+    };
+
+    // Hedge buffered requests that have had no first byte within hedgeAfter.
+    // Returns how long the caller may wait before the next check (ms).
+    auto checkHedges = [&]() -> long {
+        long waitMs = 1000;
+        if (!hedging) return waitMs;
+
+        Clock::time_point now = Clock::now();
+        std::vector<CURL*> slow;
+        for (auto& [curl, transfer] : active) {
+            if (transfer.hedgeDecided || transfer.sink || requests[transfer.index].hedgeURL.empty()) continue;
+
+            curl_off_t firstByte = 0;
+            curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+            if (firstByte > 0) {
+                transfer.hedgeDecided = true;
+                continue;
+            }
+
+            double waited = std::chrono::duration<double>(now - transfer.started).count();
+            if (waited >= hedgeAfter) {
+                slow.push_back(curl);
+            } else {
+                waitMs = std::min(waitMs, (long)((hedgeAfter - waited) * 1000) + 1);
+            }
+        }
+        for (CURL* curl : slow) {
+            startHedge(curl);
+        }
+        return slow.empty() ? waitMs : 0;
+    };
+
+    while ((next < requests.size() || !active.empty()) && !cancelled) {
+        // Keep at most maxConcurrent requests in flight
+        while (inFlight < maxConcurrent && next < requests.size()) {
+            start(next++);
+        }
+        if (active.empty()) break;
+
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(m, &running);
+        if (mc != CURLM_OK) {
+            std::cerr << "curl_multi failed: " << curl_multi_strerror(mc) << std::endl;
+            break;
+        }
+
+        int queued = 0;
+        bool anyDone = false;
+        while (CURLMsg* msg = curl_multi_info_read(m, &queued)) {
+            if (msg->msg == CURLMSG_DONE) {
+                finish(msg->easy_handle, msg->data.result);
+                anyDone = true;
+            }
+        }
+
+        // Wait for socket activity unless a slot just freed up or a hedge was sent
+        long waitMs = checkHedges();
+        if (!anyDone && running > 0 && waitMs > 0) {
+            mc = curl_multi_poll(m, nullptr, 0, (int)waitMs, nullptr);
+            if (mc != CURLM_OK) {
+                std::cerr << "curl_multi failed: " << curl_multi_strerror(mc) << std::endl;
+                break;
+            }
+        }
+    }
+
+    // Abandon anything left after a multi error or cancel()
+    while (!active.empty()) {
+        finish(active.begin()->first, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    return completed;
+}
+
+void HttpClient::cancel() {
+    cancelled = true;
+    if (multi) curl_multi_wakeup((CURLM*)multi);
+}
+
+#endif
+
+bool HttpClient::isCancelled() const {
+    return cancelled;
+}
+
+bool HttpClient::get(const std::string& url, const std::vector<std::string>& headers, HttpResponse& response) {
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = getAll({HttpRequest(url, headers)}, responses, 1);
+    response = std::move(responses[0]);
+    return completed[0];
+}
+
+bool HttpClient::download(const std::string& url, const std::vector<std::string>& headers,
+                          const std::string& outputPath, HttpResponse& response) {
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = getAll({HttpRequest(url, headers, outputPath)}, responses, 1);
+    response = std::move(responses[0]);
+    return completed[0];
+}
+
+const HttpStats& HttpClient::getStats() const {
+    return stats;
+}
+
+void HttpClient::setHedging(bool enabled) {
+    hedging = enabled;
+}
+
+double HttpClient::getHedgeDelay() const {
+    if (firstByteSamples.size() < MIN_HEDGE_SAMPLES) return DEFAULT_HEDGE_DELAY;
+
+    std::vector<double> samples = firstByteSamples;
+    size_t rank = samples.size() * 95 / 100;
+    if (rank >= samples.size()) rank = samples.size() - 1;
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return std::max(samples[rank], MIN_HEDGE_DELAY);
+}
+
+void HttpClient::recordFirstByte(double seconds) {
+    if (seconds <= 0) return;
+    if (firstByteSamples.size() < HEDGE_SAMPLES) {
+        firstByteSamples.push_back(seconds);
+    } else {
+        firstByteSamples[nextSample] = seconds;
+    }
+    nextSample = (nextSample + 1) % HEDGE_SAMPLES;
+}
+
+} // namespace box
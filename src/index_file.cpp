@@ -0,0 +1,359 @@
+#include "index_file.h"
+#include "cache.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace box {
+
+// File layout (all integers are little-endian uint32):
+//
+//   header   64 bytes, see HEADER_* offsets
+//   seeds    bucketCount x u32   displacement seed per hash bucket
+//   slots    count x u32         entry index for each perfect-hash slot
+//   entries  count x 10 x u32    name/url/latest/description/hash (offset, size) pairs
+//   strings  stringsSize bytes   pool the entries point into
+static const char INDEX_MAGIC[8] = {'B', 'O', 'X', 'I', 'D', 'X', '0', '2'};
+static const size_t HEADER_SIZE = 64;
+static const size_t HEADER_COUNT = 8;
+static const size_t HEADER_BUCKETS = 12;
+static const size_t HEADER_SEEDS = 16;
+static const size_t HEADER_SLOTS = 20;
+static const size_t HEADER_ENTRIES = 24;
+static const size_t HEADER_STRINGS = 28;
+static const size_t HEADER_STRINGS_SIZE = 32;
+static const size_t HEADER_SOURCE = 36;  // url, etag, last-modified (offset, size) pairs
+static const size_t HEADER_SERIAL = 60;
+static const size_t ENTRY_SIZE = 40;
+
+// Average keys per bucket; lower is faster to build, higher is smaller
+static const size_t KEYS_PER_BUCKET = 3;
+static const uint32_t MAX_SEED = 1u << 24;
+
+// FNV-1a over the module name
+static uint64_t hashName(std::string_view name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Re-mix the name hash with a bucket seed (splitmix64 finalizer)
+static uint64_t mixSeed(uint64_t hash, uint32_t seed) {
+    uint64_t x = hash ^ ((uint64_t)seed * 0x9E3779B97F4A7C15ULL);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static void putU32(std::string& out, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[offset + i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+CompiledIndex::CompiledIndex() {
+}
+
+CompiledIndex::~CompiledIndex() {
+    close();
+}
+
+bool CompiledIndex::write(const std::string& path, const IndexSource& source,
+                          std::vector<IndexSourceEntry> entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const IndexSourceEntry& a, const IndexSourceEntry& b) { return a.name < b.name; });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const IndexSourceEntry& a, const IndexSourceEntry& b) { return a.name == b.name; }),
+                  entries.end());
+
+    const uint32_t count = (uint32_t)entries.size();
+    const uint32_t bucketCount = count / KEYS_PER_BUCKET + 1;
+
+    // Hash-and-displace: place the biggest buckets first, trying seeds until
+    // every key of the bucket lands on a distinct free slot
+    std::vector<uint64_t> hashes(count);
+    std::vector<std::vector<uint32_t>> buckets(bucketCount);
+    for (uint32_t i = 0; i < count; i++) {
+        hashes[i] = hashName(entries[i].name);
+        buckets[hashes[i] % bucketCount].push_back(i);
+    }
+
+    std::vector<uint32_t> order(bucketCount);
+    for (uint32_t b = 0; b < bucketCount; b++) order[b] = b;
+    std::sort(order.begin(), order.end(),
+              [&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    std::vector<uint32_t> seeds(bucketCount, 0);
+    std::vector<uint32_t> slots(count, 0);
+    std::vector<bool> taken(count, false);
+    std::vector<uint32_t> candidate;
+
+    for (uint32_t b : order) {
+        const auto& keys = buckets[b];
+        if (keys.empty()) break;
+
+        bool placed = false;
+        for (uint32_t seed = 0; seed < MAX_SEED && !placed; seed++) {
+            candidate.clear();
+            bool ok = true;
+            for (uint32_t key : keys) {
+                uint32_t slot = (uint32_t)(mixSeed(hashes[key], seed) % count);
+                if (taken[slot] || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+                    ok = false;
+                    break;
+                }
+                candidate.push_back(slot);
+            }
+            if (!ok) continue;
+
+            for (size_t k = 0; k < keys.size(); k++) {
+                taken[candidate[k]] = true;
+                slots[candidate[k]] = keys[k];
+            }
+            seeds[b] = seed;
+            placed = true;
+        }
+
+        if (!placed) {
+            std::cerr << "Failed to build perfect hash for compiled index" << std::endl;
+            return false;
+        }
+    }
+
+    // String pool
+    std::string strings;
+    auto addString = [&strings](const std::string& value, uint32_t& offset, uint32_t& size) {
+        offset = (uint32_t)strings.size();
+        size = (uint32_t)value.size();
+        strings += value;
+    };
+
+    const size_t seedsOffset = HEADER_SIZE;
+    const size_t slotsOffset = seedsOffset + (size_t)bucketCount * 4;
+    const size_t entriesOffset = slotsOffset + (size_t)count * 4;
+    const size_t stringsOffset = entriesOffset + (size_t)count * ENTRY_SIZE;
+
+    std::string out(stringsOffset, '\0');
+    std::memcpy(&out[0], INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    putU32(out, HEADER_COUNT, count);
+    putU32(out, HEADER_BUCKETS, bucketCount);
+    putU32(out, HEADER_SEEDS, (uint32_t)seedsOffset);
+    putU32(out, HEADER_SLOTS, (uint32_t)slotsOffset);
+    putU32(out, HEADER_ENTRIES, (uint32_t)entriesOffset);
+    putU32(out, HEADER_STRINGS, (uint32_t)stringsOffset);
+
+    const std::string* sourceFields[3] = {&source.url, &source.etag, &source.lastModified};
+    for (int i = 0; i < 3; i++) {
+        uint32_t offset, size;
+        addString(*sourceFields[i], offset, size);
+        putU32(out, HEADER_SOURCE + i * 8, offset);
+        putU32(out, HEADER_SOURCE + i * 8 + 4, size);
+    }
+    putU32(out, HEADER_SERIAL, source.serial);
+
+    for (uint32_t b = 0; b < bucketCount; b++) {
+        putU32(out, seedsOffset + (size_t)b * 4, seeds[b]);
+    }
+    for (uint32_t s = 0; s < count; s++) {
+        putU32(out, slotsOffset + (size_t)s * 4, slots[s]);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const std::string* fields[5] = {&entries[i].name, &entries[i].url, &entries[i].latest,
+                                        &entries[i].description, &entries[i].hash};
+        size_t base = entriesOffset + (size_t)i * ENTRY_SIZE;
+        for (int f = 0; f < 5; f++) {
+            uint32_t offset, size;
+            addString(*fields[f], offset, size);
+            putU32(out, base + f * 8, offset);
+            putU32(out, base + f * 8 + 4, size);
+        }
+    }
+
+    putU32(out, HEADER_STRINGS_SIZE, (uint32_t)strings.size());
+    out += strings;
+
+    // Write then rename so a running box never maps a half-written file
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::string tmpPath = Cache::tempPathFor(path);
+    std::ofstream file(tmpPath, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to create file: " << tmpPath << std::endl;
+        return false;
+    }
+    file.write(out.data(), out.size());
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to write compiled index: " << tmpPath << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cerr << "Failed to write compiled index: " << ec.message() << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+uint32_t CompiledIndex::readU32(size_t offset) const {
+    const unsigned char* p = (const unsigned char*)data + offset;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+std::string_view CompiledIndex::stringAt(uint32_t offset, uint32_t size) const {
+    // Checked per access rather than at open() so mapping stays O(1)
+    if ((uint64_t)offset + size > readU32(HEADER_STRINGS_SIZE)) return std::string_view();
+    return std::string_view(data + readU32(HEADER_STRINGS) + offset, size);
+}
+
+bool CompiledIndex::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)HEADER_SIZE) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!map) return false;
+
+    void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(map);
+        return false;
+    }
+    mapping = map;
+    data = (const char*)view;
+    length = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+
+    data = (const char*)view;
+    length = (size_t)st.st_size;
+#endif
+
+    // Validate the header so lookups never read past the mapping
+    bool valid = std::memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0;
+    if (valid) {
+        uint64_t count = readU32(HEADER_COUNT);
+        uint64_t buckets = readU32(HEADER_BUCKETS);
+        valid = buckets > 0 &&
+                readU32(HEADER_SEEDS) == HEADER_SIZE &&
+                readU32(HEADER_SLOTS) == HEADER_SIZE + buckets * 4 &&
+                readU32(HEADER_ENTRIES) == readU32(HEADER_SLOTS) + count * 4 &&
+                readU32(HEADER_STRINGS) == readU32(HEADER_ENTRIES) + count * ENTRY_SIZE &&
+                (uint64_t)readU32(HEADER_STRINGS) + readU32(HEADER_STRINGS_SIZE) <= length;
+    }
+    if (!valid) {
+        std::cerr << "Ignoring invalid compiled index: " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CompiledIndex::close() {
+    if (!data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    if (mapping) CloseHandle((HANDLE)mapping);
+    mapping = nullptr;
+#else
+    munmap((void*)data, length);
+#endif
+    data = nullptr;
+    length = 0;
+}
+
+bool CompiledIndex::isOpen() const {
+    return data != nullptr;
+}
+
+size_t CompiledIndex::size() const {
+    return data ? readU32(HEADER_COUNT) : 0;
+}
+
+IndexEntry CompiledIndex::at(size_t index) const {
+    size_t base = readU32(HEADER_ENTRIES) + index * ENTRY_SIZE;
+    IndexEntry entry;
+    entry.name = stringAt(readU32(base), readU32(base + 4));
+    entry.url = stringAt(readU32(base + 8), readU32(base + 12));
+    entry.latest = stringAt(readU32(base + 16), readU32(base + 20));
+    entry.description = stringAt(readU32(base + 24), readU32(base + 28));
+    entry.hash = stringAt(readU32(base + 32), readU32(base + 36));
+    return entry;
+}
+
+bool CompiledIndex::lookup(std::string_view name, IndexEntry& entry) const {
+    uint32_t count = (uint32_t)size();
+    if (count == 0) return false;
+
+    uint64_t hash = hashName(name);
+    uint32_t bucketCount = readU32(HEADER_BUCKETS);
+    uint32_t seed = readU32(readU32(HEADER_SEEDS) + (size_t)(hash % bucketCount) * 4);
+    uint32_t slot = (uint32_t)(mixSeed(hash, seed) % count);
+    uint32_t index = readU32(readU32(HEADER_SLOTS) + (size_t)slot * 4);
+    if (index >= count) return false;
+
+    // A perfect hash maps unknown names somewhere too; confirm the match
+    IndexEntry candidate = at(index);
+    if (candidate.name != name) return false;
+    entry = candidate;
+    return true;
+}
+
+std::string_view CompiledIndex::getSourceURL() const {
+    return data ? stringAt(readU32(HEADER_SOURCE), readU32(HEADER_SOURCE + 4)) : std::string_view();
+}
+
+std::string_view CompiledIndex::getSourceETag() const {
+    return data ? stringAt(readU32(HEADER_SOURCE + 8), readU32(HEADER_SOURCE + 12)) : std::string_view();
+}
+
+std::string_view CompiledIndex::getSourceLastModified() const {
+    return data ? stringAt(readU32(HEADER_SOURCE + 16), readU32(HEADER_SOURCE + 20)) : std::string_view();
+}
+
+uint32_t CompiledIndex::getSourceSerial() const {
+    return data ? readU32(HEADER_SERIAL) : 0;
+}
+
+} // namespace box
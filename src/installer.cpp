@@ -1,11 +1,16 @@
 #include "installer.h"
 #include "platform.h"
 #include "builder.h"
+#include "sha256.h"
 #include <iostream>
 #include <fstream>
 #include <sys/stat.h>
+#include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <cctype>
 #include <vector>
+#include <set>
 #include <filesystem>
 
 #ifdef _WIN32
@@ -20,22 +25,90 @@
 
 namespace box {
 
-Installer::Installer() {
-    std::string homeDir;
+// Split "name@version" into its parts
+static void splitModuleSpec(const std::string& moduleSpec, std::string& moduleName, std::string& version) {
+    moduleName = moduleSpec;
+    version = "";
+    size_t atPos = moduleSpec.find('@');
+    if (atPos != std::string::npos) {
+        moduleName = moduleSpec.substr(0, atPos);
+        version = moduleSpec.substr(atPos + 1);
+    }
+}
+
+// Prebuilt binary URL for the current platform
+static std::string binaryURLFor(const VersionMetadata& versionMeta) {
+    if (Platform::isLinux()) {
+        return versionMeta.entryLinux;
+    } else if (Platform::isWindows()) {
+        return versionMeta.entryWin;
+    } else if (Platform::isMacOS()) {
+        return versionMeta.entryMac;
+    }
+    return "";
+}
+
+// Published sha256 of the prebuilt binary for the current platform, or ""
+static std::string binaryDigestFor(const VersionMetadata& versionMeta) {
+    std::string digest;
+    if (Platform::isLinux()) {
+        digest = versionMeta.sha256Linux;
+    } else if (Platform::isWindows()) {
+        digest = versionMeta.sha256Win;
+    } else if (Platform::isMacOS()) {
+        digest = versionMeta.sha256Mac;
+    }
+    std::transform(digest.begin(), digest.end(), digest.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return digest;
+}
+
+// Store key of a binary download: its published digest when the manifest
+// has one, so a binary republished under the same URL is fetched again;
+// otherwise the URL, treating release URLs as immutable
+static std::string binaryStoreKey(const VersionMetadata& versionMeta) {
+    std::string digest = binaryDigestFor(versionMeta);
+    return digest.empty() ? "url:" + binaryURLFor(versionMeta) : "sha256:" + digest;
+}
+
+// Resolve a git ref to a commit without cloning, so source builds can be
+// keyed by what they actually build. Returns "" if it can't be resolved
+// (e.g. an abbreviated hash, or no network).
+static std::string resolveGitCommit(const std::string& repoURL, const std::string& ref) {
+    bool isFullHash = ref.size() == 40 &&
+                      ref.find_first_not_of("0123456789abcdef") == std::string::npos;
+    if (isFullHash) return ref;
+
+    std::string command = "git ls-remote \"" + repoURL + "\" \"" + (ref.empty() ? "HEAD" : ref) + "\"";
 #ifdef _WIN32
-    char* userProfile = getenv("USERPROFILE");
-    if (userProfile) homeDir = userProfile;
+    command += " 2>nul";
+    FILE* pipe = _popen(command.c_str(), "r");
 #else
-    char* home = getenv("HOME");
-    if (home) {
-        homeDir = home;
-    } else {
-        struct passwd* pw = getpwuid(getuid());
-        if (pw) homeDir = pw->pw_dir;
+    command += " 2>/dev/null";
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (!pipe) return "";
+
+    // Prefer the peeled commit ("^{}") of an annotated tag
+    std::string commit;
+    char line[512];
+    while (fgets(line, sizeof(line), pipe)) {
+        std::string entry(line);
+        size_t tab = entry.find('\t');
+        if (tab != 40) continue;
+        if (commit.empty() || entry.find("^{}") != std::string::npos) {
+            commit = entry.substr(0, 40);
+        }
     }
+#ifdef _WIN32
+    _pclose(pipe);
+#else
+    pclose(pipe);
 #endif
-    
-    globalModulesDir = homeDir + "/.box/modules";
+    return commit;
+}
+
+Installer::Installer() {
+    globalModulesDir = Platform::getBoxHome() + "/modules";
     localModulesDir = "./.box/modules";
 }
 
@@ -43,6 +116,30 @@ std::string Installer::getInstallDir(bool global) {
     return global ? globalModulesDir : localModulesDir;
 }
 
+Registry& Installer::getRegistry() {
+    return registry;
+}
+
+bool Installer::installFromStore(const std::string& key, const std::string& dest) {
+    std::string storedPath;
+    if (!store.lookup(key, storedPath)) return false;
+
+    LinkMode mode;
+    if (!Store::materialize(storedPath, dest, mode)) return false;
+
+    const char* how = mode == LinkMode::HARDLINK ? "hard link" : mode == LinkMode::REFLINK ? "reflink" : "copy";
+    std::cout << "Using " << storedPath << " from the store (" << how << ")" << std::endl;
+    return true;
+}
+
+void Installer::addToStore(const std::string& file, const std::string& sha256, const std::string& key) {
+    std::string fileName = std::filesystem::path(file).filename().string();
+    std::string storedPath;
+    if (store.add(file, sha256, fileName, storedPath)) {
+        store.record(key, sha256, fileName);
+    }
+}
+
 bool Installer::ensureDirectory(const std::string& path) {
     try {
         std::filesystem::create_directories(path);
@@ -53,39 +150,84 @@ bool Installer::ensureDirectory(const std::string& path) {
     }
 }
 
+bool Installer::prefetch(const std::vector<std::string>& moduleSpecs, size_t maxConcurrent) {
+    std::vector<std::string> names;
+    std::vector<std::string> versions;
+    for (const auto& spec : moduleSpecs) {
+        std::string name, version;
+        splitModuleSpec(spec, name, version);
+        names.push_back(name);
+        versions.push_back(version);
+    }
+
+    if (!registry.fetchIndexFor(names)) {
+        std::cerr << "Failed to fetch registry index" << std::endl;
+        return false;
+    }
+
+    // All manifests in parallel, then every prebuilt binary they point at
+    registry.prefetchModuleMetadata(names, maxConcurrent);
+
+    // Modules sharing a binary are downloaded once
+    std::vector<std::string> binaryURLs;
+    std::set<std::string> seen;
+    for (size_t i = 0; i < names.size(); i++) {
+        LazyManifest manifest;
+        if (!registry.fetchManifest(names[i], manifest)) continue;
+        std::string version = versions[i].empty() ? manifest.getLatest() : versions[i];
+
+        VersionMetadata versionMeta;
+        if (!registry.fetchVersion(names[i], manifest, version, versionMeta)) continue;
+
+        // Modules with a git repository are built from source instead
+        if (!versionMeta.git.url.empty()) continue;
+
+        // Nothing to fetch for binaries the store already has
+        std::string binaryURL = binaryURLFor(versionMeta);
+        std::string storedPath;
+        if (binaryURL.empty() || !seen.insert(binaryURL).second) continue;
+        if (store.lookup(binaryStoreKey(versionMeta), storedPath)) continue;
+        binaryURLs.push_back(binaryURL);
+    }
+
+    registry.prefetch(binaryURLs, maxConcurrent);
+    return true;
+}
+
 bool Installer::install(const std::string& moduleSpec, bool global) {
-    std::string moduleName = moduleSpec;
-    std::string requestedVersion = "";
+    std::string moduleName;
+    std::string requestedVersion;
+    splitModuleSpec(moduleSpec, moduleName, requestedVersion);
     
-    size_t atPos = moduleSpec.find('@');
-    if (atPos != std::string::npos) {
-        moduleName = moduleSpec.substr(0, atPos);
-        requestedVersion = moduleSpec.substr(atPos + 1);
+    // Joined first, so a background index fetch never prints mid-line
+    if (!registry.fetchIndexFor({moduleName})) {
+        std::cerr << "Failed to fetch registry index" << std::endl;
+        return false;
     }
-    
+
     std::cout << "Installing " << moduleName;
     if (!requestedVersion.empty()) std::cout << "@" << requestedVersion;
     std::cout << "..." << std::endl;
     
-    if (!registry.fetchIndex()) {
-        std::cerr << "Failed to fetch registry index" << std::endl;
-        return false;
-    }
-    
-    ModuleMetadata metadata = registry.fetchModuleMetadata(moduleName);
-    if (metadata.name.empty()) {
+    // Only the version being installed is parsed (or downloaded)
+    LazyManifest manifest;
+    if (!registry.fetchManifest(moduleName, manifest)) {
         std::cerr << "Module not found: " << moduleName << std::endl;
         return false;
     }
     
-    std::string versionToInstall = requestedVersion.empty() ? metadata.latest : requestedVersion;
+    std::string versionToInstall = requestedVersion.empty() ? manifest.getLatest() : requestedVersion;
     
-    if (metadata.versions.find(versionToInstall) == metadata.versions.end()) {
+    if (!manifest.hasVersion(versionToInstall)) {
         std::cerr << "Version not found: " << versionToInstall << std::endl;
         return false;
     }
     
-    VersionMetadata versionMeta = metadata.versions[versionToInstall];
+    VersionMetadata versionMeta;
+    if (!registry.fetchVersion(moduleName, manifest, versionToInstall, versionMeta)) {
+        std::cerr << "Failed to read version metadata: " << versionToInstall << std::endl;
+        return false;
+    }
     
     // Create install directory
     std::string installDir = getInstallDir(global) + "/" + moduleName;
@@ -97,45 +239,62 @@ bool Installer::install(const std::string& moduleSpec, bool global) {
     // Check if git repository is available for this version
     std::string repoURL = versionMeta.git.url;
     std::string repoRef = versionMeta.git.ref;
+    std::string libraryFile = installDir + "/" + moduleName + Platform::getLibraryExtension();
+
+    // Source builds are shared through the store per commit and platform.
+    // The last build of each ref is recorded too, for when the ref can't be resolved.
+    std::string buildKey;
+    std::string refKey;
+    if (!repoURL.empty()) {
+        refKey = "git-ref:" + repoURL + "@" + repoRef + ":" + Platform::getOSString();
+        std::string commit = registry.isOffline() ? "" : resolveGitCommit(repoURL, repoRef);
+        if (!commit.empty()) buildKey = "git:" + repoURL + "@" + commit + ":" + Platform::getOSString();
+    }
 
     if (repoURL.empty()) {
         std::cerr << "No git repository available for module: " << moduleName << std::endl;
         std::cerr << "Falling back to binary download..." << std::endl;
 
         // Fallback to previous behavior if no git repo
-        std::string binaryURL;
-        if (Platform::isLinux()) {
-            binaryURL = versionMeta.entryLinux;
-        } else if (Platform::isWindows()) {
-            binaryURL = versionMeta.entryWin;
-        } else if (Platform::isMacOS()) {
-            binaryURL = versionMeta.entryMac;
-        }
+        std::string binaryURL = binaryURLFor(versionMeta);
 
         if (binaryURL.empty()) {
             std::cerr << "No binary or git repository available for " << Platform::getOSString() << std::endl;
             return false;
         }
 
-        std::cout << "Downloading from " << binaryURL << "..." << std::endl;
-        std::string binaryData = registry.download(binaryURL);
-        if (binaryData.empty()) {
-            std::cerr << "Failed to download module" << std::endl;
-            return false;
-        }
+        // Fetched once per machine; later installs link the stored copy
+        std::string storeKey = binaryStoreKey(versionMeta);
+        if (!installFromStore(storeKey, libraryFile)) {
+            std::cout << "Downloading from " << binaryURL << "..." << std::endl;
+            DownloadResult downloaded;
+            if (!registry.downloadToFile(binaryURL, libraryFile, downloaded)) {
+                std::cerr << "Failed to download module" << std::endl;
+                return false;
+            }
+            std::cout << "Downloaded " << downloaded.size << " bytes (sha256 " << downloaded.sha256 << ")" << std::endl;
 
-        std::string outputFile = installDir + "/" + moduleName + Platform::getLibraryExtension();
-        std::ofstream outFile(outputFile, std::ios::binary);
-        if (!outFile) {
-            std::cerr << "Failed to create file: " << outputFile << std::endl;
-            return false;
-        }
-        outFile.write(binaryData.data(), binaryData.size());
-        outFile.close();
+            std::string expected = binaryDigestFor(versionMeta);
+            if (!expected.empty() && downloaded.sha256 != expected) {
+                std::cerr << "Checksum mismatch for " << binaryURL << ": expected sha256 " << expected << std::endl;
+                std::error_code ec;
+                std::filesystem::remove(libraryFile, ec);
+                return false;
+            }
 
-    #ifndef _WIN32
-        chmod(outputFile.c_str(), 0755);
-    #endif
+        #ifndef _WIN32
+            chmod(libraryFile.c_str(), 0755);
+        #endif
+            addToStore(libraryFile, downloaded.sha256, storeKey);
+        }
+    } else if (!buildKey.empty() && installFromStore(buildKey, libraryFile)) {
+        // This commit was already built for this platform
+    } else if (buildKey.empty() && installFromStore(refKey, libraryFile)) {
+        // Offline (or the ref didn't resolve): reuse the last build of this ref
+    } else if (registry.isOffline()) {
+        std::cerr << "Not cached (offline): no build of " << repoURL << "@"
+                  << (repoRef.empty() ? "HEAD" : repoRef) << " in the store" << std::endl;
+        return false;
     } else {
         // Create a unique temporary directory for building
         std::string tempBaseDir = installDir + "/.tmp";
@@ -206,6 +365,10 @@ bool Installer::install(const std::string& moduleSpec, bool global) {
             }
         }
 
+        // Never let the compiler write through a hard link into the store
+        std::error_code ec;
+        std::filesystem::remove(libraryFile, ec);
+
         // Build the module using the builder
         Builder builder;
         bool buildSuccess = builder.buildFromSource(moduleName, repoDir, installDir, versionToInstall);
@@ -223,6 +386,12 @@ bool Installer::install(const std::string& moduleSpec, bool global) {
             std::cerr << "Failed to build module from source" << std::endl;
             return false;
         }
+
+        std::string sha256;
+        if (Sha256::hashFile(libraryFile, sha256)) {
+            if (!buildKey.empty()) addToStore(libraryFile, sha256, buildKey);
+            addToStore(libraryFile, sha256, refKey);
+        }
     }
     
     std::string metadataFile = installDir + "/metadata.json";
@@ -0,0 +1,362 @@
+#include "json.h"
+#include "structural.h"
+
+namespace box {
+namespace json {
+
+// Deeper documents are rejected instead of overflowing the stack
+static const size_t MAX_DEPTH = 512;
+
+Reader::Reader(std::string_view input) : input(input) {
+}
+
+const std::string& Reader::getError() const {
+    return error;
+}
+
+size_t Reader::getOffset() const {
+    return pos;
+}
+
+void Reader::setVectorized(bool enabled) {
+    vectorized = enabled;
+}
+
+bool Reader::fail(const char* message) {
+    if (error.empty()) {
+        error = std::string(message) + " at offset " + std::to_string(pos);
+    }
+    return false;
+}
+
+void Reader::skipWhitespace() {
+    while (pos < input.size()) {
+        char c = input[pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        pos++;
+    }
+}
+
+bool Reader::parse(Handler& handler) {
+    pos = 0;
+    depth = 0;
+    error.clear();
+
+    skipWhitespace();
+    if (!parseValue(handler)) return false;
+    skipWhitespace();
+    if (pos != input.size()) return fail("Trailing characters");
+    return true;
+}
+
+bool Reader::parseValue(Handler& handler) {
+    if (pos >= input.size()) return fail("Unexpected end of input");
+
+    switch (input[pos]) {
+        case '{':
+            return parseObject(handler);
+        case '[':
+            return parseArray(handler);
+        case '"': {
+            std::string_view value;
+            if (!parseString(value)) return false;
+            return handler.string(value) || fail("Stopped by handler");
+        }
+        case 't':
+            if (!parseLiteral("true")) return false;
+            return handler.boolean(true) || fail("Stopped by handler");
+        case 'f':
+            if (!parseLiteral("false")) return false;
+            return handler.boolean(false) || fail("Stopped by handler");
+        case 'n':
+            if (!parseLiteral("null")) return false;
+            return handler.null() || fail("Stopped by handler");
+        default: {
+            std::string_view raw;
+            if (!parseNumber(raw)) return false;
+            return handler.number(raw) || fail("Stopped by handler");
+        }
+    }
+}
+
+bool Reader::parseObject(Handler& handler) {
+    if (++depth > MAX_DEPTH) return fail("Nesting too deep");
+    pos++; // '{'
+    if (!handler.startObject()) return fail("Stopped by handler");
+
+    skipWhitespace();
+    if (pos < input.size() && input[pos] == '}') {
+        pos++;
+        depth--;
+        return handler.endObject() || fail("Stopped by handler");
+    }
+
+    while (true) {
+        skipWhitespace();
+        if (pos >= input.size() || input[pos] != '"') return fail("Expected object key");
+
+        std::string_view name;
+        if (!parseString(name)) return false;
+        if (!handler.key(name)) return fail("Stopped by handler");
+
+        skipWhitespace();
+        if (pos >= input.size() || input[pos] != ':') return fail("Expected ':'");
+        pos++;
+        skipWhitespace();
+
+        if (handler.skipValue()) {
+            size_t start = pos;
+            if (!skipRaw()) return false;
+            size_t end = pos;
+            while (end > start && (input[end - 1] == ' ' || input[end - 1] == '\t' ||
+                                   input[end - 1] == '\n' || input[end - 1] == '\r')) {
+                end--;
+            }
+            if (end == start) return fail("Expected value");
+            if (!handler.raw(input.substr(start, end - start))) return fail("Stopped by handler");
+        } else if (!parseValue(handler)) {
+            return false;
+        }
+
+        skipWhitespace();
+        if (pos >= input.size()) return fail("Unterminated object");
+        if (input[pos] == ',') {
+            pos++;
+            continue;
+        }
+        if (input[pos] == '}') {
+            pos++;
+            break;
+        }
+        return fail("Expected ',' or '}'");
+    }
+
+    depth--;
+    return handler.endObject() || fail("Stopped by handler");
+}
+
+bool Reader::parseArray(Handler& handler) {
+    if (++depth > MAX_DEPTH) return fail("Nesting too deep");
+    pos++; // '['
+    if (!handler.startArray()) return fail("Stopped by handler");
+
+    skipWhitespace();
+    if (pos < input.size() && input[pos] == ']') {
+        pos++;
+        depth--;
+        return handler.endArray() || fail("Stopped by handler");
+    }
+
+    while (true) {
+        skipWhitespace();
+        if (!parseValue(handler)) return false;
+
+        skipWhitespace();
+        if (pos >= input.size()) return fail("Unterminated array");
+        if (input[pos] == ',') {
+            pos++;
+            continue;
+        }
+        if (input[pos] == ']') {
+            pos++;
+            break;
+        }
+        return fail("Expected ',' or ']'");
+    }
+
+    depth--;
+    return handler.endArray() || fail("Stopped by handler");
+}
+
+bool Reader::skipRaw() {
+    // Only strings and nesting are tracked, which is enough to find the end
+    if (vectorized && pos < input.size() && (input[pos] == '"' || input[pos] == '{' || input[pos] == '[')) {
+        size_t end = StructuralIndex::skipValue(input, pos);
+        if (end == StructuralIndex::npos) {
+            pos = input.size();
+            return fail("Unterminated value");
+        }
+        pos = end;
+        return true;
+    }
+
+    size_t nesting = 0;
+    while (pos < input.size()) {
+        char c = input[pos];
+        if (c == '"') {
+            pos++;
+            while (pos < input.size() && input[pos] != '"') {
+                if (input[pos] == '\\') pos++;
+                pos++;
+            }
+            if (pos >= input.size()) return fail("Unterminated string");
+            pos++;
+        } else if (c == '{' || c == '[') {
+            if (depth + ++nesting > MAX_DEPTH) return fail("Nesting too deep");
+            pos++;
+        } else if (c == '}' || c == ']') {
+            if (nesting == 0) break;
+            nesting--;
+            pos++;
+        } else if (c == ',' && nesting == 0) {
+            break;
+        } else {
+            pos++;
+        }
+        if (nesting == 0 && (c == '"' || c == '}' || c == ']')) break;
+    }
+    if (nesting != 0) return fail("Unterminated value");
+    return true;
+}
+
+bool Reader::parseString(std::string_view& out) {
+    size_t start = ++pos; // skip opening quote
+
+    // Fast path: find the closing quote; only fall back to decoding on '\'
+    while (pos < input.size()) {
+        if (vectorized) {
+            pos = StructuralIndex::findStringEnd(input, pos);
+            if (pos >= input.size()) break;
+        }
+        char c = input[pos];
+        if (c == '"') {
+            out = input.substr(start, pos - start);
+            pos++;
+            return true;
+        }
+        if (c == '\\') {
+            if (!decodeEscapes(start)) return false;
+            out = scratch;
+            return true;
+        }
+        if ((unsigned char)c < 0x20) return fail("Control character in string");
+        pos++;
+    }
+    return fail("Unterminated string");
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void appendUTF8(std::string& out, unsigned int cp) {
+    if (cp < 0x80) {
+        out.push_back((char)cp);
+    } else if (cp < 0x800) {
+        out.push_back((char)(0xC0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back((char)(0xE0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+bool Reader::decodeEscapes(size_t start) {
+    // Copy the unescaped prefix, then decode the rest of the string
+    scratch.assign(input.data() + start, pos - start);
+
+    while (pos < input.size()) {
+        char c = input[pos];
+        if (c == '"') {
+            pos++;
+            return true;
+        }
+        if ((unsigned char)c < 0x20) return fail("Control character in string");
+        if (c != '\\') {
+            scratch.push_back(c);
+            pos++;
+            continue;
+        }
+
+        if (++pos >= input.size()) break;
+        char escaped = input[pos++];
+        switch (escaped) {
+            case '"': scratch.push_back('"'); break;
+            case '\\': scratch.push_back('\\'); break;
+            case '/': scratch.push_back('/'); break;
+            case 'b': scratch.push_back('\b'); break;
+            case 'f': scratch.push_back('\f'); break;
+            case 'n': scratch.push_back('\n'); break;
+            case 'r': scratch.push_back('\r'); break;
+            case 't': scratch.push_back('\t'); break;
+            case 'u': {
+                auto readHex4 = [this](unsigned int& value) -> bool {
+                    if (pos + 4 > input.size()) return false;
+                    value = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int digit = hexValue(input[pos + i]);
+                        if (digit < 0) return false;
+                        value = (value << 4) | (unsigned int)digit;
+                    }
+                    pos += 4;
+                    return true;
+                };
+
+                unsigned int cp;
+                if (!readHex4(cp)) return fail("Invalid \\u escape");
+
+                // Combine UTF-16 surrogate pairs
+                if (cp >= 0xD800 && cp <= 0xDBFF && pos + 1 < input.size() &&
+                    input[pos] == '\\' && input[pos + 1] == 'u') {
+                    size_t saved = pos;
+                    pos += 2;
+                    unsigned int low;
+                    if (readHex4(low) && low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else {
+                        pos = saved;
+                    }
+                }
+                appendUTF8(scratch, cp);
+                break;
+            }
+            default:
+                return fail("Invalid escape");
+        }
+    }
+    return fail("Unterminated string");
+}
+
+bool Reader::parseNumber(std::string_view& out) {
+    size_t start = pos;
+    if (pos < input.size() && input[pos] == '-') pos++;
+
+    size_t digits = pos;
+    while (pos < input.size() && input[pos] >= '0' && input[pos] <= '9') pos++;
+    if (pos == digits) return fail("Unexpected character");
+
+    if (pos < input.size() && input[pos] == '.') {
+        pos++;
+        size_t fraction = pos;
+        while (pos < input.size() && input[pos] >= '0' && input[pos] <= '9') pos++;
+        if (pos == fraction) return fail("Invalid number");
+    }
+    if (pos < input.size() && (input[pos] == 'e' || input[pos] == 'E')) {
+        pos++;
+        if (pos < input.size() && (input[pos] == '+' || input[pos] == '-')) pos++;
+        size_t exponent = pos;
+        while (pos < input.size() && input[pos] >= '0' && input[pos] <= '9') pos++;
+        if (pos == exponent) return fail("Invalid number");
+    }
+
+    out = input.substr(start, pos - start);
+    return true;
+}
+
+bool Reader::parseLiteral(std::string_view literal) {
+    if (input.substr(pos, literal.size()) != literal) return fail("Invalid literal");
+    pos += literal.size();
+    return true;
+}
+
+} // namespace json
+} // namespace box
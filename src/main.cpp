@@ -9,6 +9,7 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <cstdlib>
 
 namespace fs = std::filesystem;
 
@@ -64,9 +65,10 @@ void printUsage() {
     std::cout << "Usage: box <command> [options]\n" << std::endl;
     std::cout << "Commands:\n" << std::endl;
     std::cout << "  Installation:" << std::endl;
-    std::cout << "    install <module>       Install a module from NUR" << std::endl;
+    std::cout << "    install <module>...    Install modules from NUR" << std::endl;
+    std::cout << "    install [-j N]         Install all .quark dependencies (N parallel downloads)" << std::endl;
     std::cout << "    uninstall <module>     Remove an installed module" << std::endl;
-    std::cout << "    update <module>        Update a module to latest version" << std::endl;
+    std::cout << "    update <module>...     Update modules to their latest version" << std::endl;
     std::cout << "    list                   List installed modules" << std::endl;
     std::cout << std::endl;
     std::cout << "  Building:" << std::endl;
@@ -74,16 +76,85 @@ void printUsage() {
     std::cout << "    build nt <module>      Build Neutron source module (future)" << std::endl;
     std::cout << std::endl;
     std::cout << "  Information:" << std::endl;
-    std::cout << "    search <query>         Search for modules in NUR" << std::endl;
+    std::cout << "    search <query> [-n N]  Search for modules in NUR (top N results)" << std::endl;
     std::cout << "    info <module>          Show module information" << std::endl;
     std::cout << "    version                Show Box version" << std::endl;
     std::cout << std::endl;
+    std::cout << "  Registry:" << std::endl;
+    std::cout << "    index compile          Compile the cached index for fast lookups" << std::endl;
+    std::cout << "    index refresh          Revalidate the cached index now" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --offline                Use only the local cache and store (also BOX_OFFLINE=1)" << std::endl;
+    std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  box install base64" << std::endl;
     std::cout << "  box search crypto" << std::endl;
     std::cout << "  box build native mymodule" << std::endl;
 }
 
+// Default download concurrency, overridable with BOX_JOBS
+size_t getDefaultJobs() {
+    const char* env = getenv("BOX_JOBS");
+    if (env) {
+        long value = std::atol(env);
+        if (value > 0) return (size_t)value;
+    }
+    return 8;
+}
+
+// How old a cached index search/info may answer from, overridable with
+// BOX_INDEX_MAX_STALE (seconds, 0 to always revalidate first)
+long long getMaxStale() {
+    const char* env = getenv("BOX_INDEX_MAX_STALE");
+    if (env && *env) {
+        long long value = std::atoll(env);
+        return value > 0 ? value : 0;
+    }
+    return 600;
+}
+
+size_t parseJobs(const std::string& value, size_t fallback) {
+    long jobs = std::atol(value.c_str());
+    if (jobs <= 0) {
+        std::cerr << "Ignoring invalid job count: " << value << std::endl;
+        return fallback;
+    }
+    return (size_t)jobs;
+}
+
+// Print network counters when BOX_STATS is set
+void printStats(const Registry& registry) {
+    const char* enabled = getenv("BOX_STATS");
+    if (!enabled || std::string(enabled) == "0") return;
+
+    const HttpStats& stats = registry.getHttpStats();
+    std::cerr << "[stats] HTTP requests: " << stats.requests
+              << ", new connections: " << stats.connectionsOpened
+              << ", reused connections: " << stats.connectionsReused
+              << ", hedged: " << stats.hedgesSent << " (" << stats.hedgesWon << " won)" << std::endl;
+
+    // Bytes received vs. bytes after decoding, to see what compression saves
+    std::cerr << "[stats] bytes on the wire: " << stats.wireBytes << ", content bytes: " << stats.bodyBytes;
+    if (stats.bodyBytes > 0 && stats.wireBytes < stats.bodyBytes) {
+        std::cerr << " (" << (stats.bodyBytes - stats.wireBytes) * 100 / stats.bodyBytes << "% saved)";
+    }
+    std::cerr << std::endl;
+
+    // Which registry mirror served what
+    const Mirrors& mirrors = registry.getMirrors();
+    for (size_t i = 0; i < mirrors.getMirrors().size(); i++) {
+        const Mirror& mirror = mirrors.getMirrors()[i];
+        if (mirror.requests == 0 && mirror.failures == 0) continue;
+        std::cerr << "[stats] mirror " << mirror.url << (i == mirrors.getActive() ? " (active)" : "")
+                  << ": " << mirror.requests << " requests, " << mirror.failures << " failed";
+        if (mirror.latency >= 0) {
+            std::cerr << ", probe " << (long)(mirror.latency * 1000) << " ms";
+        }
+        std::cerr << std::endl;
+    }
+}
+
 void printVersion() {
     std::cout << "Box Package Manager v1.0.0" << std::endl;
     std::cout << "Platform: " << Platform::getOSString() << std::endl;
@@ -91,6 +162,19 @@ void printVersion() {
 }
 
 int main(int argc, char* argv[]) {
+    // --offline may appear anywhere; take it out so commands see their usual arguments
+    bool offline = false;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && std::string(argv[i]) == "--offline") {
+            offline = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    argc = (int)args.size();
+    argv = args.data();
+
     if (argc < 2) {
         printUsage();
         return 1;
@@ -109,7 +193,31 @@ int main(int argc, char* argv[]) {
     }
     
     if (command == "install") {
-        if (argc < 3) {
+        Installer installer;
+        if (offline) installer.getRegistry().setOffline(true);
+
+        // Collect options; anything else is a module spec
+        size_t jobs = getDefaultJobs();
+        std::vector<std::string> moduleArgs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+                jobs = parseJobs(argv[++i], jobs);
+            } else if (arg.rfind("--jobs=", 0) == 0) {
+                jobs = parseJobs(arg.substr(7), jobs);
+            } else {
+                moduleArgs.push_back(arg);
+            }
+        }
+
+        // The index loads in the background while the .quark file is found and
+        // read; exits before the first lookup cancel it instead of waiting
+        Registry& registry = installer.getRegistry();
+        registry.startIndexFetch();
+
+        // Modules named on the command line, or else the project's dependencies
+        std::vector<std::string> installSpecs = moduleArgs;
+        if (installSpecs.empty()) {
             // Try to find .quark file
             std::string quarkFile;
             bool found = false;
@@ -122,44 +230,48 @@ int main(int argc, char* argv[]) {
             }
 
             if (!found) {
+                registry.cancelIndexFetch();
                 std::cerr << "Error: Module name required or no .quark file found" << std::endl;
-                std::cerr << "Usage: box install <module>" << std::endl;
+                std::cerr << "Usage: box install <module>[@version]..." << std::endl;
                 return 1;
             }
 
-            std::cout << "Found project file: " << quarkFile << std::endl;
             auto deps = parseQuarkDependencies(quarkFile);
             if (deps.empty()) {
+                registry.cancelIndexFetch();
+                std::cout << "Found project file: " << quarkFile << std::endl;
                 std::cout << "No dependencies found in " << quarkFile << std::endl;
                 return 0;
             }
 
-            Installer installer;
-            int successCount = 0;
+            // Printed once the background fetch is done with stdout
+            registry.waitIndexFetch();
+            std::cout << "Found project file: " << quarkFile << std::endl;
+
             for (const auto& [name, version] : deps) {
                 std::string installSpec = name;
                 if (version != "*" && !version.empty()) {
                     installSpec += "@" + version;
                 }
-                
-                if (installer.install(installSpec, false)) {
-                    successCount++;
-                } else {
-                    std::cerr << "Failed to install " << name << std::endl;
-                }
+                installSpecs.push_back(installSpec);
             }
-            
-            return (successCount == deps.size()) ? 0 : 1;
         }
-        
-        std::string moduleName = argv[2];
-        Installer installer;
-        
-        if (installer.install(moduleName, false)) {
-            return 0;
-        } else {
-            return 1;
+
+        // Fetch every manifest and binary concurrently before installing in order;
+        // the index is fetched once and shared by every install below
+        if (installSpecs.size() > 1) installer.prefetch(installSpecs, jobs);
+
+        size_t successCount = 0;
+        for (const auto& installSpec : installSpecs) {
+            if (installer.install(installSpec, false)) {
+                successCount++;
+            } else if (installSpecs.size() > 1) {
+                std::cerr << "Failed to install " << installSpec << std::endl;
+            }
         }
+
+        printStats(registry);
+        return (successCount == installSpecs.size()) ? 0 : 1;
     }
     
     if (command == "uninstall") {
@@ -182,18 +294,23 @@ int main(int argc, char* argv[]) {
     if (command == "update") {
         if (argc < 3) {
             std::cerr << "Error: Module name required" << std::endl;
-            std::cerr << "Usage: box update <module>" << std::endl;
+            std::cerr << "Usage: box update <module>..." << std::endl;
             return 1;
         }
         
-        std::string moduleName = argv[2];
         Installer installer;
-        
-        if (installer.update(moduleName, true)) {
-            return 0;
-        } else {
-            return 1;
+        if (offline) installer.getRegistry().setOffline(true);
+
+        // Every module is updated against the same index snapshot
+        std::vector<std::string> moduleNames(argv + 2, argv + argc);
+        if (moduleNames.size() > 1) installer.prefetch(moduleNames, getDefaultJobs());
+
+        bool updated = true;
+        for (const auto& moduleName : moduleNames) {
+            if (!installer.update(moduleName, true)) updated = false;
         }
+        printStats(installer.getRegistry());
+        return updated ? 0 : 1;
     }
     
     if (command == "list") {
@@ -212,30 +329,64 @@ int main(int argc, char* argv[]) {
     }
     
     if (command == "search") {
-        if (argc < 3) {
+        std::string query;
+        size_t limit = 20;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if ((arg == "-n" || arg == "--limit") && i + 1 < argc) {
+                long value = std::atol(argv[++i]);
+                limit = value > 0 ? (size_t)value : 0;
+            } else if (query.empty()) {
+                query = arg;
+            }
+        }
+
+        if (query.empty()) {
             std::cerr << "Error: Search query required" << std::endl;
-            std::cerr << "Usage: box search <query>" << std::endl;
+            std::cerr << "Usage: box search <query> [--limit N]" << std::endl;
             return 1;
         }
         
-        std::string query = argv[2];
         Registry registry;
+        if (offline) registry.setOffline(true);
+        registry.setMaxStale(getMaxStale());
         
-        if (!registry.fetchIndex()) {
+        auto printResult = [](const SearchResult& result) {
+            std::cout << "  " << result.name;
+            if (!result.description.empty()) {
+                std::cout << std::string(result.name.size() < 20 ? 20 - result.name.size() : 1, ' ')
+                          << result.description;
+            }
+            if (result.match == MatchKind::FUZZY) {
+                std::cout << " (did you mean?)";
+            }
+            std::cout << std::endl;
+        };
+
+        // Matches are printed as the index streams in; fuzzy ones wait for the ranking
+        std::vector<std::string> printed;
+        std::vector<SearchResult> results;
+        bool ok = registry.streamSearch(query, limit, [&](const SearchResult& result) {
+            if (result.match == MatchKind::FUZZY || (limit && printed.size() >= limit)) return;
+            printResult(result);
+            printed.push_back(result.name);
+        }, results);
+        if (!ok) {
             std::cerr << "Failed to fetch registry" << std::endl;
             return 1;
         }
-        
-        auto results = registry.search(query);
-        
+
+        std::vector<std::string> ranked;
+        for (const auto& result : results) ranked.push_back(result.name);
         if (results.empty()) {
             std::cout << "No modules found matching '" << query << "'" << std::endl;
+        } else if (ranked == printed) {
+            std::cout << "Found " << results.size() << " module(s)" << std::endl;
         } else {
             std::cout << "Found " << results.size() << " module(s):" << std::endl;
-            for (const auto& mod : results) {
-                std::cout << "  " << mod << std::endl;
-            }
+            for (const auto& result : results) printResult(result);
         }
+        printStats(registry);
         return 0;
     }
     
@@ -248,8 +399,10 @@ int main(int argc, char* argv[]) {
         
         std::string moduleName = argv[2];
         Registry registry;
+        if (offline) registry.setOffline(true);
+        registry.setMaxStale(getMaxStale());
         
-        if (!registry.fetchIndex()) {
+        if (!registry.fetchIndexFor({moduleName})) {
             std::cerr << "Failed to fetch registry" << std::endl;
             return 1;
         }
@@ -284,9 +437,31 @@ int main(int argc, char* argv[]) {
             }
         }
         
+        printStats(registry);
         return 0;
     }
     
+    if (command == "index") {
+        std::string action = argc >= 3 ? argv[2] : "";
+        if (action != "compile" && action != "refresh") {
+            std::cerr << "Usage: box index <compile|refresh>" << std::endl;
+            return 1;
+        }
+
+        Registry registry;
+        if (offline) registry.setOffline(true);
+        bool done;
+        if (action == "compile") {
+            done = registry.compileIndex();
+        } else {
+            // Also run in the background after search/info answered from a stale copy
+            std::vector<std::string> moduleNames(argv + 3, argv + argc);
+            done = registry.refreshIndex(moduleNames);
+        }
+        printStats(registry);
+        return done ? 0 : 1;
+    }
+    
     if (command == "build") {
         if (argc < 4) {
             std::cerr << "Error: Build type and module name required" << std::endl;
@@ -0,0 +1,649 @@
+#include "metadata.h"
+#include "json.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace box {
+
+// Arena block size; longer strings get a block of their own
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+static const size_t ARENA_LARGE_STRING = ARENA_BLOCK_SIZE / 4;
+
+// Lookup table starts at this many slots and doubles past 3/4 full
+static const size_t ARENA_INITIAL_SLOTS = 1024;
+
+// FNV-1a, like the cache file names
+static uint64_t hashString(std::string_view value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+StringArena::StringArena() {
+}
+
+std::string_view StringArena::store(std::string_view value) {
+    if (value.empty()) return std::string_view();
+    return copy(value);
+}
+
+std::string_view StringArena::intern(std::string_view value) {
+    if (value.empty()) return std::string_view();
+    if ((count + 1) * 4 > slots.size() * 3) grow();
+
+    size_t mask = slots.size() - 1;
+    size_t slot = (size_t)hashString(value) & mask;
+    while (slots[slot].data() != nullptr) {
+        if (slots[slot] == value) return slots[slot];
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = copy(value);
+    count++;
+    return slots[slot];
+}
+
+std::string_view StringArena::copy(std::string_view value) {
+    if (value.size() > ARENA_LARGE_STRING) {
+        // Keep the current block open for the small strings that follow
+        std::unique_ptr<char[]> large = std::make_unique<char[]>(value.size());
+        std::memcpy(large.get(), value.data(), value.size());
+        blockBytes += value.size();
+        blocks.insert(blocks.begin(), std::move(large));
+        return std::string_view(blocks.front().get(), value.size());
+    }
+
+    if (blocks.empty() || blockCapacity - blockUsed < value.size()) {
+        blocks.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+        blockBytes += ARENA_BLOCK_SIZE;
+        blockUsed = 0;
+        blockCapacity = ARENA_BLOCK_SIZE;
+    }
+    char* out = blocks.back().get() + blockUsed;
+    std::memcpy(out, value.data(), value.size());
+    blockUsed += value.size();
+    return std::string_view(out, value.size());
+}
+
+void StringArena::grow() {
+    std::vector<std::string_view> old;
+    old.swap(slots);
+    slots.resize(old.empty() ? ARENA_INITIAL_SLOTS : old.size() * 2);
+
+    size_t mask = slots.size() - 1;
+    for (std::string_view value : old) {
+        if (value.data() == nullptr) continue;
+        size_t slot = (size_t)hashString(value) & mask;
+        while (slots[slot].data() != nullptr) slot = (slot + 1) & mask;
+        slots[slot] = value;
+    }
+}
+
+void StringArena::clear() {
+    blocks.clear();
+    slots.clear();
+    blockUsed = 0;
+    blockCapacity = 0;
+    blockBytes = 0;
+    count = 0;
+}
+
+size_t StringArena::size() const {
+    return count;
+}
+
+size_t StringArena::memoryUsage() const {
+    return blockBytes + slots.capacity() * sizeof(std::string_view) +
+           blocks.capacity() * sizeof(std::unique_ptr<char[]>);
+}
+
+namespace {
+
+// Ranges up to this size are insertion-sorted: stable without
+// std::stable_sort's scratch buffer, and manifests list versions nearly
+// in order anyway
+const size_t INSERTION_SORT_LIMIT = 32;
+
+template <typename T, typename Less>
+void sortRows(T* begin, T* end, Less less) {
+    if ((size_t)(end - begin) > INSERTION_SORT_LIMIT) {
+        std::stable_sort(begin, end, less);
+        return;
+    }
+    for (T* it = begin + 1; it < end; ++it) {
+        T row = *it;
+        T* hole = it;
+        while (hole > begin && less(row, *(hole - 1))) {
+            *hole = *(hole - 1);
+            --hole;
+        }
+        *hole = row;
+    }
+}
+
+enum class Field {
+    OTHER,
+    DESCRIPTION,
+    AUTHOR,
+    LICENSE,
+    REPOSITORY,
+    LATEST,
+    VERSIONS,
+    ENTRY_LINUX,
+    ENTRY_WIN,
+    ENTRY_MAC,
+    SHA256_LINUX,
+    SHA256_WIN,
+    SHA256_MAC,
+    GIT,
+    DEPS,
+    URL,
+    REF
+};
+
+Field fieldOf(std::string_view key) {
+    if (key == "description") return Field::DESCRIPTION;
+    if (key == "author") return Field::AUTHOR;
+    if (key == "license") return Field::LICENSE;
+    if (key == "repository") return Field::REPOSITORY;
+    if (key == "latest") return Field::LATEST;
+    if (key == "versions") return Field::VERSIONS;
+    if (key == "entry-linux") return Field::ENTRY_LINUX;
+    if (key == "entry-win") return Field::ENTRY_WIN;
+    if (key == "entry-mac") return Field::ENTRY_MAC;
+    if (key == "sha256-linux") return Field::SHA256_LINUX;
+    if (key == "sha256-win") return Field::SHA256_WIN;
+    if (key == "sha256-mac") return Field::SHA256_MAC;
+    if (key == "git") return Field::GIT;
+    if (key == "deps") return Field::DEPS;
+    if (key == "url") return Field::URL;
+    if (key == "ref") return Field::REF;
+    return Field::OTHER;
+}
+
+/**
+ * Appends one manifest to a MetadataTable's rows
+ *
+ * Same layout as Registry's ManifestHandler, but keys are kept as field
+ * codes or interned views instead of strings, so nothing is allocated
+ * beyond arena blocks and row growth.
+ */
+class CompactManifestHandler : public json::Handler {
+public:
+    CompactManifestHandler(StringArena& strings, CompactModule& module,
+                           std::vector<CompactVersion>& versions, std::vector<CompactDep>& deps)
+        : strings(strings), module(module), versions(versions), deps(deps) {}
+
+    bool startObject() override {
+        depth++;
+        if (depth == 3 && fields[1] == Field::VERSIONS) {
+            CompactVersion row;
+            row.version = versionKey;
+            row.firstDep = (uint32_t)deps.size();
+            versions.push_back(row);
+            inVersion = true;
+        }
+        return true;
+    }
+
+    bool endObject() override {
+        if (depth == 3 && inVersion) {
+            CompactVersion& row = versions.back();
+            row.depCount = (uint32_t)deps.size() - row.firstDep;
+            inVersion = false;
+        }
+        depth--;
+        return true;
+    }
+
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) {
+            fields[1] = fieldOf(name);
+        } else if (depth == 2 && fields[1] == Field::VERSIONS) {
+            versionKey = strings.intern(name);
+        } else if (depth == 3) {
+            fields[3] = fieldOf(name);
+        } else if (depth == 4 && inVersion && fields[3] == Field::DEPS) {
+            depName = strings.intern(name);
+        } else if (depth == 4) {
+            fields[4] = fieldOf(name);
+        }
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (depth == 1) {
+            switch (fields[1]) {
+                case Field::DESCRIPTION: module.description = strings.intern(value); break;
+                case Field::AUTHOR: module.author = strings.intern(value); break;
+                case Field::LICENSE: module.license = strings.intern(value); break;
+                case Field::REPOSITORY: module.repository = strings.intern(value); break;
+                case Field::LATEST: module.latest = strings.intern(value); break;
+                default: break;
+            }
+        } else if (inVersion && depth == 3) {
+            CompactVersion& row = versions.back();
+            switch (fields[3]) {
+                case Field::DESCRIPTION: row.description = strings.intern(value); break;
+                case Field::ENTRY_LINUX: row.entryLinux = strings.store(value); break;
+                case Field::ENTRY_WIN: row.entryWin = strings.store(value); break;
+                case Field::ENTRY_MAC: row.entryMac = strings.store(value); break;
+                case Field::SHA256_LINUX: row.sha256Linux = strings.store(value); break;
+                case Field::SHA256_WIN: row.sha256Win = strings.store(value); break;
+                case Field::SHA256_MAC: row.sha256Mac = strings.store(value); break;
+                default: break;
+            }
+        } else if (inVersion && depth == 4) {
+            if (fields[3] == Field::GIT) {
+                if (fields[4] == Field::URL) versions.back().gitURL = strings.intern(value);
+                else if (fields[4] == Field::REF) versions.back().gitRef = strings.store(value);
+            } else if (fields[3] == Field::DEPS) {
+                deps.push_back(CompactDep{depName, strings.intern(value)});
+            }
+        }
+        return true;
+    }
+
+private:
+    static const int MAX_FIELDS = 5;
+
+    StringArena& strings;
+    CompactModule& module;
+    std::vector<CompactVersion>& versions;
+    std::vector<CompactDep>& deps;
+    int depth = 0;
+    bool inVersion = false;
+    Field fields[MAX_FIELDS] = {};  // current key at depths 1, 3 and 4
+    std::string_view versionKey;
+    std::string_view depName;
+};
+
+} // namespace
+
+MetadataTable::MetadataTable() {
+}
+
+bool MetadataTable::addManifest(std::string_view name, std::string_view content) {
+    size_t firstVersion = versions.size();
+    size_t firstDep = deps.size();
+
+    CompactModule module;
+    module.name = strings.intern(name);
+    CompactManifestHandler handler(strings, module, versions, deps);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        // Interned strings stay behind; the rows don't
+        versions.resize(firstVersion);
+        deps.resize(firstDep);
+        return false;
+    }
+
+    // Sorted like std::map; a repeated key keeps its last occurrence, and
+    // deps of a dropped version just stay unreferenced
+    auto byVersion = [](const CompactVersion& a, const CompactVersion& b) { return a.version < b.version; };
+    sortRows(versions.data() + firstVersion, versions.data() + versions.size(), byVersion);
+    size_t kept = firstVersion;
+    for (size_t i = firstVersion; i < versions.size(); i++) {
+        if (i + 1 < versions.size() && versions[i + 1].version == versions[i].version) continue;
+        versions[kept++] = versions[i];
+    }
+    versions.resize(kept);
+
+    auto byName = [](const CompactDep& a, const CompactDep& b) { return a.name < b.name; };
+    for (size_t i = firstVersion; i < versions.size(); i++) {
+        CompactVersion& version = versions[i];
+        CompactDep* begin = deps.data() + version.firstDep;
+        CompactDep* end = begin + version.depCount;
+        sortRows(begin, end, byName);
+        CompactDep* out = begin;
+        for (CompactDep* it = begin; it != end; ++it) {
+            if (it + 1 != end && (it + 1)->name == it->name) continue;
+            *out++ = *it;
+        }
+        version.depCount = (uint32_t)(out - begin);
+    }
+
+    module.firstVersion = (uint32_t)firstVersion;
+    module.versionCount = (uint32_t)(versions.size() - firstVersion);
+    modules.push_back(module);
+    return true;
+}
+
+size_t MetadataTable::size() const {
+    return modules.size();
+}
+
+const CompactModule& MetadataTable::at(size_t index) const {
+    return modules[index];
+}
+
+const CompactModule* MetadataTable::find(std::string_view name) const {
+    // Sorted lazily, so adding a batch of modules costs one sort
+    if (byNameCount != modules.size()) {
+        byName.resize(modules.size());
+        for (size_t i = 0; i < modules.size(); i++) byName[i] = (uint32_t)i;
+        std::sort(byName.begin(), byName.end(), [this](uint32_t a, uint32_t b) {
+            return modules[a].name < modules[b].name;
+        });
+        byNameCount = modules.size();
+    }
+
+    auto it = std::lower_bound(byName.begin(), byName.end(), name, [this](uint32_t row, std::string_view key) {
+        return modules[row].name < key;
+    });
+    if (it == byName.end() || modules[*it].name != name) return nullptr;
+    return &modules[*it];
+}
+
+MetadataRange<CompactVersion> MetadataTable::versionsOf(const CompactModule& module) const {
+    return MetadataRange<CompactVersion>{versions.data() + module.firstVersion, module.versionCount};
+}
+
+const CompactVersion* MetadataTable::findVersion(const CompactModule& module, std::string_view version) const {
+    MetadataRange<CompactVersion> range = versionsOf(module);
+    const CompactVersion* it = std::lower_bound(range.begin(), range.end(), version,
+        [](const CompactVersion& row, std::string_view key) { return row.version < key; });
+    if (it == range.end() || it->version != version) return nullptr;
+    return it;
+}
+
+MetadataRange<CompactDep> MetadataTable::depsOf(const CompactVersion& version) const {
+    return MetadataRange<CompactDep>{deps.data() + version.firstDep, version.depCount};
+}
+
+void MetadataTable::toMetadata(const CompactModule& module, ModuleMetadata& metadata) const {
+    metadata = ModuleMetadata();
+    metadata.name.assign(module.name);
+    metadata.description.assign(module.description);
+    metadata.author.assign(module.author);
+    metadata.license.assign(module.license);
+    metadata.repository.assign(module.repository);
+    metadata.latest.assign(module.latest);
+
+    for (const CompactVersion& row : versionsOf(module)) {
+        VersionMetadata& version = metadata.versions[std::string(row.version)];
+        version.description.assign(row.description);
+        version.entryLinux.assign(row.entryLinux);
+        version.entryWin.assign(row.entryWin);
+        version.entryMac.assign(row.entryMac);
+        version.sha256Linux.assign(row.sha256Linux);
+        version.sha256Win.assign(row.sha256Win);
+        version.sha256Mac.assign(row.sha256Mac);
+        version.git.url.assign(row.gitURL);
+        version.git.ref.assign(row.gitRef);
+        for (const CompactDep& dep : depsOf(row)) {
+            version.deps[std::string(dep.name)].assign(dep.constraint);
+        }
+    }
+}
+
+void MetadataTable::clear() {
+    modules.clear();
+    versions.clear();
+    deps.clear();
+    byName.clear();
+    byNameCount = 0;
+    strings.clear();
+}
+
+size_t MetadataTable::memoryUsage() const {
+    return strings.memoryUsage() + modules.capacity() * sizeof(CompactModule) +
+           versions.capacity() * sizeof(CompactVersion) + deps.capacity() * sizeof(CompactDep) +
+           byName.capacity() * sizeof(uint32_t);
+}
+
+
+namespace {
+
+/**
+ * Reads a manifest's top-level fields and hands each version's value over
+ * unparsed (the layout ManifestHandler in registry.cpp parses in full)
+ */
+class LazyManifestHandler : public json::Handler {
+public:
+    LazyManifestHandler(std::string& description, std::string& author, std::string& license,
+                        std::string& repository, std::string& latest, std::string_view content,
+                        std::vector<std::pair<std::string, std::pair<size_t, size_t>>>& slots)
+        : description(description), author(author), license(license), repository(repository),
+          latest(latest), content(content), slots(slots) {}
+
+    bool startObject() override { depth++; return true; }
+    bool endObject() override { depth--; return true; }
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) field = fieldOf(name);
+        else if (depth == 2 && field == Field::VERSIONS) versionKey.assign(name);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (depth != 1) return true;
+        switch (field) {
+            case Field::DESCRIPTION: description.assign(value); break;
+            case Field::AUTHOR: author.assign(value); break;
+            case Field::LICENSE: license.assign(value); break;
+            case Field::REPOSITORY: repository.assign(value); break;
+            case Field::LATEST: latest.assign(value); break;
+            default: break;
+        }
+        return true;
+    }
+
+    bool skipValue() override {
+        return depth == 2 && field == Field::VERSIONS;
+    }
+
+    bool raw(std::string_view text) override {
+        size_t offset = (size_t)(text.data() - content.data());
+        slots.emplace_back(versionKey, std::make_pair(offset, text.size()));
+        return true;
+    }
+
+private:
+    std::string& description;
+    std::string& author;
+    std::string& license;
+    std::string& repository;
+    std::string& latest;
+    std::string_view content;
+    std::vector<std::pair<std::string, std::pair<size_t, size_t>>>& slots;
+    int depth = 0;
+    Field field = Field::OTHER;
+    std::string versionKey;
+};
+
+/**
+ * Fills VersionMetadata from one version object, or records the file the
+ * version lives in when the value is a path or has a "path" field
+ */
+class VersionHandler : public json::Handler {
+public:
+    VersionHandler(VersionMetadata& metadata, std::string* file, std::string* hash)
+        : metadata(metadata), file(file), hash(hash) {}
+
+    bool startObject() override { depth++; return true; }
+    bool endObject() override { depth--; return true; }
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) {
+            field = fieldOf(name);
+            isPath = name == "path";
+            isHash = name == "hash";
+        } else if (depth == 2 && field == Field::DEPS) {
+            depName.assign(name);
+        } else if (depth == 2) {
+            subField = fieldOf(name);
+        }
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (depth == 0) {
+            // "1.2.0": "./base64/1.2.0.json"
+            if (file) file->assign(value);
+        } else if (depth == 1) {
+            switch (field) {
+                case Field::DESCRIPTION: metadata.description.assign(value); break;
+                case Field::ENTRY_LINUX: metadata.entryLinux.assign(value); break;
+                case Field::ENTRY_WIN: metadata.entryWin.assign(value); break;
+                case Field::ENTRY_MAC: metadata.entryMac.assign(value); break;
+                case Field::SHA256_LINUX: metadata.sha256Linux.assign(value); break;
+                case Field::SHA256_WIN: metadata.sha256Win.assign(value); break;
+                case Field::SHA256_MAC: metadata.sha256Mac.assign(value); break;
+                default:
+                    if (isPath && file) file->assign(value);
+                    else if (isHash && hash) hash->assign(value);
+                    break;
+            }
+        } else if (depth == 2) {
+            if (field == Field::GIT) {
+                if (subField == Field::URL) metadata.git.url.assign(value);
+                else if (subField == Field::REF) metadata.git.ref.assign(value);
+            } else if (field == Field::DEPS) {
+                metadata.deps[depName].assign(value);
+            }
+        }
+        return true;
+    }
+
+private:
+    VersionMetadata& metadata;
+    std::string* file;
+    std::string* hash;
+    int depth = 0;
+    Field field = Field::OTHER;
+    Field subField = Field::OTHER;
+    bool isPath = false;
+    bool isHash = false;
+    std::string depName;
+};
+
+} // namespace
+
+LazyManifest::LazyManifest() {
+}
+
+bool LazyManifest::load(std::string document) {
+    *this = LazyManifest();
+    content = std::move(document);
+
+    // Format: {"name":"base64","latest":"1.0.1","versions":{"1.0.0":{...},"1.0.1":"./1.0.1.json"}}
+    std::vector<std::pair<std::string, std::pair<size_t, size_t>>> slots;
+    LazyManifestHandler handler(description, author, license, repository, latest, content, slots);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Invalid module manifest: " << reader.getError() << std::endl;
+        return false;
+    }
+
+    // Sorted like std::map; a repeated key keeps its last occurrence
+    std::stable_sort(slots.begin(), slots.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    versions.reserve(slots.size());
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (i + 1 < slots.size() && slots[i + 1].first == slots[i].first) continue;
+        VersionSlot slot;
+        slot.version = std::move(slots[i].first);
+        slot.offset = slots[i].second.first;
+        slot.length = slots[i].second.second;
+        versions.push_back(std::move(slot));
+    }
+
+    // Older manifests only describe individual versions
+    if (description.empty() && !latest.empty()) {
+        VersionMetadata version;
+        if (getVersion(latest, version)) description = version.description;
+    }
+    return true;
+}
+
+const std::string& LazyManifest::getDescription() const {
+    return description;
+}
+
+const std::string& LazyManifest::getAuthor() const {
+    return author;
+}
+
+const std::string& LazyManifest::getLicense() const {
+    return license;
+}
+
+const std::string& LazyManifest::getRepository() const {
+    return repository;
+}
+
+const std::string& LazyManifest::getLatest() const {
+    return latest;
+}
+
+const LazyManifest::VersionSlot* LazyManifest::findSlot(const std::string& version) const {
+    auto it = std::lower_bound(versions.begin(), versions.end(), version,
+        [](const VersionSlot& slot, const std::string& key) { return slot.version < key; });
+    if (it == versions.end() || it->version != version) return nullptr;
+    return &*it;
+}
+
+bool LazyManifest::hasVersion(const std::string& version) const {
+    return findSlot(version) != nullptr;
+}
+
+std::vector<std::string> LazyManifest::listVersions() const {
+    std::vector<std::string> names;
+    names.reserve(versions.size());
+    for (const VersionSlot& slot : versions) names.push_back(slot.version);
+    return names;
+}
+
+const LazyManifest::ParsedVersion* LazyManifest::touch(const std::string& version) {
+    auto it = parsed.find(version);
+    if (it != parsed.end()) return &it->second;
+
+    const VersionSlot* slot = findSlot(version);
+    if (!slot) return nullptr;
+
+    ParsedVersion& entry = parsed[version];
+    VersionHandler handler(entry.metadata, &entry.file, &entry.hash);
+    json::Reader reader(std::string_view(content).substr(slot->offset, slot->length));
+    entry.valid = reader.parse(handler);
+    if (!entry.valid) {
+        std::cerr << "Invalid version " << version << " in module manifest: " << reader.getError() << std::endl;
+    }
+    return &entry;
+}
+
+bool LazyManifest::getVersion(const std::string& version, VersionMetadata& metadata) {
+    const ParsedVersion* entry = touch(version);
+    if (!entry || !entry->valid || !entry->file.empty()) return false;
+    metadata = entry->metadata;
+    return true;
+}
+
+bool LazyManifest::getVersionFile(const std::string& version, std::string& path, std::string& hash) {
+    const ParsedVersion* entry = touch(version);
+    if (!entry || !entry->valid || entry->file.empty()) return false;
+    path = entry->file;
+    hash = entry->hash;
+    return true;
+}
+
+bool LazyManifest::parseVersion(std::string_view content, VersionMetadata& metadata) {
+    VersionHandler handler(metadata, nullptr, nullptr);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Invalid version manifest: " << reader.getError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace box
@@ -0,0 +1,259 @@
+#include "mirrors.h"
+#include "cache.h"
+#include "json.h"
+#include "platform.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <ctime>
+#include <cstdlib>
+
+namespace box {
+
+static const char* DEFAULT_REGISTRY_URL = "https://raw.githubusercontent.com/neutron-modules/nur/refs/heads/main";
+
+// How long a probed choice is trusted before mirrors are probed again
+static const long long MIRROR_CHOICE_TTL = 3600;
+
+namespace {
+
+/**
+ * Reads the registry settings of ~/.box/config.json
+ */
+class ConfigHandler : public json::Handler {
+public:
+    std::string registry;
+    std::vector<std::string> mirrors;
+
+    bool startObject() override { depth++; return true; }
+    bool endObject() override { depth--; return true; }
+    bool startArray() override {
+        depth++;
+        inMirrors = depth == 2 && topKey == "mirrors";
+        return true;
+    }
+    bool endArray() override {
+        depth--;
+        inMirrors = false;
+        return true;
+    }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) topKey.assign(name);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (inMirrors) mirrors.emplace_back(value);
+        else if (depth == 1 && topKey == "registry") registry.assign(value);
+        return true;
+    }
+
+private:
+    int depth = 0;
+    bool inMirrors = false;
+    std::string topKey;
+};
+
+} // namespace
+
+Mirrors::Mirrors() {
+    std::vector<std::string> urls;
+
+    // BOX_REGISTRY_URL wins over the config file
+    const char* env = getenv("BOX_REGISTRY_URL");
+    if (env && *env) {
+        std::stringstream list(env);
+        std::string url;
+        while (std::getline(list, url, ',')) {
+            if (!url.empty()) urls.push_back(url);
+        }
+    }
+    if (urls.empty()) {
+        urls = loadConfig();
+    }
+    if (urls.empty()) {
+        urls.push_back(DEFAULT_REGISTRY_URL);
+    }
+
+    for (const auto& url : urls) {
+        Mirror mirror;
+        mirror.url = normalize(url);
+        if (!mirror.url.empty()) mirrors.push_back(mirror);
+    }
+    if (mirrors.empty()) {
+        mirrors.push_back(Mirror{DEFAULT_REGISTRY_URL});
+    }
+}
+
+Mirrors::Mirrors(const std::vector<std::string>& urls) {
+    for (const auto& url : urls) {
+        Mirror mirror;
+        mirror.url = normalize(url);
+        if (!mirror.url.empty()) mirrors.push_back(mirror);
+    }
+    if (mirrors.empty()) {
+        mirrors.push_back(Mirror{DEFAULT_REGISTRY_URL});
+    }
+}
+
+std::vector<std::string> Mirrors::loadConfig() {
+    std::ifstream file(Platform::getBoxHome() + "/config.json");
+    if (!file.is_open()) return {};
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string content = buffer.str();
+
+    ConfigHandler handler;
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Ignoring invalid ~/.box/config.json: " << reader.getError() << std::endl;
+        return {};
+    }
+
+    // An explicit mirror list replaces the single "registry" entry
+    if (!handler.mirrors.empty()) return handler.mirrors;
+    if (!handler.registry.empty()) return {handler.registry};
+    return {};
+}
+
+std::string Mirrors::normalize(const std::string& url) {
+    std::string result = url;
+    size_t start = result.find_first_not_of(" \t");
+    size_t end = result.find_last_not_of(" \t");
+    if (start == std::string::npos) return "";
+    result = result.substr(start, end - start + 1);
+
+    const std::string index = "/nur.json";
+    if (result.size() > index.size() &&
+        result.compare(result.size() - index.size(), index.size(), index) == 0) {
+        result.resize(result.size() - index.size());
+    }
+    while (!result.empty() && result.back() == '/') {
+        result.pop_back();
+    }
+    return result;
+}
+
+const std::string& Mirrors::getCanonicalURL() const {
+    return mirrors[0].url;
+}
+
+const std::vector<Mirror>& Mirrors::getMirrors() const {
+    return mirrors;
+}
+
+size_t Mirrors::getActive() const {
+    return active;
+}
+
+bool Mirrors::isMirrored(const std::string& url) const {
+    const std::string& base = mirrors[0].url;
+    return url.size() > base.size() && url.compare(0, base.size(), base) == 0 && url[base.size()] == '/';
+}
+
+std::string Mirrors::resolve(const std::string& url, size_t mirror) const {
+    if (mirror == 0 || mirror >= mirrors.size() || !isMirrored(url)) return url;
+    return mirrors[mirror].url + url.substr(mirrors[0].url.size());
+}
+
+std::vector<size_t> Mirrors::order() const {
+    std::vector<size_t> result{active};
+    for (size_t i = 0; i < mirrors.size(); i++) {
+        if (i != active) result.push_back(i);
+    }
+    return result;
+}
+
+void Mirrors::record(size_t mirror, bool ok) {
+    if (mirror >= mirrors.size()) return;
+    mirrors[mirror].requests++;
+    if (!ok) mirrors[mirror].failures++;
+}
+
+void Mirrors::failover(size_t mirror) {
+    if (mirror != active || mirrors.size() < 2) return;
+
+    // Next mirror in configured order, wrapping around
+    active = (active + 1) % mirrors.size();
+    std::cerr << "Registry mirror " << mirrors[mirror].url << " failed; switching to "
+              << mirrors[active].url << std::endl;
+    saveChoice();
+}
+
+void Mirrors::select(HttpClient& http, const std::string& path) {
+    if (selected) return;
+    statePath = path;
+    if (mirrors.size() < 2) {
+        selected = true;
+        return;
+    }
+
+    // A recent choice that is still configured saves a round of probes
+    std::ifstream state(statePath);
+    std::string url;
+    long long chosenAt = 0;
+    if (state >> url >> chosenAt && (long long)std::time(nullptr) - chosenAt < MIRROR_CHOICE_TTL) {
+        for (size_t i = 0; i < mirrors.size(); i++) {
+            if (mirrors[i].url == url) {
+                active = i;
+                selected = true;
+                return;
+            }
+        }
+    }
+
+    // Probe every mirror at once with a one-byte read of nur.json
+    std::vector<HttpRequest> requests;
+    for (const auto& mirror : mirrors) {
+        requests.push_back(HttpRequest(mirror.url + "/nur.json", {"Range: bytes=0-0"}));
+    }
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = http.getAll(requests, responses, requests.size());
+
+    bool found = false;
+    bool reachable = false;
+    for (size_t i = 0; i < mirrors.size(); i++) {
+        if (!responses[i].connectFailed) reachable = true;
+        bool healthy = completed[i] && (responses[i].status == 200 || responses[i].status == 206);
+        if (!healthy) {
+            mirrors[i].failures++;
+            continue;
+        }
+        mirrors[i].latency = responses[i].firstByteTime;
+        if (!found || mirrors[i].latency < mirrors[active].latency) {
+            active = i;
+            found = true;
+        }
+    }
+
+    // Mirrors are tried in order either way; the requests' own retries decide
+    // whether the registry is unreachable. A probe that connected nowhere (a
+    // network blip) is repeated before the next batch of requests.
+    if (found) {
+        saveChoice();
+    } else {
+        std::cerr << "No registry mirror answered the probe; trying them in order" << std::endl;
+    }
+    selected = reachable;
+}
+
+void Mirrors::saveChoice() const {
+    if (statePath.empty()) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(statePath).parent_path(), ec);
+
+    // Every box process may save its choice; each writes its own temp file
+    std::string tmpPath = Cache::tempPathFor(statePath);
+    std::ofstream out(tmpPath);
+    if (!out) return;
+    out << mirrors[active].url << "\n" << (long long)std::time(nullptr) << "\n";
+    out.close();
+    if (out) std::filesystem::rename(tmpPath, statePath, ec);
+    if (!out || ec) std::filesystem::remove(tmpPath, ec);
+}
+
+} // namespace box
@@ -1,4 +1,5 @@
 #include "platform.h"
+#include <cstdlib>
 
 // Platform detection macros (only define if not already defined)
 #ifdef _WIN32
@@ -15,6 +16,26 @@
     #endif
 #endif
 
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <pwd.h>
+    #include <climits>
+#endif
+
+#ifdef PLATFORM_MACOS
+    #include <mach-o/dyld.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+    #include <immintrin.h>
+#endif
+
 namespace box {
 
 Platform::OS Platform::detectOS() {
@@ -80,4 +101,122 @@ bool Platform::isMacOS() {
     return detectOS() == OS::MACOS;
 }
 
+static bool cpuHasAVX2() {
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER) && defined(_M_X64)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool Platform::hasAVX2() {
+    static const bool supported = cpuHasAVX2();
+    return supported;
+}
+
+std::string Platform::getHomeDir() {
+    std::string homeDir;
+#ifdef _WIN32
+    char* userProfile = getenv("USERPROFILE");
+    if (userProfile) homeDir = userProfile;
+#else
+    char* home = getenv("HOME");
+    if (home) {
+        homeDir = home;
+    } else {
+        struct passwd* pw = getpwuid(getuid());
+        if (pw) homeDir = pw->pw_dir;
+    }
+#endif
+    return homeDir;
+}
+
+std::string Platform::getBoxHome() {
+    return getHomeDir() + "/.box";
+}
+
+std::string Platform::getExecutablePath() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) return "";
+    return std::string(path, length);
+#elif defined(PLATFORM_MACOS)
+    char path[PATH_MAX];
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) != 0) return "";
+    return path;
+#else
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) return "";
+    return std::string(path, (size_t)length);
+#endif
+}
+
+bool Platform::spawnDetached(const std::vector<std::string>& args) {
+    if (args.empty()) return false;
+#ifdef _WIN32
+    std::string commandLine;
+    for (const auto& arg : args) {
+        if (!commandLine.empty()) commandLine += ' ';
+        commandLine += '"' + arg + '"';
+    }
+
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process = {};
+    if (!CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE,
+                        DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP | CREATE_NO_WINDOW,
+                        NULL, NULL, &startup, &process)) {
+        return false;
+    }
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+    return true;
+#else
+    // Everything the child needs is prepared before fork()
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        // Fork again so the program is reparented to init and never becomes
+        // a zombie of this process; setsid() detaches it from the terminal
+        setsid();
+        pid_t grandchild = fork();
+        if (grandchild != 0) _exit(grandchild < 0 ? 1 : 0);
+
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull >= 0) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+            if (devNull > STDERR_FILENO) close(devNull);
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
 } // namespace box
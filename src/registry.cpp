@@ -1,314 +1,2220 @@
 #include "registry.h"
 #include "platform.h"
+#include "json.h"
+#include "structural.h"
+#include "sha256.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <vector>
+#include <set>
+#include <ctime>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <functional>
 
-// For HTTP requests - will need to link with curl or similar
-#ifdef _WIN32
-    #include <windows.h>
-    #include <wininet.h>
-    #pragma comment(lib, "wininet.lib")
-#else
-    #include <curl/curl.h>
-#endif
+namespace box {
+
+// Index paths starting with "." are relative to the registry root
+static std::string resolveIndexPath(const std::string& registryURL, std::string_view path) {
+    if (!path.empty() && path[0] == '.') {
+        std::string url = registryURL;
+        url.append(path.substr(1));
+        return url;
+    }
+    // Bare relative paths ("modules/x.json") resolve against the registry too,
+    // so an index can be served unchanged from any mirror
+    if (path.find("://") == std::string_view::npos) {
+        std::string url = registryURL;
+        if (!path.empty() && path[0] != '/') url += '/';
+        url.append(path);
+        return url;
+    }
+    return std::string(path);
+}
+
+static std::string normalizeHash(std::string_view hash) {
+    std::string lower(hash);
+    for (char& c : lower) c = (char)std::tolower((unsigned char)c);
+    return lower;
+}
+
+static uint32_t parseSerial(std::string_view raw) {
+    uint64_t value = 0;
+    for (char c : raw) {
+        if (c < '0' || c > '9') return 0;  // negative or fractional: treat as absent
+        value = value * 10 + (uint64_t)(c - '0');
+        if (value > 0xFFFFFFFFull) return 0;
+    }
+    return (uint32_t)value;
+}
+
+static void appendJSONString(std::string& out, const std::string& value) {
+    out += '"';
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+namespace {
+
+/**
+ * Collects the "modules" map of nur.json
+ */
+class IndexHandler : public json::Handler {
+public:
+    IndexHandler(std::map<std::string, IndexRecord>& index, const std::string& registryURL)
+        : index(index), registryURL(registryURL) {}
+
+    bool sawModules() const { return foundModules; }
+    uint32_t getSerial() const { return serial; }
+    const IndexRecord& getBundle() const { return bundle; }
+
+    bool startObject() override {
+        depth++;
+        if (depth == 2 && topKey == "modules") {
+            inModules = true;
+            foundModules = true;
+        } else if (depth == 2 && topKey == "bundle") {
+            // {"path": "./nur.bundle", "hash": "..."}
+            inBundle = true;
+        } else if (depth == 3 && inModules) {
+            // {"path": "...", "hash": "..."} entry
+            record = &index[moduleName];
+        }
+        return true;
+    }
+
+    bool endObject() override {
+        if (depth == 2) inModules = inBundle = false;
+        if (depth == 3) record = nullptr;
+        depth--;
+        return true;
+    }
+
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) topKey.assign(name);
+        else if (inModules && depth == 2) moduleName.assign(name);
+        else if (record && depth == 3) field.assign(name);
+        else if (inBundle && depth == 2) field.assign(name);
+        return true;
+    }
+
+    bool number(std::string_view raw) override {
+        if (depth == 1 && topKey == "serial") serial = parseSerial(raw);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (inModules && depth == 2) {
+            // Plain "name": "path" entry
+            IndexRecord& entry = index[moduleName];
+            entry.url = resolveIndexPath(registryURL, value);
+            entry.hash.clear();
+        } else if (record && depth == 3) {
+            if (field == "path") record->url = resolveIndexPath(registryURL, value);
+            else if (field == "hash") record->hash = normalizeHash(value);
+        } else if (inBundle && depth == 2) {
+            if (field == "path") bundle.url = resolveIndexPath(registryURL, value);
+            else if (field == "hash") bundle.hash = normalizeHash(value);
+        }
+        return true;
+    }
+
+private:
+    std::map<std::string, IndexRecord>& index;
+    const std::string& registryURL;
+    IndexRecord* record = nullptr;
+    int depth = 0;
+    bool inModules = false;
+    bool inBundle = false;
+    bool foundModules = false;
+    uint32_t serial = 0;
+    IndexRecord bundle;
+    std::string topKey;
+    std::string moduleName;
+    std::string field;
+};
+
+/**
+ * Reads a sparse index shard: {"path": "./modules/x.json", "hash": "..."}
+ */
+class ShardHandler : public json::Handler {
+public:
+    ShardHandler(IndexRecord& record, const std::string& registryURL)
+        : record(record), registryURL(registryURL) {}
+
+    bool startObject() override { depth++; return true; }
+    bool endObject() override { depth--; return true; }
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) field.assign(name);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (depth != 1) return true;
+        if (field == "path") record.url = resolveIndexPath(registryURL, value);
+        else if (field == "hash") record.hash = normalizeHash(value);
+        return true;
+    }
+
+private:
+    IndexRecord& record;
+    const std::string& registryURL;
+    int depth = 0;
+    std::string field;
+};
+
+/**
+ * Reads nur.changes.json
+ *
+ * Layout: {"serial": 42, "since": 30, "changes": [{"serial": 31, "name": "x",
+ * "path": "./modules/x.json", "hash": "..."}, {"serial": 35, "name": "y",
+ * "removed": true}]}
+ */
+class ChangesHandler : public json::Handler {
+public:
+    ChangesHandler(IndexChanges& changes, const std::string& registryURL)
+        : changes(changes), registryURL(registryURL) {}
+
+    bool startObject() override {
+        depth++;
+        if (depth == 3 && inChanges) {
+            changes.entries.emplace_back();
+            change = &changes.entries.back();
+        }
+        return true;
+    }
+
+    bool endObject() override {
+        if (depth == 3) change = nullptr;
+        depth--;
+        return true;
+    }
+
+    bool startArray() override {
+        depth++;
+        if (depth == 2 && topKey == "changes") inChanges = true;
+        return true;
+    }
+
+    bool endArray() override {
+        if (depth == 2) inChanges = false;
+        depth--;
+        return true;
+    }
+
+    bool key(std::string_view name) override {
+        if (depth == 1) topKey.assign(name);
+        else if (change && depth == 3) field.assign(name);
+        return true;
+    }
+
+    bool number(std::string_view raw) override {
+        if (depth == 1 && topKey == "serial") changes.serial = parseSerial(raw);
+        else if (depth == 1 && topKey == "since") changes.since = parseSerial(raw);
+        else if (change && depth == 3 && field == "serial") change->serial = parseSerial(raw);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (!change || depth != 3) return true;
+        if (field == "name") change->name.assign(value);
+        else if (field == "path") change->record.url = resolveIndexPath(registryURL, value);
+        else if (field == "hash") change->record.hash = normalizeHash(value);
+        return true;
+    }
+
+    bool boolean(bool value) override {
+        if (change && depth == 3 && field == "removed") change->removed = value;
+        return true;
+    }
+
+private:
+    IndexChanges& changes;
+    const std::string& registryURL;
+    IndexChange* change = nullptr;
+    int depth = 0;
+    bool inChanges = false;
+    std::string topKey;
+    std::string field;
+};
+
+/**
+ * Fills ModuleMetadata straight from manifest parse events
+ *
+ * Layout: top-level fields at depth 1, version objects at depth 3 under
+ * "versions", and "git"/"deps" objects at depth 4.
+ */
+class ManifestHandler : public json::Handler {
+public:
+    explicit ManifestHandler(ModuleMetadata& metadata) : metadata(metadata) {}
+
+    bool startObject() override {
+        depth++;
+        if (depth == 3 && keys[1] == "versions") {
+            version = &metadata.versions[keys[2]];
+        }
+        return true;
+    }
+
+    bool endObject() override {
+        if (depth == 3) version = nullptr;
+        depth--;
+        return true;
+    }
+
+    bool startArray() override { depth++; return true; }
+    bool endArray() override { depth--; return true; }
+
+    bool key(std::string_view name) override {
+        if (depth < MAX_KEYS) keys[depth].assign(name);
+        return true;
+    }
+
+    bool string(std::string_view value) override {
+        if (depth == 2 && keys[1] == "versions") {
+            // Kept in a file of its own; listed with empty fields
+            metadata.versions[keys[2]];
+        } else if (depth == 1) {
+            const std::string& field = keys[1];
+            if (field == "description") metadata.description.assign(value);
+            else if (field == "author") metadata.author.assign(value);
+            else if (field == "license") metadata.license.assign(value);
+            else if (field == "repository") metadata.repository.assign(value);
+            else if (field == "latest") metadata.latest.assign(value);
+        } else if (version && depth == 3) {
+            const std::string& field = keys[3];
+            if (field == "description") version->description.assign(value);
+            else if (field == "entry-linux") version->entryLinux.assign(value);
+            else if (field == "entry-win") version->entryWin.assign(value);
+            else if (field == "entry-mac") version->entryMac.assign(value);
+            else if (field == "sha256-linux") version->sha256Linux.assign(value);
+            else if (field == "sha256-win") version->sha256Win.assign(value);
+            else if (field == "sha256-mac") version->sha256Mac.assign(value);
+        } else if (version && depth == 4) {
+            if (keys[3] == "git") {
+                if (keys[4] == "url") version->git.url.assign(value);
+                else if (keys[4] == "ref") version->git.ref.assign(value);
+            } else if (keys[3] == "deps") {
+                version->deps[keys[4]].assign(value);
+            }
+        }
+        return true;
+    }
+
+private:
+    static const int MAX_KEYS = 5;
+
+    ModuleMetadata& metadata;
+    VersionMetadata* version = nullptr;
+    int depth = 0;
+    std::string keys[MAX_KEYS];  // current key at each depth, reused across entries
+};
+
+/**
+ * Receives a lone JSON string (an escaped key being decoded)
+ */
+class StringHandler : public json::Handler {
+public:
+    bool string(std::string_view text) override {
+        value.assign(text);
+        return true;
+    }
+
+    std::string value;
+};
+
+/**
+ * Reads the module names of nur.json chunk by chunk, as it arrives
+ *
+ * Only the unread tail of the document is kept. Module entries and other
+ * top-level values are crossed with StructuralIndex's scans rather than
+ * parsed, so they are checked only when the index is next parsed whole.
+ */
+class IndexNameScanner {
+public:
+    explicit IndexNameScanner(std::function<void(std::string_view)> onName) : onName(std::move(onName)) {}
+
+    bool feed(const char* data, size_t size) {
+        if (failed) return false;
+        pending.append(data, size);
+        return scan(false);
+    }
+
+    // The document ended: true if it was complete and had a "modules" object
+    bool finish() {
+        if (failed || !scan(true)) return false;
+        if (state != State::DONE) return fail("unexpected end of input");
+        if (!foundModules) return fail("'modules' not found");
+        return true;
+    }
+
+    void reset() {
+        pending.clear();
+        state = State::START;
+        foundModules = false;
+        failed = false;
+        count = 0;
+        error.clear();
+    }
+
+    size_t getCount() const { return count; }
+    const std::string& getError() const { return error; }
+
+private:
+    enum class State { START, TOP_FIRST, TOP_KEY, TOP_NEXT, MODULES_FIRST, MODULE_KEY, MODULE_NEXT, DONE };
+
+    static const size_t INCOMPLETE = json::StructuralIndex::npos;
+
+    std::function<void(std::string_view)> onName;
+    std::string pending;  // input not consumed yet
+    State state = State::START;
+    bool foundModules = false;
+    bool failed = false;
+    size_t count = 0;
+    std::string error;
+    std::string decodedKey;
+
+    bool fail(const char* message) {
+        failed = true;
+        error = message;
+        return false;
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static size_t skipSpace(std::string_view text, size_t pos) {
+        while (pos < text.size() && isSpace(text[pos])) pos++;
+        return pos;
+    }
+
+    // Offset just past the string opening at pos
+    size_t stringEnd(std::string_view text, size_t pos) {
+        size_t i = pos + 1;
+        while (true) {
+            i = json::StructuralIndex::findStringEnd(text, i);
+            if (i >= text.size()) return INCOMPLETE;
+            if (text[i] == '"') return i + 1;
+            if (text[i] != '\\') {
+                fail("control character in string");
+                return INCOMPLETE;
+            }
+            i += 2;
+        }
+    }
+
+    // Offset just past the value starting at pos
+    size_t valueEnd(std::string_view text, size_t pos, bool final) {
+        char c = text[pos];
+        if (c == '"') return stringEnd(text, pos);
+        if (c == '{' || c == '[') return json::StructuralIndex::skipValue(text, pos);
+        if (c != '-' && (c < '0' || c > '9') && c != 't' && c != 'f' && c != 'n') {
+            fail("unexpected character");
+            return INCOMPLETE;
+        }
+        size_t end = pos;
+        while (end < text.size() && text[end] != ',' && text[end] != '}' && text[end] != ']' &&
+               !isSpace(text[end])) {
+            end++;
+        }
+        return end < text.size() || final ? end : INCOMPLETE;
+    }
+
+    bool scan(bool final) {
+        std::string_view text(pending);
+        size_t pos = 0;
+        while ((pos = skipSpace(text, pos)) < text.size()) {
+            char c = text[pos];
+            if (state == State::START) {
+                if (c != '{') return fail("expected an object");
+                state = State::TOP_FIRST;
+                pos++;
+                continue;
+            }
+            if (state == State::DONE) return fail("unexpected data after the index");
+            if (state == State::TOP_NEXT || state == State::MODULE_NEXT) {
+                bool top = state == State::TOP_NEXT;
+                if (c == ',') state = top ? State::TOP_KEY : State::MODULE_KEY;
+                else if (c == '}') state = top ? State::DONE : State::TOP_NEXT;
+                else return fail("expected ',' or '}'");
+                pos++;
+                continue;
+            }
+            if (c == '}' && (state == State::TOP_FIRST || state == State::MODULES_FIRST)) {
+                state = state == State::TOP_FIRST ? State::DONE : State::TOP_NEXT;
+                pos++;
+                continue;
+            }
+
+            // A member, "key": value, is consumed only once all of it is here
+            if (c != '"') return fail("expected a key");
+            bool top = state == State::TOP_FIRST || state == State::TOP_KEY;
+            size_t keyEnd = stringEnd(text, pos);
+            if (keyEnd == INCOMPLETE) break;
+            size_t colon = skipSpace(text, keyEnd);
+            if (colon == text.size()) break;
+            if (text[colon] != ':') return fail("expected ':'");
+            size_t value = skipSpace(text, colon + 1);
+            if (value == text.size()) break;
+
+            std::string_view key = text.substr(pos + 1, keyEnd - pos - 2);
+            if (key.find('\\') != std::string_view::npos) {
+                StringHandler handler;
+                json::Reader reader(text.substr(pos, keyEnd - pos));
+                if (!reader.parse(handler)) return fail("invalid key");
+                decodedKey = std::move(handler.value);
+                key = decodedKey;
+            }
+            if (top && key == "modules" && text[value] == '{') {
+                foundModules = true;
+                state = State::MODULES_FIRST;
+                pos = value + 1;
+                continue;
+            }
+
+            size_t end = valueEnd(text, value, final);
+            if (end == INCOMPLETE) break;
+            // Entries are "name": "path" or "name": {"path": ...}, as IndexHandler reads them
+            if (!top && (text[value] == '"' || text[value] == '{')) {
+                count++;
+                onName(key);
+            }
+            state = top ? State::TOP_NEXT : State::MODULE_NEXT;
+            pos = end;
+        }
+        if (failed) return false;
+        pending.erase(0, pos);
+        return true;
+    }
+};
+
+} // namespace
+
+// Manifests refreshed in parallel after an index update
+static const size_t DEFAULT_MANIFEST_CONCURRENCY = 8;
+
+// How long the answer to "does the registry publish a sparse index" is trusted
+static const long long SPARSE_CONFIG_TTL = 3600;
+
+// How long a 404 is remembered, so repeated lookups of a missing manifest,
+// shard or changes log don't go back to the registry
+static const long long MISSING_TTL = 300;
+
+// Stale answers older than this are refreshed in the background
+static const long long REFRESH_AFTER = 60;
+
+// A background refresh holding its lock longer than this is assumed dead
+static const long long REFRESH_LOCK_TTL = 600;
+
+// Attempts per downloadToFile(); each one resumes where the last stopped
+static const int MAX_DOWNLOAD_ATTEMPTS = 3;
+
+// Attempts per registry request (at least one per mirror), with jittered
+// exponential backoff between them
+static const int MAX_FETCH_ATTEMPTS = 3;
+static const long RETRY_BASE_DELAY_MS = 200;
+static const long RETRY_MAX_DELAY_MS = 5000;
+
+// Copy a local file in fixed-size chunks, hashing it on the way
+static bool copyWithDigest(const std::string& from, const std::string& to, DownloadResult& result) {
+    std::ifstream in(from, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot read " << from << std::endl;
+        return false;
+    }
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot write " << to << std::endl;
+        return false;
+    }
+
+    Sha256 hasher;
+    char buffer[65536];
+    result.size = 0;
+    while (in) {
+        in.read(buffer, sizeof(buffer));
+        std::streamsize count = in.gcount();
+        if (count <= 0) break;
+        out.write(buffer, count);
+        hasher.update(buffer, (size_t)count);
+        result.size += (size_t)count;
+    }
+    out.close();
+    if (in.bad() || !out) {
+        std::cerr << "Failed to copy " << from << " to " << to << std::endl;
+        return false;
+    }
+    result.sha256 = hasher.finish();
+    return true;
+}
+
+// Move a finished download into place; falls back to a copy across filesystems
+static bool moveIntoPlace(const std::string& from, const std::string& to) {
+    std::error_code ec;
+    std::filesystem::rename(from, to, ec);
+    if (!ec) return true;
+
+    std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec);
+    std::filesystem::remove(from);
+    if (ec) {
+        std::cerr << "Failed to move " << from << " to " << to << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Registry::Registry() {
+    // Online registry by default; BOX_REGISTRY_URL or ~/.box/config.json may list mirrors
+    registryURL = mirrors.getCanonicalURL();
+
+    const char* offlineEnv = getenv("BOX_OFFLINE");
+    offline = offlineEnv && *offlineEnv && std::string(offlineEnv) != "0";
+}
+
+Registry::~Registry() {
+    // The background fetch still uses this object; an early exit doesn't wait for all of it
+    cancelIndexFetch();
+    startRefresh();
+
+    // Prefetched files nobody asked for
+    for (const auto& [url, prefetchedFile] : prefetchedFiles) {
+        if (prefetchedFile.taken) continue;
+        std::error_code ec;
+        std::filesystem::remove(prefetchedFile.file.path, ec);
+    }
+}
+
+std::string Registry::download(const std::string& url) {
+    std::string response;
+
+    auto memo = prefetched.find(url);
+    if (memo != prefetched.end()) {
+        return memo->second;
+    }
+
+    // Check if it's a local file URL
+    if (url.substr(0, 7) == "file://") {
+        std::string localPath = url.substr(7); // Remove "file://" prefix
+        std::ifstream file(localPath);
+        if (file.is_open()) {
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            response = buffer.str();
+            file.close();
+        }
+        return response;
+    }
+
+    if (offline) {
+        return loadOffline(url);
+    }
+
+    HttpResponse httpResponse;
+    if (!fetch(url, {}, httpResponse)) {
+        return offline ? loadOffline(url) : response;
+    }
+    if (httpResponse.status >= 400) {
+        std::cerr << "HTTP " << httpResponse.status << " for " << url << std::endl;
+        return response;
+    }
+
+    return std::move(httpResponse.body);
+}
+
+bool Registry::downloadToFile(const std::string& url, const std::string& outputPath, DownloadResult& result) {
+    // Prefetched: the first caller takes the file, later ones copy it from there
+    auto memo = prefetchedFiles.find(url);
+    if (memo != prefetchedFiles.end()) {
+        DownloadResult& file = memo->second.file;
+        if (!memo->second.taken) {
+            if (!moveIntoPlace(file.path, outputPath)) return false;
+            memo->second.taken = true;
+            file.path = outputPath;
+            result = file;
+            return true;
+        }
+        std::string tempPath = outputPath + ".part";
+        DownloadResult copied;
+        if (copyWithDigest(file.path, tempPath, copied) && copied.sha256 == file.sha256 &&
+            moveIntoPlace(tempPath, outputPath)) {
+            result = file;
+            result.path = outputPath;
+            return true;
+        }
+        // The first copy was moved or changed since: download it again
+        std::filesystem::remove(tempPath);
+        prefetchedFiles.erase(memo);
+    }
+
+    if (url.substr(0, 7) == "file://") {
+        // Copy next to the destination so the final rename stays on one filesystem
+        std::string tempPath = outputPath + ".part";
+        if (!copyWithDigest(url.substr(7), tempPath, result) || !moveIntoPlace(tempPath, outputPath)) {
+            std::filesystem::remove(tempPath);
+            return false;
+        }
+        result.path = outputPath;
+        return true;
+    }
+
+    if (offline) {
+        std::cerr << "Not cached (offline): " << url << std::endl;
+        return false;
+    }
+
+    for (int attempt = 0; attempt < MAX_DOWNLOAD_ATTEMPTS; attempt++) {
+        HttpRequest request = resumableRequest(url);
+        std::vector<HttpResponse> responses;
+        bool completed = fetchAll({request}, responses, 1)[0];
+        const HttpResponse& httpResponse = responses[0];
+        if (offline) {
+            // The network went away: keep any partial download for later
+            std::cerr << "Not cached (offline): " << url << std::endl;
+            return false;
+        }
+
+        if (finishResumable(request, completed, httpResponse)) {
+            if (!moveIntoPlace(request.outputPath, outputPath)) return false;
+            result.path = outputPath;
+            result.size = httpResponse.size;
+            result.sha256 = httpResponse.sha256;
+            return true;
+        }
+
+        // Go again only while attempts make progress, or after a stale range was dropped
+        // (a restarted transfer can end up shorter than the range it replaced)
+        bool progressed = !completed && httpResponse.size > 0 && httpResponse.size != request.resumeFrom;
+        bool staleRange = completed && httpResponse.status == 416 && request.resumeFrom > 0;
+        if (!progressed && !staleRange) break;
+    }
+    return false;
+}
+
+HttpRequest Registry::resumableRequest(const std::string& url) {
+    HttpRequest request(url, {}, cache.partialPathFor(url));
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(request.outputPath).parent_path(), ec);
+
+    CacheEntry partial;
+    size_t have = 0;
+    if (cache.loadPartial(url, partial, have)) {
+        // If-Range only accepts a strong ETag; fall back to the date otherwise
+        std::string validator = partial.lastModified;
+        if (!partial.etag.empty() && partial.etag.compare(0, 2, "W/") != 0) {
+            validator = partial.etag;
+        }
+        if (!validator.empty()) {
+            std::cout << "Resuming " << url << " at " << have << " bytes" << std::endl;
+            request.headers.push_back("Range: bytes=" + std::to_string(have) + "-");
+            request.headers.push_back("If-Range: " + validator);
+            request.resumeFrom = have;
+        }
+    }
+    return request;
+}
+
+bool Registry::finishResumable(const HttpRequest& request, bool completed, const HttpResponse& httpResponse) {
+    const std::string& url = request.url;
+
+    if (completed && httpResponse.status < 400) {
+        cache.dropPartial(url, false);
+        return true;
+    }
+
+    if (completed) {
+        // 416 means the kept bytes no longer line up with the file
+        if (httpResponse.status != 416) {
+            std::cerr << "HTTP " << httpResponse.status << " for " << url << std::endl;
+        }
+        cache.dropPartial(url, true);
+        return false;
+    }
+
+    if (httpResponse.size == 0) {
+        cache.dropPartial(url, true);
+        return false;
+    }
+
+    // The kept bytes are decoded, so they don't line up with ranges of an encoded body
+    if (!httpResponse.contentEncoding.empty() && httpResponse.contentEncoding != "identity") {
+        std::cerr << "Download of " << url << " interrupted after " << httpResponse.size
+                  << " bytes (" << httpResponse.contentEncoding << " encoded, starting over)" << std::endl;
+        cache.dropPartial(url, true);
+        return false;
+    }
+
+    // Interrupted: keep what arrived. If no headers came back this time the
+    // existing validators still describe the data.
+    if (!httpResponse.etag.empty() || !httpResponse.lastModified.empty()) {
+        CacheEntry partial;
+        partial.url = url;
+        partial.etag = httpResponse.etag;
+        partial.lastModified = httpResponse.lastModified;
+        partial.fetchedAt = (long long)std::time(nullptr);
+        cache.storePartial(partial);
+    }
+    std::cerr << "Download of " << url << " interrupted after " << httpResponse.size << " bytes" << std::endl;
+    return false;
+}
+
+const HttpStats& Registry::getHttpStats() const {
+    return http.getStats();
+}
+
+const Mirrors& Registry::getMirrors() const {
+    return mirrors;
+}
+
+// Transport errors, stalls, throttling and server errors are worth another try
+static bool transientFailure(bool completed, const HttpResponse& response) {
+    return !completed || response.status == 429 || response.status >= 500;
+}
+
+// A streamed request may only be retried while its output file still holds
+// exactly what the request started from
+static bool canRetry(const HttpRequest& request, bool completed, const HttpResponse& response) {
+    if (request.outputPath.empty()) return true;
+    return completed ? request.resumeFrom == 0 : response.size == request.resumeFrom;
+}
+
+// Full-jitter exponential backoff before retry number `attempt` (1-based)
+static void backoff(int attempt) {
+    static std::mt19937 rng(std::random_device{}());
+    long ceiling = std::min(RETRY_BASE_DELAY_MS << (attempt - 1), RETRY_MAX_DELAY_MS);
+    std::uniform_int_distribution<long> delay(ceiling / 2, ceiling);
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay(rng)));
+}
+
+std::vector<bool> Registry::fetchAll(const std::vector<HttpRequest>& requests,
+                                     std::vector<HttpResponse>& responses,
+                                     size_t maxConcurrent) {
+    std::vector<bool> completed(requests.size(), false);
+    responses.assign(requests.size(), HttpResponse());
+    if (offline || http.isCancelled()) return completed;
+
+    std::vector<size_t> pending;
+    bool anyMirrored = false;
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending.push_back(i);
+        if (mirrors.isMirrored(requests[i].url)) anyMirrored = true;
+    }
+    if (anyMirrored) mirrors.select(http, cache.getCacheDir() + "/mirror");
+
+    size_t mirrorCount = mirrors.getMirrors().size();
+    int attempts = std::max(MAX_FETCH_ATTEMPTS, (int)mirrorCount);
+    std::vector<bool> tried(mirrorCount, false);
+    bool mirrorReached = false;  // some attempt connected to a mirror
+    bool mirrorFailed = false;
+    for (int attempt = 0; attempt < attempts && !pending.empty() && !http.isCancelled(); attempt++) {
+        if (attempt > 0) backoff(attempt);
+
+        // The active mirror (which moves on failover), else the next untried one
+        std::vector<size_t> order = mirrors.order();
+        size_t mirror = order[0];
+        auto untried = std::find_if(order.begin(), order.end(), [&](size_t i) { return !tried[i]; });
+        if (tried[mirror] && untried != order.end()) mirror = *untried;
+        tried[mirror] = true;
+
+        // Slow first bytes are hedged on another mirror, or on a second connection
+        size_t alternate = mirror;
+        if (mirrorCount > 1) {
+            alternate = mirror == order[0] ? order[1] : order[0];
+        }
+
+        std::vector<HttpRequest> batch;
+        batch.reserve(pending.size());
+        for (size_t i : pending) {
+            batch.push_back(requests[i]);
+            batch.back().url = mirrors.resolve(requests[i].url, mirror);
+            if (requests[i].outputPath.empty()) {
+                batch.back().hedgeURL = mirrors.resolve(requests[i].url, alternate);
+            }
+        }
+
+        std::vector<HttpResponse> batchResponses;
+        std::vector<bool> batchCompleted = http.getAll(batch, batchResponses, maxConcurrent);
+
+        std::vector<size_t> retry;
+        mirrorFailed = false;
+        for (size_t k = 0; k < pending.size(); k++) {
+            size_t i = pending[k];
+            completed[i] = batchCompleted[k];
+            responses[i] = std::move(batchResponses[k]);
+
+            bool failed = transientFailure(completed[i], responses[i]);
+            if (mirrors.isMirrored(requests[i].url)) {
+                mirrors.record(responses[i].fromHedge ? alternate : mirror, !failed);
+                if (failed) mirrorFailed = true;
+                if (!responses[i].connectFailed) mirrorReached = true;
+            }
+            if (failed && canRetry(requests[i], completed[i], responses[i])) {
+                retry.push_back(i);
+            }
+        }
+        if (mirrorFailed) {
+            mirrors.failover(mirror);
+        }
+        pending = std::move(retry);
+    }
+
+    // Every attempt, with backoff, failed to even connect: serve the rest from the cache.
+    // One refused connection (a DNS blip, a restarting server) only costs a retry.
+    if (anyMirrored && mirrorFailed && !mirrorReached && !http.isCancelled()) {
+        goOffline();
+    }
+    return completed;
+}
+
+void Registry::setOffline(bool enabled) {
+    offline = enabled;
+}
+
+bool Registry::isOffline() const {
+    return offline;
+}
+
+void Registry::goOffline() {
+    if (offline) return;
+    offline = true;
+    std::cerr << "Registry unreachable; continuing offline from the local cache" << std::endl;
+}
+
+std::string Registry::loadOffline(const std::string& url) {
+    CacheEntry entry;
+    if (cache.load(url, entry)) {
+        return std::move(entry.body);
+    }
+    std::cerr << "Not cached (offline): " << url << std::endl;
+    return "";
+}
+
+void Registry::setMaxStale(long long maxAge) {
+    maxStale = maxAge;
+}
+
+bool Registry::loadStaleIndex(const std::string& indexURL) {
+    if (maxStale <= 0 || offline || indexURL.substr(0, 7) == "file://") return false;
+
+    CacheEntry entry;
+    if (!cache.loadMeta(indexURL, entry)) return false;
+    long long age = (long long)std::time(nullptr) - entry.fetchedAt;
+    if (age < 0 || age >= maxStale) return false;
+
+    std::cout << "Using the cached NUR index (checked " << age << "s ago)" << std::endl;
+    uint32_t serial = 0;
+    if (compiledMatches(indexURL, entry)) {
+        useCompiled = true;
+        indexSerial = compiled.getSourceSerial();
+        searchIndex.reset();
+        std::cout << "Loaded " << compiled.size() << " modules from compiled index" << std::endl;
+    } else if (loadNameFilter(indexURL, serial)) {
+        deferIndex(serial);
+    } else {
+        CacheEntry cached;
+        if (!cache.load(indexURL, cached) || !parseIndex(cached.body)) return false;
+        saveNameFilter(indexURL);
+    }
+
+    if (age >= REFRESH_AFTER) refreshPending = true;
+    return true;
+}
+
+bool Registry::loadStale(const std::string& url, const std::string& moduleName, std::string& content) {
+    if (maxStale <= 0 || offline || url.substr(0, 7) == "file://") return false;
+
+    // Recorded 404s expire on their own schedule (see knownMissing())
+    CacheEntry entry;
+    if (!cache.load(url, entry) || entry.body.empty()) return false;
+    long long age = (long long)std::time(nullptr) - entry.fetchedAt;
+    if (age < 0 || age >= maxStale) return false;
+
+    if (age >= REFRESH_AFTER) {
+        refreshPending = true;
+        if (std::find(staleModules.begin(), staleModules.end(), moduleName) == staleModules.end()) {
+            staleModules.push_back(moduleName);
+        }
+    }
+    content = std::move(entry.body);
+    return true;
+}
+
+void Registry::startRefresh() {
+    if (!refreshPending) return;
+    refreshPending = false;
+
+    // One refresh at a time; the running one converges the cache anyway
+    if (cache.isLocked("refresh", REFRESH_LOCK_TTL)) return;
+
+    std::string executable = Platform::getExecutablePath();
+    if (executable.empty()) return;
+    std::vector<std::string> args = {executable, "index", "refresh"};
+    args.insert(args.end(), staleModules.begin(), staleModules.end());
+    Platform::spawnDetached(args);
+}
+
+bool Registry::refreshIndex(const std::vector<std::string>& moduleNames) {
+    if (!cache.lock("refresh", REFRESH_LOCK_TTL)) {
+        std::cout << "Another index refresh is running" << std::endl;
+        return true;
+    }
+
+    maxStale = 0;
+    bool refreshed = moduleNames.empty() ? fetchIndex() : fetchIndexFor(moduleNames);
+    if (refreshed && !moduleNames.empty()) {
+        prefetchModuleMetadata(moduleNames, DEFAULT_MANIFEST_CONCURRENCY);
+    }
+
+    cache.unlock("refresh");
+    return refreshed;
+}
+
+bool Registry::fetch(const std::string& url, const std::vector<std::string>& headers, HttpResponse& response) {
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = fetchAll({HttpRequest(url, headers)}, responses, 1);
+    response = std::move(responses[0]);
+    return completed[0];
+}
+
+std::string Registry::downloadCached(const std::string& url, bool* notModified) {
+    // Local registries are already on disk
+    if (url.substr(0, 7) == "file://") {
+        return download(url);
+    }
+
+    auto memo = prefetched.find(url);
+    if (memo != prefetched.end()) {
+        return memo->second;
+    }
+
+    // Offline the cached copy is as current as it gets
+    if (offline) {
+        if (notModified) *notModified = true;
+        return loadOffline(url);
+    }
+
+    CacheEntry entry;
+    bool haveCached = cache.load(url, entry);
+    if (knownMissing(entry, haveCached)) {
+        std::cerr << "Not found (cached): " << url << std::endl;
+        return "";
+    }
+
+    HttpResponse httpResponse;
+    if (!fetch(url, conditionalHeaders(entry, haveCached), httpResponse)) {
+        if (!offline) return "";
+        if (!haveCached) {
+            std::cerr << "Not cached (offline): " << url << std::endl;
+            return "";
+        }
+        if (notModified) *notModified = true;
+        return std::move(entry.body);
+    }
+
+    if (notModified) *notModified = httpResponse.status == 304 && haveCached;
+    return finishCached(url, entry, haveCached, httpResponse);
+}
+
+bool Registry::needsRequest(const std::string& url) const {
+    return !offline && url.substr(0, 7) != "file://" && !prefetched.count(url);
+}
+
+std::vector<std::string> Registry::conditionalHeaders(const CacheEntry& entry, bool haveCached) {
+    std::vector<std::string> headers;
+    if (haveCached) {
+        if (!entry.etag.empty()) {
+            headers.push_back("If-None-Match: " + entry.etag);
+        }
+        if (!entry.lastModified.empty()) {
+            headers.push_back("If-Modified-Since: " + entry.lastModified);
+        }
+    }
+    return headers;
+}
+
+std::string Registry::finishCached(const std::string& url, CacheEntry& entry, bool haveCached,
+                                   HttpResponse& httpResponse) {
+    if (httpResponse.status == 304 && haveCached) {
+        cache.touch(entry);
+        return std::move(entry.body);
+    }
+
+    if (httpResponse.status >= 400 || httpResponse.body.empty()) {
+        if (httpResponse.status >= 400) {
+            std::cerr << "HTTP " << httpResponse.status << " for " << url << std::endl;
+        }
+        if (httpResponse.status == 404 || httpResponse.status == 410) {
+            rememberMissing(url);
+        }
+        return "";
+    }
+
+    // Only keep responses we can revalidate later
+    if (!httpResponse.etag.empty() || !httpResponse.lastModified.empty()) {
+        entry.url = url;
+        entry.body = httpResponse.body;
+        entry.etag = httpResponse.etag;
+        entry.lastModified = httpResponse.lastModified;
+        entry.fetchedAt = (long long)std::time(nullptr);
+        cache.store(entry);
+    }
+
+    return std::move(httpResponse.body);
+}
+
+void Registry::rememberMissing(const std::string& url) {
+    CacheEntry entry;
+    if (cache.load(url, entry) && !entry.body.empty()) return;
+
+    // An empty body without validators marks the document as missing
+    entry = CacheEntry();
+    entry.url = url;
+    entry.fetchedAt = (long long)std::time(nullptr);
+    cache.store(entry);
+}
+
+bool Registry::knownMissing(const CacheEntry& entry, bool haveCached) {
+    return haveCached && entry.body.empty() &&
+           (long long)std::time(nullptr) - entry.fetchedAt < MISSING_TTL;
+}
+
+size_t Registry::prefetchModuleMetadata(const std::vector<std::string>& moduleNames, size_t maxConcurrent) {
+    std::vector<HttpRequest> requests;
+    std::vector<CacheEntry> entries;
+    std::vector<bool> haveCached;
+    size_t fetched = 0;
+
+    for (const auto& name : moduleNames) {
+        std::string url = getModuleURL(name);
+        if (url.empty() || prefetched.count(url)) continue;
+
+        // Local registries need no network round trip
+        if (url.substr(0, 7) == "file://") {
+            std::string content = download(url);
+            if (!content.empty()) {
+                prefetched[url] = std::move(content);
+                fetched++;
+            }
+            continue;
+        }
+
+        std::string content;
+        if (loadVerifiedManifest(url, getManifestHash(name), content)) {
+            prefetched[url] = std::move(content);
+            fetched++;
+            continue;
+        }
+
+        CacheEntry entry;
+        bool cached = cache.load(url, entry);
+        if (knownMissing(entry, cached)) continue;
+        requests.emplace_back(url, conditionalHeaders(entry, cached));
+        entries.push_back(std::move(entry));
+        haveCached.push_back(cached);
+    }
+
+    // Offline, fetchModuleMetadata() reads whatever is cached
+    if (requests.empty() || offline) return fetched;
+
+    std::cout << "Fetching metadata for " << requests.size() << " module(s)..." << std::endl;
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = fetchAll(requests, responses, maxConcurrent);
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (!completed[i]) continue;
+        std::string content = finishCached(requests[i].url, entries[i], haveCached[i], responses[i]);
+        if (!content.empty()) {
+            prefetched[requests[i].url] = std::move(content);
+            fetched++;
+        }
+    }
+    return fetched;
+}
+
+size_t Registry::prefetch(const std::vector<std::string>& urls, size_t maxConcurrent) {
+    std::vector<HttpRequest> requests;
+    size_t fetched = 0;
+    if (offline) return fetched;
+
+    // Each URL once: modules sharing a binary share its download (and its partial file)
+    std::set<std::string> unique;
+    for (const auto& url : urls) {
+        if (url.empty() || prefetchedFiles.count(url)) continue;
+        if (url.substr(0, 7) == "file://") continue;  // read on demand
+        if (!unique.insert(url).second) continue;
+        requests.push_back(resumableRequest(url));
+    }
+
+    if (requests.empty()) return fetched;
+
+    std::cout << "Downloading " << requests.size() << " file(s)..." << std::endl;
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = fetchAll(requests, responses, maxConcurrent);
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        // Failures are retried (and resumed) by downloadToFile()
+        if (!finishResumable(requests[i], completed[i], responses[i])) continue;
+        DownloadResult& file = prefetchedFiles[requests[i].url].file;
+        file.path = requests[i].outputPath;
+        file.size = responses[i].size;
+        file.sha256 = responses[i].sha256;
+        fetched++;
+    }
+    return fetched;
+}
+
+std::string Registry::getIndexURL() const {
+    return registryURL + "/nur.json";
+}
+
+std::string Registry::getCompiledIndexPath() const {
+    return cache.getCacheDir() + "/index.bin";
+}
+
+std::string Registry::getChangesURL() const {
+    return registryURL + "/nur.changes.json";
+}
+
+bool Registry::fetchIndex() {
+    // One snapshot per session, shared by every install and lookup
+    if (indexLoaded) return true;
+
+    // Sparse registries only had their layout checked in the background
+    bool loaded = false;
+    if (joinIndexFetch(loaded) && !sparse) return indexLoaded = loaded;
+    return indexLoaded = loadIndex();
+}
+
+void Registry::startIndexFetch() {
+    if (indexFetch.valid()) return;
+    indexFetch = std::async(std::launch::async, [this] {
+        return !checkSparse() && loadIndex();
+    }).share();
+}
+
+void Registry::waitIndexFetch() {
+    if (indexFetch.valid()) indexFetch.wait();
+}
+
+void Registry::cancelIndexFetch() {
+    if (!indexFetch.valid()) return;
+    if (indexFetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) http.cancel();
+    indexFetch.wait();
+}
+
+bool Registry::joinIndexFetch(bool& loaded) {
+    if (!indexFetch.valid()) return false;
+    loaded = indexFetch.get();
+    return true;
+}
+
+bool Registry::loadIndex() {
+    std::string indexURL = getIndexURL();
+
+    // Checked recently enough: answer now, revalidate in the background
+    indexDeferred = false;
+    if (loadStaleIndex(indexURL)) return true;
+
+    if (offline) {
+        std::cout << "Offline: using the cached NUR index" << std::endl;
+    } else {
+        std::cout << "Fetching NUR index from " << indexURL << "..." << std::endl;
+    }
+
+    // Registries with a changes log: apply what changed since our copy
+    bool parsedCached = false;
+    if (updateFromChanges(indexURL, parsedCached)) {
+        if (parsedCached) saveNameFilter(indexURL);
+        return true;
+    }
+
+    // Tells whether the body parsed below is the one now in the cache
+    CacheEntry previous;
+    cache.loadMeta(indexURL, previous);
+
+    // Unchanged index with an up-to-date compiled copy: skip the JSON entirely
+    std::string content;
+    if (useCompiledIndex(indexURL, content)) {
+        std::cout << "Loaded " << compiled.size() << " modules from compiled index" << std::endl;
+        return true;
+    }
+
+    bool notModified = false;
+    if (content.empty()) {
+        content = downloadCached(indexURL, &notModified);
+        // updateFromChanges() already parsed this very copy
+        if (notModified && parsedCached && !moduleIndex.empty()) {
+            saveNameFilter(indexURL);
+            return true;
+        }
+
+        // Unchanged since the name filter was built: misses are answered
+        // from the filter, and the JSON is parsed only for a likely hit
+        uint32_t serial = 0;
+        if (notModified && !content.empty() && loadNameFilter(indexURL, serial)) {
+            deferIndex(serial);
+            return true;
+        }
+    }
+    if (content.empty()) {
+        if (offline) {
+            std::cerr << "The NUR index is not cached; run once with network access first" << std::endl;
+        } else if (!http.isCancelled()) {
+            std::cerr << "Failed to fetch NUR index" << std::endl;
+        }
+        return false;
+    }
 
-namespace box {
+    if (!parseIndex(content)) return false;
+    CacheEntry current;
+    if (cache.loadMeta(indexURL, current) && (notModified || current.generation != previous.generation)) {
+        saveNameFilter(indexURL);
+    }
+    return true;
+}
 
-// Callback for curl to write data
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
-    userp->append((char*)contents, size * nmemb);
-    return size * nmemb;
+std::string Registry::getNameFilterPath() const {
+    return cache.getCacheDir() + "/index.bloom";
 }
 
-Registry::Registry() {
-    // Use online registry by default
-    registryURL = "https://raw.githubusercontent.com/neutron-modules/nur/refs/heads/main";
+bool Registry::loadNameFilter(const std::string& indexURL, uint32_t& serial) {
+    CacheEntry entry;
+    if (!cache.loadMeta(indexURL, entry) || entry.generation == 0) return false;
+
+    std::string source;
+    uint64_t generation = 0;
+    nameFilterGeneration = 0;
+    if (!nameFilter.read(getNameFilterPath(), source, generation, serial) || source != indexURL ||
+        generation != (uint64_t)entry.generation) {
+        return false;
+    }
+    nameFilterGeneration = entry.generation;
+    return true;
 }
 
-std::string Registry::download(const std::string& url) {
-    std::string response;
+void Registry::saveNameFilter(const std::string& indexURL) {
+    CacheEntry entry;
+    if (!cache.loadMeta(indexURL, entry) || entry.generation == 0 ||
+        entry.generation == nameFilterGeneration) {
+        return;
+    }
 
-    // Check if it's a local file URL
-    if (url.substr(0, 7) == "file://") {
-        std::string localPath = url.substr(7); // Remove "file://" prefix
-        std::ifstream file(localPath);
-        if (file.is_open()) {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            response = buffer.str();
-            file.close();
+    nameFilter.reset(moduleIndex.size());
+    for (const auto& pair : moduleIndex) {
+        nameFilter.add(pair.first);
+    }
+    if (nameFilter.write(getNameFilterPath(), indexURL, (uint64_t)entry.generation, indexSerial)) {
+        nameFilterGeneration = entry.generation;
+    } else {
+        nameFilterGeneration = 0;
+    }
+}
+
+void Registry::deferIndex(uint32_t serial) {
+    moduleIndex.clear();
+    bundleRecord = IndexRecord();
+    indexSerial = serial;
+    useCompiled = false;
+    searchIndex.reset();
+    indexDeferred = true;
+}
+
+bool Registry::ensureIndex() {
+    if (!indexDeferred) return true;
+    indexDeferred = false;
+
+    CacheEntry entry;
+    if (!cache.load(getIndexURL(), entry)) {
+        std::cerr << "Failed to read the cached NUR index" << std::endl;
+        return false;
+    }
+    return parseIndex(entry.body);
+}
+
+bool Registry::fetchIndexFor(const std::vector<std::string>& moduleNames) {
+    if (indexLoaded) return true;
+    bool loaded = false;
+    if (joinIndexFetch(loaded) && !sparse) return indexLoaded = loaded;
+    if (!checkSparse()) return indexLoaded = loadIndex();
+
+    // Shards already read this session stay valid for the session
+    useCompiled = false;
+    std::vector<std::string> names;
+    for (const auto& name : moduleNames) {
+        if (moduleIndex.count(name) || getShardPath(name).empty()) continue;
+        if (std::find(names.begin(), names.end(), name) != names.end()) continue;
+        names.push_back(name);
+    }
+    if (names.empty()) return true;
+
+    std::vector<HttpRequest> requests;
+    std::vector<std::string> requestNames;
+    std::vector<CacheEntry> entries;
+    std::vector<bool> haveCached;
+    for (const auto& name : names) {
+        std::string url = registryURL + "/" + getShardPath(name);
+        std::string content;
+        if (loadStale(url, name, content)) {
+            parseShard(name, content);
+            continue;
         }
-        return response;
+        if (offline || url.substr(0, 7) == "file://") {
+            content = downloadCached(url);
+            if (!content.empty()) parseShard(name, content);
+            continue;
+        }
+
+        CacheEntry entry;
+        bool cached = cache.load(url, entry);
+        if (knownMissing(entry, cached)) continue;  // looked up moments ago
+        requests.emplace_back(url, conditionalHeaders(entry, cached));
+        requestNames.push_back(name);
+        entries.push_back(std::move(entry));
+        haveCached.push_back(cached);
     }
+    if (requests.empty()) return true;
 
-#ifdef _WIN32
-    // Windows implementation using WinINet
-    HINTERNET hInternet = InternetOpenA("Box/1.0", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
-    if (hInternet) {
-        HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
-        if (hUrl) {
-            char buffer[4096];
-            DWORD bytesRead;
-            while (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
-                response.append(buffer, bytesRead);
-            }
-            InternetCloseHandle(hUrl);
+    std::cout << "Fetching sparse index entries for " << requests.size() << " module(s)..." << std::endl;
+    std::vector<HttpResponse> responses;
+    std::vector<bool> completed = fetchAll(requests, responses, DEFAULT_MANIFEST_CONCURRENCY);
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        std::string content;
+        if (!completed[i]) {
+            // Unreachable: fall back to the cached shard, if any
+            if (offline && haveCached[i]) content = std::move(entries[i].body);
+        } else if (responses[i].status == 404 || responses[i].status == 410) {
+            rememberMissing(requests[i].url);  // not in the registry
+        } else {
+            content = finishCached(requests[i].url, entries[i], haveCached[i], responses[i]);
         }
-        InternetCloseHandle(hInternet);
+        if (!content.empty()) parseShard(requestNames[i], content);
+    }
+    return true;
+}
+
+std::string Registry::getShardPath(const std::string& moduleName) {
+    // Names become path components, so they must not be able to escape them
+    if (moduleName.empty() || moduleName == "." || moduleName == ".." ||
+        moduleName.find_first_of("/\\?#%") != std::string::npos) {
+        return "";
+    }
+
+    // Same layout as the crates.io sparse index, with lowercased directories:
+    // 1/a, 2/ab, 3/a/abc, ab/cd/abcd...
+    std::string lower = moduleName;
+    for (char& c : lower) c = (char)std::tolower((unsigned char)c);
+    switch (moduleName.size()) {
+        case 1: return "index/1/" + moduleName;
+        case 2: return "index/2/" + moduleName;
+        case 3: return "index/3/" + lower.substr(0, 1) + "/" + moduleName;
+        default: return "index/" + lower.substr(0, 2) + "/" + lower.substr(2, 2) + "/" + moduleName;
+    }
+}
+
+bool Registry::checkSparse() {
+    if (sparseChecked) return sparse;
+    sparseChecked = true;
+
+    std::string url = registryURL + "/index/config.json";
+    if (url.substr(0, 7) == "file://") {
+        sparse = !download(url).empty();
+        return sparse;
+    }
+
+    // A recent answer either way is trusted without asking again; an empty
+    // cached body records that the registry has no sparse index
+    CacheEntry entry;
+    bool haveCached = cache.load(url, entry);
+    long long age = (long long)std::time(nullptr) - entry.fetchedAt;
+    if (haveCached && (offline || age < SPARSE_CONFIG_TTL)) {
+        sparse = !entry.body.empty();
+        return sparse;
+    }
+    if (offline) return false;
+
+    HttpResponse httpResponse;
+    if (!fetch(url, conditionalHeaders(entry, haveCached), httpResponse)) {
+        sparse = haveCached && !entry.body.empty();
+        return sparse;
+    }
+
+    if (httpResponse.status == 304 && haveCached) {
+        cache.touch(entry);
+    } else if (httpResponse.status == 200 || httpResponse.status == 404 || httpResponse.status == 410) {
+        entry.url = url;
+        entry.body = httpResponse.status == 200 ? std::move(httpResponse.body) : std::string();
+        entry.etag = httpResponse.etag;
+        entry.lastModified = httpResponse.lastModified;
+        entry.fetchedAt = (long long)std::time(nullptr);
+        cache.store(entry);
+    } else {
+        // Server trouble says nothing about the layout; ask again next time
+        return false;
     }
-#else
-    // Unix-like systems using libcurl
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    sparse = !entry.body.empty();
+    return sparse;
+}
+
+bool Registry::parseShard(const std::string& moduleName, const std::string& content) {
+    IndexRecord record;
+    ShardHandler handler(record, registryURL);
+    json::Reader reader(content);
+    if (!reader.parse(handler) || record.url.empty()) {
+        std::cerr << "Invalid sparse index entry for " << moduleName << std::endl;
+        return false;
+    }
+    moduleIndex[moduleName] = std::move(record);
+    searchIndex.reset();
+    return true;
+}
+
+bool Registry::compiledMatches(const std::string& indexURL, const CacheEntry& indexEntry) {
+    if (!compiled.isOpen() && !compiled.open(getCompiledIndexPath())) return false;
+    if (compiled.getSourceURL() != indexURL ||
+        compiled.getSourceETag() != indexEntry.etag ||
+        compiled.getSourceLastModified() != indexEntry.lastModified) {
+        compiled.close();
+        return false;
+    }
+    return true;
+}
+
+bool Registry::useCompiledIndex(const std::string& indexURL, std::string& content) {
+    useCompiled = false;
+    if (indexURL.substr(0, 7) == "file://") return false;
 
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-            response.clear();
+    // The compiled index must come from exactly the nur.json we have cached
+    CacheEntry entry;
+    if (!cache.loadMeta(indexURL, entry) || !compiledMatches(indexURL, entry)) return false;
+
+    // Offline the compiled index is used as it is
+    HttpResponse httpResponse;
+    if (!offline && !fetch(indexURL, conditionalHeaders(entry, true), httpResponse)) {
+        // fetch() may have just found the registry unreachable
+        if (!offline) {
+            compiled.close();
+            return false;
         }
-        curl_easy_cleanup(curl);
     }
-#endif
 
-    return response;
+    if (offline || httpResponse.status == 304) {
+        cache.touch(entry);
+        useCompiled = true;
+        indexSerial = compiled.getSourceSerial();
+        searchIndex.reset();
+        return true;
+    }
+
+    // The index changed: hand the fresh body back instead of fetching it twice
+    content = finishCached(indexURL, entry, false, httpResponse);
+    compiled.close();
+    std::cerr << "Compiled index is out of date; run 'box index compile' to refresh it" << std::endl;
+    return false;
 }
 
-bool Registry::fetchIndex() {
-    std::string indexURL;
-    if (registryURL.substr(0, 7) == "file://") {
-        indexURL = registryURL + "/nur.json";
+bool Registry::updateFromChanges(const std::string& indexURL, bool& parsedCached) {
+    parsedCached = false;
+    if (indexURL.substr(0, 7) == "file://") return false;
+
+    // Without a local copy there is nothing to update
+    CacheEntry indexEntry;
+    if (!cache.loadMeta(indexURL, indexEntry)) return false;
+
+    // Local serial: from the compiled index when it matches, else the cached JSON.
+    // Indexes without a serial predate the changes log, so don't ask for one.
+    bool fromCompiled = compiledMatches(indexURL, indexEntry);
+    uint32_t localSerial = 0;
+    bool deferred = false;
+    if (fromCompiled) {
+        localSerial = compiled.getSourceSerial();
+    } else if (loadNameFilter(indexURL, localSerial)) {
+        // The name filter recorded the serial; no need to parse the JSON for it
+        deferred = true;
     } else {
-        indexURL = registryURL + "/nur.json";
+        CacheEntry cached;
+        if (!cache.load(indexURL, cached) || !parseIndex(cached.body)) return false;
+        parsedCached = true;
+        localSerial = indexSerial;
+    }
+    if (localSerial == 0) return false;
+
+    std::string changesURL = getChangesURL();
+    CacheEntry changesEntry;
+    bool haveChanges = cache.load(changesURL, changesEntry);
+    if (knownMissing(changesEntry, haveChanges)) return false;
+    HttpResponse httpResponse;
+    if (!fetch(changesURL, conditionalHeaders(changesEntry, haveChanges), httpResponse)) return false;
+    if (httpResponse.status == 404) {  // the registry doesn't publish one
+        rememberMissing(changesURL);
+        return false;
+    }
+
+    std::string content = finishCached(changesURL, changesEntry, haveChanges, httpResponse);
+    IndexChanges changes;
+    if (content.empty() || !parseChanges(content, changes)) return false;
+
+    // Too old for the log to bridge: fall back to a full fetch
+    if (localSerial < changes.since || localSerial > changes.serial) return false;
+
+    cache.touch(indexEntry);
+    if (localSerial == changes.serial) {
+        if (fromCompiled) {
+            useCompiled = true;
+            indexSerial = localSerial;
+            searchIndex.reset();
+            std::cout << "Loaded " << compiled.size() << " modules from compiled index" << std::endl;
+        } else if (deferred) {
+            deferIndex(localSerial);
+        }
+        return true;
+    }
+
+    if (fromCompiled) {
+        loadFromCompiled();
+    } else if (deferred) {
+        CacheEntry cached;
+        if (!cache.load(indexURL, cached) || !parseIndex(cached.body)) return false;
+    }
+
+    std::vector<std::string> changed;
+    for (const auto& change : changes.entries) {
+        if (change.serial <= localSerial || change.name.empty()) continue;
+        if (change.removed) {
+            moduleIndex.erase(change.name);
+        } else {
+            moduleIndex[change.name] = change.record;
+        }
+        changed.push_back(change.name);
+    }
+    indexSerial = changes.serial;
+    if (saveIndex(indexURL)) saveNameFilter(indexURL);
+
+    std::cout << "Applied " << changed.size() << " index change(s) (serial " << localSerial
+              << " -> " << indexSerial << ")" << std::endl;
+
+    // Cached manifests of changed modules are refreshed now; the rest stay valid
+    std::vector<std::string> stale;
+    for (const auto& name : changed) {
+        auto it = moduleIndex.find(name);
+        std::string manifest;
+        if (it != moduleIndex.end() && cache.loadMeta(it->second.url, changesEntry) &&
+            !loadVerifiedManifest(it->second.url, it->second.hash, manifest)) {
+            stale.push_back(name);
+        }
+    }
+    if (!stale.empty()) {
+        prefetchModuleMetadata(stale, DEFAULT_MANIFEST_CONCURRENCY);
+    }
+
+    // Keep a compiled index in step with the updated copy. It still carries
+    // the same validators, so one that can't be rewritten is removed rather
+    // than left to pass for the updated copy.
+    if (fromCompiled) {
+        if (writeCompiledIndex(indexURL, true) && compiled.open(getCompiledIndexPath())) {
+            useCompiled = true;
+            std::cout << "Loaded " << compiled.size() << " modules from compiled index" << std::endl;
+        } else {
+            compiled.close();
+            std::error_code ec;
+            std::filesystem::remove(getCompiledIndexPath(), ec);
+        }
+    }
+    return true;
+}
+
+bool Registry::saveIndex(const std::string& indexURL) {
+    std::string content = "{\"version\":\"1.1\",\"serial\":" + std::to_string(indexSerial) + ",";
+    if (!bundleRecord.url.empty()) {
+        content += "\"bundle\":{\"path\":";
+        appendJSONString(content, bundleRecord.url);
+        content += ",\"hash\":";
+        appendJSONString(content, bundleRecord.hash);
+        content += "},";
+    }
+    content += "\"modules\":{";
+    bool first = true;
+    for (const auto& pair : moduleIndex) {
+        if (!first) content += ',';
+        first = false;
+        appendJSONString(content, pair.first);
+        content += ":{\"path\":";
+        appendJSONString(content, pair.second.url);
+        if (!pair.second.hash.empty()) {
+            content += ",\"hash\":";
+            appendJSONString(content, pair.second.hash);
+        }
+        content += '}';
     }
+    content += "}}";
+
+    // The validators of the copy the changes were applied to are kept: a 304
+    // for them means the registry's nur.json is still the one this copy was
+    // patched from, so the patched copy is at least as new. A 200 replaces it.
+    CacheEntry entry;
+    cache.loadMeta(indexURL, entry);
+    entry.url = indexURL;
+    entry.body = std::move(content);
+    entry.fetchedAt = (long long)std::time(nullptr);
+    return cache.store(entry);
+}
+
+bool Registry::compileIndex() {
+    std::string indexURL = getIndexURL();
+    compiled.close();
+    useCompiled = false;
 
     std::cout << "Fetching NUR index from " << indexURL << "..." << std::endl;
+    bool parsedCached = false;
+    if (!updateFromChanges(indexURL, parsedCached)) {
+        std::string content = downloadCached(indexURL);
+        if (content.empty() || !parseIndex(content)) {
+            std::cerr << "Failed to fetch NUR index" << std::endl;
+            return false;
+        }
+    } else if (useCompiled) {
+        loadFromCompiled();
+    } else if (!ensureIndex()) {
+        return false;
+    }
 
-    std::string content = download(indexURL);
-    if (content.empty()) {
-        std::cerr << "Failed to fetch NUR index" << std::endl;
+    // One bundle download covers every manifest the compiled index folds in
+    fetchBundle();
+    return writeCompiledIndex(indexURL, false);
+}
+
+void Registry::loadFromCompiled() {
+    moduleIndex.clear();
+    for (size_t i = 0; i < compiled.size(); i++) {
+        IndexEntry entry = compiled.at(i);
+        IndexRecord& record = moduleIndex[std::string(entry.name)];
+        record.url.assign(entry.url);
+        record.hash.assign(entry.hash);
+    }
+    indexSerial = compiled.getSourceSerial();
+    useCompiled = false;
+    searchIndex.reset();
+}
+
+bool Registry::writeCompiledIndex(const std::string& indexURL, bool incremental) {
+    IndexSource source;
+    source.url = indexURL;
+    source.serial = indexSerial;
+    CacheEntry indexEntry;
+    if (cache.loadMeta(indexURL, indexEntry)) {
+        source.etag = indexEntry.etag;
+        source.lastModified = indexEntry.lastModified;
+    }
+
+    // Refresh only the cached manifests whose published hash changed
+    // (an incremental update has already refreshed the changed ones)
+    if (!incremental) {
+        compiled.close();
+        std::vector<std::string> stale = staleManifests();
+        if (!stale.empty()) {
+            prefetchModuleMetadata(stale, DEFAULT_MANIFEST_CONCURRENCY);
+        }
+    }
+
+    // Fold in whatever manifests are cached or bundled; never download them all
+    // Manifests go into one flat table rather than a ModuleMetadata each
+    std::vector<IndexSourceEntry> entries;
+    entries.reserve(moduleIndex.size());
+    MetadataTable manifests;
+    size_t withManifest = 0;
+    for (const auto& pair : moduleIndex) {
+        IndexSourceEntry entry;
+        entry.name = pair.first;
+        entry.url = pair.second.url;
+        entry.hash = pair.second.hash;
+
+        // Incremental update: unchanged entries keep their compiled fields
+        IndexEntry previous;
+        if (incremental && !entry.hash.empty() && compiled.isOpen() &&
+            compiled.lookup(entry.name, previous) && previous.hash == entry.hash) {
+            entry.latest.assign(previous.latest);
+            entry.description.assign(previous.description);
+            if (!entry.latest.empty()) withManifest++;
+            entries.push_back(std::move(entry));
+            continue;
+        }
+
+        std::string manifest;
+        auto memo = prefetched.find(entry.url);
+        if (memo != prefetched.end()) {
+            manifest = memo->second;
+        } else if (entry.url.substr(0, 7) == "file://") {
+            manifest = download(entry.url);
+        } else if (!loadVerifiedManifest(entry.url, entry.hash, manifest)) {
+            CacheEntry cached;
+            if (cache.load(entry.url, cached)) manifest = std::move(cached.body);
+        }
+
+        if (!manifest.empty() && manifests.addManifest(entry.name, manifest)) {
+            const CompactModule& module = manifests.at(manifests.size() - 1);
+            entry.latest.assign(module.latest);
+            entry.description.assign(module.description);
+
+            // Older manifests only describe individual versions
+            if (entry.description.empty() && !entry.latest.empty()) {
+                const CompactVersion* latest = manifests.findVersion(module, module.latest);
+                if (latest) entry.description.assign(latest->description);
+            }
+            withManifest++;
+        } else if (!manifest.empty()) {
+            std::cerr << "Invalid module manifest: " << entry.name << std::endl;
+        }
+        entries.push_back(std::move(entry));
+    }
+    manifests.clear();
+
+    // Unmap before replacing the file (required on Windows)
+    compiled.close();
+    useCompiled = false;
+
+    std::string path = getCompiledIndexPath();
+    if (!CompiledIndex::write(path, source, std::move(entries))) {
+        std::cerr << "Failed to write compiled index" << std::endl;
         return false;
     }
 
-    return parseIndex(content);
+    std::cout << "Compiled " << moduleIndex.size() << " modules (" << withManifest
+              << " with cached manifests) to " << path << std::endl;
+    return true;
 }
 
 bool Registry::parseIndex(const std::string& content) {
-    // Simple JSON parsing for nur.json
     // Format: {"version":"1.0","modules":{"base64":"./modules/base64.json",...}}
-    
+    // or, with manifest hashes: {"version":"1.1","serial":42,"modules":{
+    //     "base64":{"path":"./modules/base64.json","hash":"<sha256>"},...}}
     moduleIndex.clear();
-    
-    // Find "modules" object
-    size_t modulesPos = content.find("\"modules\"");
-    if (modulesPos == std::string::npos) {
-        std::cerr << "Invalid NUR index format: 'modules' not found" << std::endl;
+    indexSerial = 0;
+    bundleRecord = IndexRecord();
+    indexDeferred = false;
+    useCompiled = false;
+    searchIndex.reset();
+
+    IndexHandler handler(moduleIndex, registryURL);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Invalid NUR index: " << reader.getError() << std::endl;
         return false;
     }
-    
-    // Find opening brace of modules object
-    size_t openBrace = content.find('{', modulesPos);
-    if (openBrace == std::string::npos) return false;
-    
-    // Parse module entries
-    size_t pos = openBrace + 1;
-    while (pos < content.length()) {
-        // Find module name
-        size_t nameStart = content.find('"', pos);
-        if (nameStart == std::string::npos) break;
-        
-        size_t nameEnd = content.find('"', nameStart + 1);
-        if (nameEnd == std::string::npos) break;
-        
-        std::string moduleName = content.substr(nameStart + 1, nameEnd - nameStart - 1);
-        
-        // Find module URL
-        size_t urlStart = content.find('"', nameEnd + 1);
-        if (urlStart == std::string::npos) break;
-        
-        size_t urlEnd = content.find('"', urlStart + 1);
-        if (urlEnd == std::string::npos) break;
-        
-        std::string moduleURL = content.substr(urlStart + 1, urlEnd - urlStart - 1);
-        
-        // Convert relative URL to absolute
-        if (moduleURL[0] == '.') {
-            moduleURL = registryURL + moduleURL.substr(1);
-        }
-        
-        moduleIndex[moduleName] = moduleURL;
-        
-        pos = urlEnd + 1;
-        
-        // Check for end of modules object
-        if (content.find('}', pos) < content.find('"', pos)) break;
+    if (!handler.sawModules()) {
+        std::cerr << "Invalid NUR index format: 'modules' not found" << std::endl;
+        return false;
     }
-    
+    indexSerial = handler.getSerial();
+    bundleRecord = handler.getBundle();
+
     std::cout << "Loaded " << moduleIndex.size() << " modules from NUR" << std::endl;
     return !moduleIndex.empty();
 }
 
+bool Registry::parseChanges(const std::string& content, IndexChanges& changes) {
+    ChangesHandler handler(changes, registryURL);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Invalid NUR changes log: " << reader.getError() << std::endl;
+        return false;
+    }
+    return changes.serial != 0;
+}
+
+bool Registry::parseManifest(std::string_view content, ModuleMetadata& metadata) {
+    // Format: {"name":"base64","latest":"1.0.1","versions":{"1.0.0":{...},"1.0.1":{...}}}
+    ManifestHandler handler(metadata);
+    json::Reader reader(content);
+    if (!reader.parse(handler)) {
+        std::cerr << "Invalid module manifest: " << reader.getError() << std::endl;
+        return false;
+    }
+
+    // Older manifests only describe individual versions
+    if (metadata.description.empty() && !metadata.latest.empty()) {
+        auto latest = metadata.versions.find(metadata.latest);
+        if (latest != metadata.versions.end()) {
+            metadata.description = latest->second.description;
+        }
+    }
+    return true;
+}
+
 std::string Registry::getModuleURL(const std::string& moduleName) {
+    if (useCompiled) {
+        IndexEntry entry;
+        if (compiled.lookup(moduleName, entry)) return std::string(entry.url);
+        return "";
+    }
+
+    // A name the filter rejects is certainly not in the index: no need to parse it
+    if (indexDeferred && !nameFilter.mightContain(moduleName)) return "";
+    if (!ensureIndex()) return "";
+
+    // Relative paths were resolved against the registry when the index was read
     auto it = moduleIndex.find(moduleName);
     if (it != moduleIndex.end()) {
-        std::string modulePath = it->second;
-        // If this is a local registry, convert relative paths to absolute
-        if (registryURL.substr(0, 7) == "file://") {
-            if (modulePath[0] == '.') {
-                // Convert relative path like "./modules/base64.json" to absolute path
-                std::string basePath = registryURL.substr(7); // Remove "file://"
-                modulePath = basePath + modulePath.substr(1); // Remove leading "."
+        return it->second.url;
+    }
+    return "";
+}
+
+std::string Registry::getManifestHash(const std::string& moduleName) {
+    if (useCompiled) {
+        IndexEntry entry;
+        if (compiled.lookup(moduleName, entry)) return std::string(entry.hash);
+        return "";
+    }
+
+    if (!ensureIndex()) return "";
+    auto it = moduleIndex.find(moduleName);
+    return it != moduleIndex.end() ? it->second.hash : "";
+}
+
+bool Registry::loadVerifiedManifest(const std::string& url, const std::string& hash, std::string& content) {
+    if (hash.empty()) return false;
+
+    CacheEntry entry;
+    if (cache.load(url, entry)) {
+        Sha256 hasher;
+        hasher.update(entry.body.data(), entry.body.size());
+        if (hasher.finish() == hash) {
+            content = std::move(entry.body);
+            return true;
+        }
+    }
+
+    // Not cached (or changed since): the bundle may hold this exact version
+    return openBundle() && bundle.read(hash, content);
+}
+
+std::string Registry::getBundleDir() const {
+    return cache.getCacheDir() + "/bundles";
+}
+
+bool Registry::openBundle() {
+    if (bundleChecked) return bundle.isOpen();
+    bundleChecked = true;
+
+    // Prefer the bundle the index names; an older one still serves every
+    // manifest that hasn't changed since
+    std::string dir = getBundleDir();
+    std::string path = dir + "/" + bundleRecord.hash + ".bundle";
+    std::error_code ec;
+    if (bundleRecord.hash.empty() || !std::filesystem::is_regular_file(path, ec)) {
+        path.clear();
+        for (const auto& file : std::filesystem::directory_iterator(dir, ec)) {
+            if (file.path().extension() == ".bundle") {
+                path = file.path().string();
+                break;
             }
-        } else {
-            // For online registry, handle relative paths as before
-            if (modulePath[0] == '.') {
-                modulePath = registryURL + modulePath.substr(1);
+        }
+    }
+    return !path.empty() && bundle.open(path);
+}
+
+bool Registry::fetchBundle() {
+    if (bundleRecord.url.empty() || bundleRecord.hash.empty()) return false;
+
+    // Bundles are named by their hash, so a cached one is current by definition
+    std::string dir = getBundleDir();
+    std::string path = dir + "/" + bundleRecord.hash + ".bundle";
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        if (offline) return openBundle();
+
+        std::filesystem::create_directories(dir, ec);
+        std::cout << "Fetching manifest bundle from " << bundleRecord.url << "..." << std::endl;
+        DownloadResult result;
+        if (!downloadToFile(bundleRecord.url, path, result)) {
+            std::cerr << "Failed to fetch manifest bundle; manifests will be fetched one by one" << std::endl;
+            std::filesystem::remove(path, ec);
+            return openBundle();
+        }
+        if (result.sha256 != bundleRecord.hash) {
+            std::cerr << "Manifest bundle does not match the hash in the index" << std::endl;
+            std::filesystem::remove(path, ec);
+            return openBundle();
+        }
+
+        // The new bundle supersedes older ones (closed first for Windows)
+        bundle.close();
+        for (const auto& file : std::filesystem::directory_iterator(dir, ec)) {
+            if (file.path().extension() == ".bundle" && file.path().string() != path) {
+                std::filesystem::remove(file.path(), ec);
             }
         }
-        return modulePath;
     }
-    return "";
+
+    bundleChecked = true;
+    if (!bundle.open(path)) {
+        std::cerr << "Invalid manifest bundle: " << path << std::endl;
+        std::filesystem::remove(path, ec);
+        return false;
+    }
+    std::cout << "Manifest bundle holds " << bundle.size() << " manifests" << std::endl;
+    return true;
 }
 
-ModuleMetadata Registry::fetchModuleMetadata(const std::string& moduleName) {
-    ModuleMetadata metadata;
-    metadata.name = moduleName;
-    
+std::vector<std::string> Registry::staleManifests() {
+    std::vector<std::string> stale;
+    for (const auto& pair : moduleIndex) {
+        const IndexRecord& record = pair.second;
+        if (record.hash.empty()) continue;
+
+        CacheEntry entry;
+        std::string content;
+        if (cache.loadMeta(record.url, entry) && !loadVerifiedManifest(record.url, record.hash, content)) {
+            stale.push_back(pair.first);
+        }
+    }
+    return stale;
+}
+
+std::string Registry::fetchManifestContent(const std::string& moduleName) {
     std::string moduleURL = getModuleURL(moduleName);
     if (moduleURL.empty()) {
         std::cerr << "Module not found in registry: " << moduleName << std::endl;
-        return metadata;
+        return "";
     }
     
-    std::cout << "Fetching metadata for " << moduleName << "..." << std::endl;
-    std::string content = download(moduleURL);
+    // A cached manifest matching the published hash needs no round trip
+    std::string content;
+    if (!loadVerifiedManifest(moduleURL, getManifestHash(moduleName), content) &&
+        !loadStale(moduleURL, moduleName, content)) {
+        if (needsRequest(moduleURL)) std::cout << "Fetching metadata for " << moduleName << "..." << std::endl;
+        content = downloadCached(moduleURL);
+    }
     
     if (content.empty()) {
         std::cerr << "Failed to fetch module metadata" << std::endl;
-        return metadata;
     }
-    
-    // Parse module metadata JSON with versions
-    // Format: {"name":"base64","latest":"1.0.1","versions":{"1.0.0":{...},"1.0.1":{...}}}
+    return content;
+}
+
+ModuleMetadata Registry::fetchModuleMetadata(const std::string& moduleName) {
+    // name stays empty unless the manifest was fetched and parsed
+    ModuleMetadata metadata;
+    std::string content = fetchManifestContent(moduleName);
+    if (!content.empty() && parseManifest(content, metadata)) {
+        metadata.name = moduleName;
+    }
+    return metadata;
+}
+
+bool Registry::fetchManifest(const std::string& moduleName, LazyManifest& manifest) {
+    std::string content = fetchManifestContent(moduleName);
+    return !content.empty() && manifest.load(std::move(content));
+}
+
+bool Registry::fetchVersion(const std::string& moduleName, LazyManifest& manifest, const std::string& version,
+                            VersionMetadata& metadata) {
+    std::string path, hash;
+    if (!manifest.getVersionFile(version, path, hash)) {
+        return manifest.getVersion(version, metadata);
+    }
+
+    // Paths starting with "/" are relative to the registry root, others
+    // to the manifest's directory
+    std::string url;
+    if (path.find("://") != std::string::npos || (!path.empty() && path[0] == '/')) {
+        url = resolveIndexPath(registryURL, path);
+    } else {
+        std::string moduleURL = getModuleURL(moduleName);
+        url = moduleURL.substr(0, moduleURL.rfind('/') + 1);
+        url += path.compare(0, 2, "./") == 0 ? path.substr(2) : path;
+    }
+
+    std::string content;
+    if (!loadVerifiedManifest(url, hash, content)) {
+        if (needsRequest(url)) std::cout << "Fetching " << moduleName << "@" << version << " metadata..." << std::endl;
+        content = downloadCached(url);
+    }
+    if (content.empty()) {
+        std::cerr << "Failed to fetch version metadata: " << url << std::endl;
+        return false;
+    }
+    return LazyManifest::parseVersion(content, metadata);
+}
+
+void Registry::buildSearchIndex() {
+    // Parsing a deferred index resets searchIndex, so do it first
+    if (!useCompiled) ensureIndex();
+    searchIndex = std::make_unique<SearchIndex>();
+
+    // Descriptions come from the compiled index, which folds in cached
+    // manifests; searching never downloads manifests
+    if (useCompiled) {
+        for (size_t i = 0; i < compiled.size(); i++) {
+            IndexEntry entry = compiled.at(i);
+            searchIndex->add(entry.name, entry.description);
+        }
+    } else {
+        for (const auto& pair : moduleIndex) {
+            searchIndex->add(pair.first, "");
+        }
+    }
+    searchIndex->build();
+}
 
-    auto extractValue = [&content](const std::string& key, size_t startPos = 0) -> std::string {
-        std::string searchKey = "\"" + key + "\"";
-        size_t pos = content.find(searchKey, startPos);
-        if (pos == std::string::npos) return "";
+std::vector<SearchResult> Registry::searchModules(const std::string& query, size_t limit) {
+    if (!searchIndex) buildSearchIndex();
+    return searchIndex->search(query, limit);
+}
 
-        size_t colonPos = content.find(':', pos);
-        if (colonPos == std::string::npos) return "";
+bool Registry::streamSearch(const std::string& query, size_t limit,
+                            const std::function<void(const SearchResult&)>& onMatch,
+                            std::vector<SearchResult>& results) {
+    std::string indexURL = getIndexURL();
+    bool local = indexURL.substr(0, 7) == "file://";
+    CacheEntry entry;
+    bool haveCached = !local && cache.loadMeta(indexURL, entry);
 
-        size_t valueStart = content.find('"', colonPos);
-        if (valueStart == std::string::npos) return "";
+    // A compiled index is mapped rather than parsed, and has descriptions
+    if (haveCached && compiledMatches(indexURL, entry)) {
+        if (!fetchIndex()) return false;
+        results = searchModules(query, limit);
+        return true;
+    }
 
-        size_t valueEnd = content.find('"', valueStart + 1);
-        if (valueEnd == std::string::npos) return "";
+    // Matches are reported as they are found, except after a stream that
+    // already reported some had to start over (the ranked results follow anyway)
+    StreamingSearch search(query, limit);
+    SearchResult entered;
+    bool reported = false;
+    bool quiet = false;
+    IndexNameScanner scanner([&](std::string_view name) {
+        if (!search.add(name, "", entered) || quiet) return;
+        reported = true;
+        onMatch(entered);
+    });
+    auto feed = [&scanner](const char* data, size_t size) { return scanner.feed(data, size); };
 
-        return content.substr(valueStart + 1, valueEnd - valueStart - 1);
+    // Each source ends with finish(), once, when it was read to the end
+    auto fromCache = [&]() {
+        scanner.reset();
+        search.clear();
+        quiet = reported;
+        if (cache.stream(indexURL, entry, feed)) return scanner.finish();
+        if (!scanner.getError().empty()) return false;
+        std::cerr << "The NUR index is not cached; run once with network access first" << std::endl;
+        return false;
     };
 
-    // Extract top-level metadata
-    metadata.description = extractValue("description");
-    metadata.author = extractValue("author");
-    metadata.license = extractValue("license");
-    metadata.repository = extractValue("repository");
-    metadata.latest = extractValue("latest");
-
-    // Parse versions object
-    size_t versionsPos = content.find("\"versions\"");
-    if (versionsPos != std::string::npos) {
-        size_t versionObjStart = content.find('{', versionsPos);
-        if (versionObjStart != std::string::npos) {
-            // Find each version key
-            size_t pos = versionObjStart + 1;
-            size_t endOfVersions = content.length();
-
-            // Find the closing brace for versions object (simple brace counting)
-            int braceCount = 1;
-            for (size_t i = versionObjStart + 1; i < content.length() && braceCount > 0; i++) {
-                if (content[i] == '{') braceCount++;
-                else if (content[i] == '}') {
-                    braceCount--;
-                    if (braceCount == 0) {
-                        endOfVersions = i;
-                        break;
-                    }
-                }
-            }
+    bool read = false;
+    long long age = haveCached ? (long long)std::time(nullptr) - entry.fetchedAt : -1;
+    if (local) {
+        std::cout << "Fetching NUR index from " << indexURL << "..." << std::endl;
+        std::ifstream file(indexURL.substr(7), std::ios::binary);
+        char buffer[65536];
+        read = (bool)file;
+        while (read && file) {
+            file.read(buffer, sizeof(buffer));
+            if (file.gcount() > 0) read = feed(buffer, (size_t)file.gcount());
+        }
+        if (!read && scanner.getError().empty()) std::cerr << "Failed to fetch NUR index" << std::endl;
+        read = read && scanner.finish();
+    } else if (offline) {
+        std::cout << "Offline: using the cached NUR index" << std::endl;
+        read = fromCache();
+    } else if (maxStale > 0 && haveCached && age >= 0 && age < maxStale) {
+        // Checked recently enough: answer now, revalidate in the background
+        std::cout << "Using the cached NUR index (checked " << age << "s ago)" << std::endl;
+        if (age >= REFRESH_AFTER) refreshPending = true;
+        read = fromCache();
+    } else {
+        std::cout << "Fetching NUR index from " << indexURL << "..." << std::endl;
+
+        // The body goes to a file under the cache (one per process, as concurrent
+        // searches may fetch at once), and to the scanner as it arrives
+        HttpRequest request(indexURL, conditionalHeaders(entry, haveCached),
+                            Cache::tempPathFor(cache.partialPathFor(indexURL)));
+        request.onBody = feed;
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(request.outputPath).parent_path(), ec);
 
-            while (pos < endOfVersions) {
-                size_t versionKeyStart = content.find('"', pos);
-                if (versionKeyStart == std::string::npos || versionKeyStart >= endOfVersions) break;
-
-                size_t versionKeyEnd = content.find('"', versionKeyStart + 1);
-                if (versionKeyEnd == std::string::npos) break;
-
-                std::string versionNum = content.substr(versionKeyStart + 1, versionKeyEnd - versionKeyStart - 1);
-
-                // Parse this version's metadata
-                size_t versionObjStart2 = content.find('{', versionKeyEnd);
-                if (versionObjStart2 == std::string::npos) break;
-
-                VersionMetadata versionMeta;
-                versionMeta.description = extractValue("description", versionObjStart2);
-                versionMeta.entryLinux = extractValue("entry-linux", versionObjStart2);
-                versionMeta.entryWin = extractValue("entry-win", versionObjStart2);
-                versionMeta.entryMac = extractValue("entry-mac", versionObjStart2);
-
-                // Parse git metadata if present
-                size_t gitPos = content.find("\"git\"", versionObjStart2);
-                if (gitPos != std::string::npos && gitPos < content.find('}', versionObjStart2)) {
-                    size_t gitObjStart = content.find('{', gitPos);
-                    if (gitObjStart != std::string::npos) {
-                        versionMeta.git.url = extractValue("url", gitObjStart);
-                        versionMeta.git.ref = extractValue("ref", gitObjStart);
-                    }
-                }
-
-                metadata.versions[versionNum] = versionMeta;
-
-                // Move to next version - find matching closing brace
-                int versionBraceCount = 1;
-                pos = versionObjStart2 + 1;
-                while (pos < endOfVersions && versionBraceCount > 0) {
-                    if (content[pos] == '{') versionBraceCount++;
-                    else if (content[pos] == '}') versionBraceCount--;
-                    pos++;
-                }
+        std::vector<HttpResponse> responses;
+        bool completed = fetchAll({request}, responses, 1)[0];
+        const HttpResponse& response = responses[0];
+        if (completed && response.status == 304 && haveCached) {
+            std::filesystem::remove(request.outputPath, ec);
+            cache.touch(entry);
+            read = fromCache();
+        } else if (completed && response.status >= 200 && response.status < 300) {
+            read = scanner.finish();
+            if (read && (!response.etag.empty() || !response.lastModified.empty())) {
+                // Only keep responses we can revalidate later
+                CacheEntry fresh;
+                fresh.url = indexURL;
+                fresh.etag = response.etag;
+                fresh.lastModified = response.lastModified;
+                fresh.fetchedAt = (long long)std::time(nullptr);
+                cache.storeFile(fresh, request.outputPath);
+            } else {
+                std::filesystem::remove(request.outputPath, ec);
+            }
+        } else {
+            std::filesystem::remove(request.outputPath, ec);
+            if (completed) {
+                std::cerr << "HTTP " << response.status << " for " << indexURL << std::endl;
+            } else if (offline && haveCached && scanner.getError().empty()) {
+                // The registry went away, maybe halfway through: start over from the cache
+                read = fromCache();
+            } else if (scanner.getError().empty()) {
+                std::cerr << "Failed to fetch NUR index" << std::endl;
             }
         }
     }
-    
-    return metadata;
+
+    if (!read) {
+        if (!scanner.getError().empty()) std::cerr << "Invalid NUR index: " << scanner.getError() << std::endl;
+        return false;
+    }
+
+    std::cout << "Scanned " << scanner.getCount() << " modules from NUR" << std::endl;
+    results = search.results();
+    return true;
 }
 
 std::vector<std::string> Registry::search(const std::string& query) {
     std::vector<std::string> results;
-    std::string lowerQuery = query;
-    std::transform(lowerQuery.begin(), lowerQuery.end(), lowerQuery.begin(), ::tolower);
-    
-    for (const auto& pair : moduleIndex) {
-        std::string lowerName = pair.first;
-        std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
-        
-        if (lowerName.find(lowerQuery) != std::string::npos) {
-            results.push_back(pair.first);
-        }
+    for (auto& result : searchModules(query, 0)) {
+        results.push_back(std::move(result.name));
     }
-    
     return results;
 }
 
 std::vector<std::string> Registry::listModules() {
     std::vector<std::string> modules;
+    if (useCompiled) {
+        for (size_t i = 0; i < compiled.size(); i++) {
+            modules.push_back(std::string(compiled.at(i).name));
+        }
+        return modules;
+    }
+    ensureIndex();
     for (const auto& pair : moduleIndex) {
         modules.push_back(pair.first);
     }
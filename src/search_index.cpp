@@ -0,0 +1,448 @@
+#include "search_index.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BOX_SEARCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Like the JSON scanner, the AVX2 scan is compiled for AVX2 whatever the
+// build flags and only called when the CPU has it
+#if defined(BOX_SEARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BOX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BOX_TARGET_AVX2
+#endif
+
+namespace box {
+
+// ASCII only, which is all std::tolower does in the "C" locale box runs in,
+// without a call per byte
+static inline char lowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static std::string toLower(std::string_view value) {
+    std::string lower(value);
+    for (char& c : lower) c = lowerAscii(c);
+    return lower;
+}
+
+static const size_t NOT_FOUND = (size_t)-1;
+
+// Finds the first occurrence of needle (not empty) in text[from, size)
+using FindFunction = size_t (*)(const char* text, size_t size, size_t from, std::string_view needle);
+
+static size_t findScalar(const char* text, size_t size, size_t from, std::string_view needle) {
+    size_t at = std::string_view(text, size).find(needle, from);
+    return at == std::string_view::npos ? NOT_FOUND : at;
+}
+
+#ifdef BOX_SEARCH_X86
+
+static inline unsigned countTrailingZeros(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(x);
+#endif
+}
+
+// The first and last bytes already matched
+static inline bool middleMatches(const char* at, std::string_view needle) {
+    return needle.size() <= 2 || std::memcmp(at + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+// Compare 16 starting positions at once against the needle's first byte
+// and, shifted by its length, its last byte; only positions matching both
+// are compared in full
+static size_t findSSE2(const char* text, size_t size, size_t from, std::string_view needle) {
+    const size_t span = needle.size() - 1;
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    size_t i = from;
+    for (; i + span + 16 <= size; i += 16) {
+        __m128i starts = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i ends = _mm_loadu_si128((const __m128i*)(text + i + span));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last)));
+        while (mask) {
+            size_t at = i + countTrailingZeros(mask);
+            if (middleMatches(text + at, needle)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(text, size, i, needle);
+}
+
+BOX_TARGET_AVX2 static size_t findAVX2(const char* text, size_t size, size_t from, std::string_view needle) {
+    const size_t span = needle.size() - 1;
+    const __m256i first = _mm256_set1_epi8(needle.front());
+    const __m256i last = _mm256_set1_epi8(needle.back());
+    size_t i = from;
+    for (; i + span + 32 <= size; i += 32) {
+        __m256i starts = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i ends = _mm256_loadu_si256((const __m256i*)(text + i + span));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(starts, first), _mm256_cmpeq_epi8(ends, last)));
+        while (mask) {
+            size_t at = i + countTrailingZeros(mask);
+            if (middleMatches(text + at, needle)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return findSSE2(text, size, i, needle);
+}
+
+#endif // BOX_SEARCH_X86
+
+static FindFunction bestFind() {
+#ifdef BOX_SEARCH_X86
+    return Platform::hasAVX2() ? findAVX2 : findSSE2;
+#else
+    return findScalar;
+#endif
+}
+
+// Calls found(id) for every module whose value in a column contains the
+// needle, in id order, until it returns false
+template <typename Found>
+static void scanColumn(const std::string& text, const std::vector<uint32_t>& offsets,
+                       std::string_view needle, Found&& found) {
+    static const FindFunction find = bestFind();
+    size_t from = 0;
+    while (from < text.size()) {
+        size_t at = find(text.data(), text.size(), from, needle);
+        if (at == NOT_FOUND) return;
+
+        // The module whose value the match starts in
+        size_t id = (size_t)(std::upper_bound(offsets.begin(), offsets.end(), (uint32_t)at) - offsets.begin()) - 1;
+        size_t end = offsets[id + 1] - 1;  // its terminator
+        if (at + needle.size() <= end) {
+            if (!found((uint32_t)id)) return;
+            from = end + 1;
+        } else {
+            from = at + 1;  // the match runs into the next value
+        }
+    }
+}
+
+// Levenshtein distance, or maxDistance + 1 once it must exceed maxDistance.
+// Only the diagonal band |i - j| <= maxDistance can stay within the bound,
+// so each row costs 2 * maxDistance + 1 cells whatever the lengths.
+static int boundedEditDistance(std::string_view a, std::string_view b, int maxDistance,
+                               std::vector<int>& previous, std::vector<int>& current) {
+    int lengthDiff = (int)a.size() - (int)b.size();
+    if (lengthDiff > maxDistance || -lengthDiff > maxDistance) return maxDistance + 1;
+
+    const int over = maxDistance + 1;
+    const size_t band = (size_t)maxDistance;
+    previous.assign(b.size() + 1, over);
+    current.assign(b.size() + 1, over);
+    for (size_t j = 0; j <= std::min(b.size(), band); j++) previous[j] = (int)j;
+
+    for (size_t i = 1; i <= a.size(); i++) {
+        size_t from = i > band ? i - band : 1;
+        size_t to = std::min(b.size(), i + band);
+        current[from - 1] = from == 1 ? std::min((int)i, over) : over;
+        int rowMin = current[from - 1];
+        for (size_t j = from; j <= to; j++) {
+            int cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            current[j] = std::min({previous[j] + 1, current[j - 1] + 1, previous[j - 1] + cost, over});
+            rowMin = std::min(rowMin, current[j]);
+        }
+        if (rowMin > maxDistance) return over;
+        if (to < b.size()) current[to + 1] = over;  // the next row's band reaches one further
+        std::swap(previous, current);
+    }
+    return previous[b.size()];
+}
+
+SearchIndex::SearchIndex() {
+}
+
+void SearchIndex::TextColumn::append(std::string_view value, bool lowercase) {
+    size_t start = text.size();
+    text.append(value);
+    if (lowercase) {
+        for (size_t i = start; i < text.size(); i++) {
+            text[i] = lowerAscii(text[i]);
+        }
+    }
+    text.push_back('\0');
+    offsets.push_back((uint32_t)text.size());
+}
+
+// Rewrite a column in the given module order
+static void reorder(std::string& text, std::vector<uint32_t>& offsets, const std::vector<uint32_t>& order) {
+    std::string sortedText;
+    sortedText.reserve(text.size());
+    std::vector<uint32_t> sortedOffsets;
+    sortedOffsets.reserve(offsets.size());
+    sortedOffsets.push_back(0);
+    for (uint32_t id : order) {
+        sortedText.append(text, offsets[id], offsets[id + 1] - offsets[id]);
+        sortedOffsets.push_back((uint32_t)sortedText.size());
+    }
+    text.swap(sortedText);
+    offsets.swap(sortedOffsets);
+}
+
+void SearchIndex::add(std::string_view name, std::string_view description) {
+    names.append(name, false);
+    lowerNames.append(name, true);
+    descriptions.append(description, false);
+    lowerDescriptions.append(description, true);
+    built = false;
+}
+
+size_t SearchIndex::size() const {
+    return names.offsets.size() - 1;
+}
+
+void SearchIndex::build() {
+    // The registry adds modules in index order, which is usually name order
+    // already; then there is nothing to move
+    const uint32_t count = (uint32_t)size();
+    bool sorted = true;
+    for (uint32_t id = 1; id < count && sorted; id++) {
+        sorted = lowerNames.at(id - 1) <= lowerNames.at(id);
+    }
+
+    if (!sorted) {
+        // Sort on each name's first eight bytes, packed so integer order is
+        // string order, and only compare names whose first eight bytes tie
+        std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+        for (uint32_t id = 0; id < count; id++) {
+            std::string_view name = lowerNames.at(id);
+            uint64_t key = 0;
+            for (size_t i = 0; i < 8; i++) {
+                key = (key << 8) | (i < name.size() ? (unsigned char)name[i] : 0);
+            }
+            keys[id] = {key, id};
+        }
+        std::sort(keys.begin(), keys.end(), [this](const std::pair<uint64_t, uint32_t>& a,
+                                                   const std::pair<uint64_t, uint32_t>& b) {
+            if (a.first != b.first) return a.first < b.first;
+            std::string_view left = lowerNames.at(a.second);
+            std::string_view right = lowerNames.at(b.second);
+            return left < right || (left == right && a.second < b.second);
+        });
+
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < count; i++) order[i] = keys[i].second;
+        for (TextColumn* column : {&names, &lowerNames, &descriptions, &lowerDescriptions}) {
+            reorder(column->text, column->offsets, order);
+        }
+    }
+
+    // Module ids grouped by name length (a counting sort, ids ascending in
+    // each group), so fuzzy matching only visits names of a usable length
+    size_t longest = 0;
+    for (uint32_t id = 0; id < count; id++) longest = std::max(longest, lowerNames.at(id).size());
+    lengthStarts.assign(longest + 2, 0);
+    for (uint32_t id = 0; id < count; id++) lengthStarts[lowerNames.at(id).size() + 1]++;
+    for (size_t length = 1; length < lengthStarts.size(); length++) {
+        lengthStarts[length] += lengthStarts[length - 1];
+    }
+    byLength.resize(count);
+    std::vector<uint32_t> fill(lengthStarts.begin(), lengthStarts.end() - 1);
+    for (uint32_t id = 0; id < count; id++) byLength[fill[lowerNames.at(id).size()]++] = id;
+
+    built = true;
+}
+
+std::pair<uint32_t, uint32_t> SearchIndex::findPrefix(std::string_view prefix) const {
+    // Names starting with the prefix sort together, right from where the
+    // prefix itself would go
+    uint32_t first = 0;
+    uint32_t count = (uint32_t)size();
+    while (count > 0) {
+        uint32_t step = count / 2;
+        if (lowerNames.at(first + step) < prefix) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    uint32_t last = first;
+    count = (uint32_t)size() - first;
+    while (count > 0) {
+        uint32_t step = count / 2;
+        if (lowerNames.at(last + step).substr(0, prefix.size()) == prefix) {
+            last += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return {first, last};
+}
+
+std::vector<SearchResult> SearchIndex::search(std::string_view query, size_t limit) const {
+    std::vector<SearchResult> results;
+    if (!built) return results;
+
+    const std::string lower = toLower(query);
+    std::vector<bool> seen(size(), false);
+    auto full = [&]() { return limit != 0 && results.size() >= limit; };
+    auto emit = [&](uint32_t id, MatchKind kind, int distance) {
+        seen[id] = true;
+        SearchResult result;
+        result.name.assign(names.at(id));
+        result.description.assign(descriptions.at(id));
+        result.match = kind;
+        result.distance = distance;
+        results.push_back(std::move(result));
+    };
+
+    // Exact and prefix matches: one contiguous range in name order, so
+    // exact matches (the shortest names) come first
+    std::pair<uint32_t, uint32_t> range = findPrefix(lower);
+    for (uint32_t id = range.first; id < range.second && !full(); id++) {
+        if (lowerNames.at(id) != lower) break;
+        emit(id, MatchKind::EXACT, 0);
+    }
+    for (uint32_t id = range.first; id < range.second && !full(); id++) {
+        if (!seen[id]) emit(id, MatchKind::PREFIX, 0);
+    }
+    if (full() || lower.empty()) return results;
+
+    // Substring matches, then description matches: a scan of the lowercased
+    // column that stops once the limit is reached
+    scanColumn(lowerNames.text, lowerNames.offsets, lower, [&](uint32_t id) {
+        if (!seen[id]) emit(id, MatchKind::SUBSTRING, 0);
+        return !full();
+    });
+    if (full()) return results;
+
+    scanColumn(lowerDescriptions.text, lowerDescriptions.offsets, lower, [&](uint32_t id) {
+        if (!seen[id]) emit(id, MatchKind::DESCRIPTION, 0);
+        return !full();
+    });
+    if (full() || lower.size() < 3) return results;
+
+    // Fuzzy matches: only names within maxDistance of the query's length
+    // can be within maxDistance edits, and each is checked with a banded
+    // edit distance that gives up as soon as the bound is exceeded
+    const size_t maxDistance = lower.size() <= 4 ? 1 : 2;
+    const size_t maxLength = lengthStarts.size() - 2;  // of any name
+    const size_t shortest = std::min(lower.size() - maxDistance, maxLength + 1);
+    const size_t longest = std::min(lower.size() + maxDistance, maxLength);
+
+    std::vector<SearchResult> fuzzy;
+    std::vector<int> previous, current;
+    const size_t first = lengthStarts[shortest];
+    const size_t last = lengthStarts[longest + 1];
+    for (size_t slot = first; slot < last; slot++) {
+        uint32_t id = byLength[slot];
+        if (seen[id]) continue;
+        int distance = boundedEditDistance(lower, lowerNames.at(id), (int)maxDistance, previous, current);
+        if (distance > (int)maxDistance) continue;
+
+        SearchResult result;
+        result.name.assign(names.at(id));
+        result.description.assign(descriptions.at(id));
+        result.match = MatchKind::FUZZY;
+        result.distance = distance;
+        fuzzy.push_back(std::move(result));
+    }
+    std::sort(fuzzy.begin(), fuzzy.end(), [](const SearchResult& a, const SearchResult& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        return a.name < b.name;
+    });
+
+    for (auto& result : fuzzy) {
+        if (full()) break;
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+StreamingSearch::StreamingSearch(std::string_view query, size_t limit)
+    : query(toLower(query)), limit(limit) {
+}
+
+bool StreamingSearch::ranksBefore(const Entry& a, const Entry& b) {
+    if (a.result.match != b.result.match) return a.result.match < b.result.match;
+    if (a.result.distance != b.result.distance) return a.result.distance < b.result.distance;
+    if (a.lowerName != b.lowerName) return a.lowerName < b.lowerName;
+    return a.result.name < b.result.name;
+}
+
+bool StreamingSearch::add(std::string_view name, std::string_view description, SearchResult& entered) {
+    lowerName.assign(name);
+    for (char& c : lowerName) c = lowerAscii(c);
+
+    // The best way this module matches, as SearchIndex::search() tries them
+    MatchKind kind;
+    int distance = 0;
+    if (lowerName == query) {
+        kind = MatchKind::EXACT;
+    } else if (lowerName.compare(0, query.size(), query) == 0) {
+        kind = MatchKind::PREFIX;
+    } else if (lowerName.find(query) != std::string::npos) {
+        kind = MatchKind::SUBSTRING;
+    } else if (!description.empty() && containsLower(description)) {
+        kind = MatchKind::DESCRIPTION;
+    } else {
+        if (query.size() < 3) return false;
+        // A full heap of better matches leaves no room for a fuzzy one
+        bool full = limit != 0 && heap.size() >= limit;
+        if (full && heap.front().result.match < MatchKind::FUZZY) return false;
+        const int maxDistance = query.size() <= 4 ? 1 : 2;
+        distance = boundedEditDistance(query, lowerName, maxDistance, previous, current);
+        if (distance > maxDistance) return false;
+        kind = MatchKind::FUZZY;
+    }
+
+    candidate.result.name.assign(name);
+    candidate.result.description.assign(description);
+    candidate.result.match = kind;
+    candidate.result.distance = distance;
+    candidate.lowerName.assign(lowerName);
+
+    // Keep it if there is room or it beats the worst kept result, which then
+    // becomes the scratch entry (so its strings are reused)
+    if (limit == 0 || heap.size() < limit) {
+        heap.push_back(candidate);
+    } else {
+        if (!ranksBefore(candidate, heap.front())) return false;
+        std::pop_heap(heap.begin(), heap.end(), ranksBefore);
+        std::swap(heap.back(), candidate);
+    }
+    entered = heap.back().result;
+    std::push_heap(heap.begin(), heap.end(), ranksBefore);
+    return true;
+}
+
+bool StreamingSearch::containsLower(std::string_view text) {
+    lowerText.assign(text);
+    for (char& c : lowerText) c = lowerAscii(c);
+    return lowerText.find(query) != std::string::npos;
+}
+
+std::vector<SearchResult> StreamingSearch::results() const {
+    std::vector<Entry> sorted = heap;
+    std::sort(sorted.begin(), sorted.end(), ranksBefore);
+    std::vector<SearchResult> out;
+    out.reserve(sorted.size());
+    for (auto& entry : sorted) {
+        out.push_back(std::move(entry.result));
+    }
+    return out;
+}
+
+void StreamingSearch::clear() {
+    heap.clear();
+}
+
+} // namespace box
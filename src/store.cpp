@@ -0,0 +1,198 @@
+#include "store.h"
+#include "cache.h"
+#include "platform.h"
+#include "sha256.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+
+#ifndef _WIN32
+    #include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <linux/fs.h>
+#endif
+
+namespace box {
+
+Store::Store() {
+    storeDir = Platform::getBoxHome() + "/store";
+}
+
+Store::Store(const std::string& dir) : storeDir(dir) {
+}
+
+std::string Store::getStoreDir() const {
+    return storeDir;
+}
+
+std::string Store::keyPath(const std::string& key) const {
+    Sha256 hasher;
+    hasher.update(key.data(), key.size());
+    return storeDir + "/keys/" + hasher.finish();
+}
+
+std::string Store::find(const std::string& sha256, const std::string& fileName) const {
+    std::string path = storeDir + "/" + sha256 + "/" + fileName;
+    std::error_code ec;
+    return std::filesystem::is_regular_file(path, ec) ? path : "";
+}
+
+bool Store::intact(const std::string& path, const std::string& sha256) const {
+    // Each object is hashed once per session, however often it is looked up
+    auto it = verified.find(path);
+    if (it != verified.end()) return it->second;
+
+    std::string actual;
+    bool matches = Sha256::hashFile(path, actual) && actual == sha256;
+    verified[path] = matches;
+    return matches;
+}
+
+bool Store::add(const std::string& file, const std::string& sha256, const std::string& fileName,
+                std::string& storedPath) const {
+    // A damaged copy already in the store is replaced below
+    std::string existing = find(sha256, fileName);
+    if (!existing.empty() && intact(existing, sha256)) {
+        storedPath = existing;
+        return true;
+    }
+
+    std::string dir = storeDir + "/" + sha256;
+    std::string path = dir + "/" + fileName;
+    std::string tmpPath = Cache::tempPathFor(path);
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Error creating store directory " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // Link rather than copy when the file is on the same filesystem
+    std::filesystem::create_hard_link(file, tmpPath, ec);
+    if (ec) {
+        std::filesystem::copy_file(file, tmpPath, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            std::cerr << "Failed to add " << file << " to the store: " << ec.message() << std::endl;
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+    }
+
+#ifndef _WIN32
+    // Every install shares this inode, so nobody gets to modify it in place
+    chmod(tmpPath.c_str(), 0555);
+#endif
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cerr << "Failed to add " << file << " to the store: " << ec.message() << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    verified[path] = true;
+    storedPath = path;
+    return true;
+}
+
+bool Store::lookup(const std::string& key, std::string& storedPath) const {
+    std::ifstream in(keyPath(key));
+    if (!in.is_open()) return false;
+
+    std::string sha256, fileName, recordedKey;
+    in >> sha256 >> fileName;
+    in.ignore();
+    std::getline(in, recordedKey);
+    if (recordedKey != key) return false;
+
+    std::string path = find(sha256, fileName);
+    if (path.empty()) return false;
+
+    // A damaged or replaced object is ignored, so the key is fetched or built again
+    bool known = verified.count(path) > 0;
+    if (!intact(path, sha256)) {
+        if (!known) {
+            std::cerr << "Ignoring " << path << " in the store: its content doesn't match sha256 " << sha256 << std::endl;
+        }
+        return false;
+    }
+    storedPath = path;
+    return true;
+}
+
+bool Store::record(const std::string& key, const std::string& sha256, const std::string& fileName) const {
+    std::string path = keyPath(key);
+    std::string tmpPath = Cache::tempPathFor(path);
+
+    std::error_code ec;
+    std::filesystem::create_directories(storeDir + "/keys", ec);
+    if (ec) return false;
+
+    std::ofstream out(tmpPath);
+    if (!out) return false;
+    out << sha256 << " " << fileName << "\n" << key << "\n";
+    out.close();
+    if (out) std::filesystem::rename(tmpPath, path, ec);
+    if (!out || ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool Store::materialize(const std::string& storedPath, const std::string& dest, LinkMode& mode) {
+    std::error_code ec;
+    if (std::filesystem::equivalent(storedPath, dest, ec)) {
+        mode = LinkMode::HARDLINK;
+        return true;
+    }
+
+    // Build the new file beside dest and rename it over, so dest is never half-written
+    std::string tmpPath = Cache::tempPathFor(dest);
+
+    std::filesystem::create_hard_link(storedPath, tmpPath, ec);
+    if (!ec) {
+        mode = LinkMode::HARDLINK;
+    } else {
+        bool cloned = false;
+#ifdef __linux__
+        // Copy-on-write clone on filesystems that support it (btrfs, XFS)
+        int src = open(storedPath.c_str(), O_RDONLY);
+        if (src >= 0) {
+            int dst = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0755);
+            if (dst >= 0) {
+                cloned = ioctl(dst, FICLONE, src) == 0;
+                close(dst);
+                if (!cloned) std::filesystem::remove(tmpPath, ec);
+            }
+            close(src);
+        }
+#endif
+        if (cloned) {
+            mode = LinkMode::REFLINK;
+        } else {
+            std::filesystem::copy_file(storedPath, tmpPath, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec) {
+                std::cerr << "Failed to copy " << storedPath << " to " << dest << ": " << ec.message() << std::endl;
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+            mode = LinkMode::COPY;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, dest, ec);
+    if (ec) {
+        std::cerr << "Failed to place " << dest << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace box
@@ -0,0 +1,383 @@
+#include "structural.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BOX_STRUCTURAL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels are compiled for their instruction set whatever the build flags,
+// and picked at run time
+#if defined(BOX_STRUCTURAL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BOX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BOX_TARGET_AVX2
+#endif
+
+namespace box {
+namespace json {
+
+static const size_t BLOCK_SIZE = 64;
+
+// What a 64-byte block holds, one bit per byte
+struct BlockMasks {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t open = 0;        // { [
+    uint64_t close = 0;       // } ]
+    uint64_t structural = 0;  // { } [ ] : ,
+    uint64_t control = 0;     // bytes below 0x20
+};
+
+typedef void (*Classifier)(const unsigned char* block, BlockMasks& masks);
+
+// Carried from one block to the next
+struct ScanState {
+    uint64_t inString = 0;    // all ones while inside a string
+    bool escapeNext = false;  // block ended in an unescaped backslash
+};
+
+static inline unsigned countTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctzll(x);
+#endif
+}
+
+// Bit i of the result is the XOR of bits 0..i: 1 from an opening quote up
+// to (not including) its closing quote
+static inline unsigned countBits(uint64_t x) {
+#ifdef _MSC_VER
+    return (unsigned)__popcnt64(x);
+#else
+    return (unsigned)__builtin_popcountll(x);
+#endif
+}
+
+static inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Bytes escaped by a backslash. Registry documents have few escapes, so
+// the backslashes are walked one by one rather than with carry tricks.
+static inline uint64_t escapedBytes(uint64_t backslash, bool& escapeNext) {
+    uint64_t escaped = 0;
+    if (escapeNext) {
+        escaped = 1;
+        backslash &= ~1ULL;
+        escapeNext = false;
+    }
+    while (backslash) {
+        unsigned i = countTrailingZeros(backslash);
+        if (i == 63) {
+            escapeNext = true;
+            break;
+        }
+        escaped |= 1ULL << (i + 1);
+        backslash &= ~(3ULL << i);  // this backslash and the byte it escapes
+    }
+    return escaped;
+}
+
+// Classification by table, for CPUs (and builds) without SIMD
+static const unsigned char CLASS_QUOTE = 1;
+static const unsigned char CLASS_BACKSLASH = 2;
+static const unsigned char CLASS_STRUCTURAL = 4;
+static const unsigned char CLASS_CONTROL = 8;
+static const unsigned char CLASS_OPEN = 16;
+static const unsigned char CLASS_CLOSE = 32;
+
+struct ClassTable {
+    unsigned char classes[256];
+
+    ClassTable() {
+        for (int c = 0; c < 256; c++) {
+            classes[c] = c < 0x20 ? CLASS_CONTROL : 0;
+        }
+        classes[(unsigned char)'"'] = CLASS_QUOTE;
+        classes[(unsigned char)'\\'] = CLASS_BACKSLASH;
+        for (char c : {':', ','}) classes[(unsigned char)c] = CLASS_STRUCTURAL;
+        for (char c : {'{', '['}) classes[(unsigned char)c] = CLASS_STRUCTURAL | CLASS_OPEN;
+        for (char c : {'}', ']'}) classes[(unsigned char)c] = CLASS_STRUCTURAL | CLASS_CLOSE;
+    }
+};
+
+static const ClassTable CLASS_TABLE;
+
+static void classifyScalar(const unsigned char* block, BlockMasks& masks) {
+    masks = BlockMasks();
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        unsigned char c = CLASS_TABLE.classes[block[i]];
+        if (!c) continue;
+        uint64_t bit = 1ULL << i;
+        if (c & CLASS_QUOTE) masks.quote |= bit;
+        if (c & CLASS_BACKSLASH) masks.backslash |= bit;
+        if (c & CLASS_OPEN) masks.open |= bit;
+        if (c & CLASS_CLOSE) masks.close |= bit;
+        if (c & CLASS_STRUCTURAL) masks.structural |= bit;
+        if (c & CLASS_CONTROL) masks.control |= bit;
+    }
+}
+
+#ifdef BOX_STRUCTURAL_X86
+
+// SSE2 is part of x86-64, so this kernel needs no check
+static void classifySSE2(const unsigned char* block, BlockMasks& masks) {
+    const __m128i controlMax = _mm_set1_epi8(0x1F);
+    masks = BlockMasks();
+    for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i open = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+        __m128i close = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('}')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+        __m128i separator = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+        // v <= 0x1F unsigned: max(v, 0x1F) == 0x1F
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(v, controlMax), controlMax);
+
+        uint64_t openBits = (uint16_t)_mm_movemask_epi8(open);
+        uint64_t closeBits = (uint16_t)_mm_movemask_epi8(close);
+        uint64_t separatorBits = (uint16_t)_mm_movemask_epi8(separator);
+        masks.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        masks.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        masks.open |= openBits << i;
+        masks.close |= closeBits << i;
+        masks.structural |= (openBits | closeBits | separatorBits) << i;
+        masks.control |= (uint64_t)(uint16_t)_mm_movemask_epi8(control) << i;
+    }
+}
+
+BOX_TARGET_AVX2 static void classifyAVX2(const unsigned char* block, BlockMasks& masks) {
+    const __m256i controlMax = _mm256_set1_epi8(0x1F);
+    masks = BlockMasks();
+    for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i open = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')));
+        __m256i close = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('}')),
+                                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')));
+        __m256i separator = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(v, controlMax), controlMax);
+
+        uint64_t openBits = (uint32_t)_mm256_movemask_epi8(open);
+        uint64_t closeBits = (uint32_t)_mm256_movemask_epi8(close);
+        uint64_t separatorBits = (uint32_t)_mm256_movemask_epi8(separator);
+        masks.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        masks.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        masks.open |= openBits << i;
+        masks.close |= closeBits << i;
+        masks.structural |= (openBits | closeBits | separatorBits) << i;
+        masks.control |= (uint64_t)(uint32_t)_mm256_movemask_epi8(control) << i;
+    }
+}
+
+#endif // BOX_STRUCTURAL_X86
+
+StructuralIndex::StructuralIndex() {
+}
+
+bool StructuralIndex::isSupported(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AUTO:
+        case Kernel::SCALAR:
+            return true;
+#ifdef BOX_STRUCTURAL_X86
+        case Kernel::SSE2:
+            return true;
+        case Kernel::AVX2:
+            return Platform::hasAVX2();
+#endif
+        default:
+            return false;
+    }
+}
+
+StructuralIndex::Kernel StructuralIndex::bestKernel() {
+    if (isSupported(Kernel::AVX2)) return Kernel::AVX2;
+    if (isSupported(Kernel::SSE2)) return Kernel::SSE2;
+    return Kernel::SCALAR;
+}
+
+const char* StructuralIndex::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AVX2: return "avx2";
+        case Kernel::SSE2: return "sse2";
+        case Kernel::SCALAR: return "scalar";
+        default: return kernelName(bestKernel());
+    }
+}
+
+static Classifier classifierFor(StructuralIndex::Kernel kernel) {
+#ifdef BOX_STRUCTURAL_X86
+    if (kernel == StructuralIndex::Kernel::SSE2) return classifySSE2;
+    if (kernel == StructuralIndex::Kernel::AVX2) return classifyAVX2;
+#endif
+    (void)kernel;
+    return classifyScalar;
+}
+
+// Resolved once; AUTO callers on the parse path skip the CPU checks
+static Classifier bestClassifier() {
+    static const Classifier best = classifierFor(StructuralIndex::bestKernel());
+    return best;
+}
+
+// Classify the 64 bytes at base, padding past the end with spaces (which
+// classify as nothing)
+static inline void classifyAt(Classifier classify, std::string_view input, size_t base, BlockMasks& masks) {
+    const unsigned char* block = (const unsigned char*)input.data() + base;
+    size_t length = input.size() - base;
+    if (length < BLOCK_SIZE) {
+        unsigned char tail[BLOCK_SIZE];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, block, length);
+        classify(tail, masks);
+    } else {
+        classify(block, masks);
+    }
+}
+
+bool StructuralIndex::build(std::string_view input, Kernel kernel) {
+    count = 0;
+    controls.clear();
+    unterminated = false;
+    if (input.size() >= UINT32_MAX) return false;
+    if (kernel == Kernel::AUTO) kernel = bestKernel();
+    if (!isSupported(kernel)) return false;
+    Classifier classify = classifierFor(kernel);
+
+    // Roughly one position per 8 bytes for registry documents; grown as needed
+    if (positions.size() < input.size() / 8 + BLOCK_SIZE) {
+        positions.resize(input.size() / 8 + BLOCK_SIZE);
+    }
+
+    ScanState state;
+    BlockMasks masks;
+    for (size_t base = 0; base < input.size(); base += BLOCK_SIZE) {
+        classifyAt(classify, input, base, masks);
+
+        uint64_t escaped = escapedBytes(masks.backslash, state.escapeNext);
+        uint64_t quotes = masks.quote & ~escaped;
+        uint64_t inside = prefixXor(quotes) ^ state.inString;
+        state.inString = (uint64_t)((int64_t)inside >> 63);
+
+        uint64_t control = masks.control & inside;
+        while (control) {
+            controls.push_back((uint32_t)(base + countTrailingZeros(control)));
+            control &= control - 1;
+        }
+
+        uint64_t found = (masks.structural & ~inside) | quotes;
+        if (count + BLOCK_SIZE > positions.size()) positions.resize(positions.size() * 2);
+        uint32_t* out = positions.data() + count;
+        while (found) {
+            *out++ = (uint32_t)(base + countTrailingZeros(found));
+            found &= found - 1;
+        }
+        count = (size_t)(out - positions.data());
+    }
+    unterminated = state.inString != 0;
+    return true;
+}
+
+size_t StructuralIndex::skipValue(std::string_view input, size_t offset, Kernel kernel) {
+    if (offset >= input.size()) return npos;
+    char first = input[offset];
+    if (first != '"' && first != '{' && first != '[') return npos;
+    if (kernel != Kernel::AUTO && !isSupported(kernel)) return npos;
+    Classifier classify = kernel == Kernel::AUTO ? bestClassifier() : classifierFor(kernel);
+
+    // Blocks start at the value, so its opening quote or bracket is bit 0
+    ScanState state;
+    BlockMasks masks;
+    size_t nesting = 0;
+    for (size_t base = offset; base < input.size(); base += BLOCK_SIZE) {
+        classifyAt(classify, input, base, masks);
+
+        uint64_t escaped = escapedBytes(masks.backslash, state.escapeNext);
+        uint64_t quotes = masks.quote & ~escaped;
+        uint64_t inside = prefixXor(quotes) ^ state.inString;
+        state.inString = (uint64_t)((int64_t)inside >> 63);
+
+        if (first == '"') {
+            // The first quote that leaves a string closes this one
+            uint64_t closing = quotes & ~inside;
+            if (closing) return base + countTrailingZeros(closing) + 1;
+            continue;
+        }
+
+        uint64_t open = masks.open & ~inside;
+        uint64_t close = masks.close & ~inside;
+        if (countBits(close) < nesting) {
+            // Can't get back to the value's own level in this block
+            nesting += countBits(open);
+            nesting -= countBits(close);
+            continue;
+        }
+        for (uint64_t bits = open | close; bits; bits &= bits - 1) {
+            unsigned i = countTrailingZeros(bits);
+            if (open & (1ULL << i)) {
+                nesting++;
+            } else if (--nesting == 0) {
+                return base + i + 1;
+            }
+        }
+    }
+    return npos;
+}
+
+size_t StructuralIndex::findStringEnd(std::string_view input, size_t offset) {
+    const unsigned char* data = (const unsigned char*)input.data();
+    size_t size = input.size();
+#ifdef BOX_STRUCTURAL_X86
+    // Strings are short, so 16 bytes at a time beats a 64-byte block
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i controlMax = _mm_set1_epi8(0x1F);
+    while (offset + 16 <= size) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + offset));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(v, controlMax), controlMax));
+        unsigned bits = (unsigned)_mm_movemask_epi8(special);
+        if (bits) return offset + countTrailingZeros(bits);
+        offset += 16;
+    }
+#endif
+    while (offset < size) {
+        unsigned char c = data[offset];
+        if (c == '"' || c == '\\' || c < 0x20) return offset;
+        offset++;
+    }
+    return size;
+}
+
+size_t StructuralIndex::size() const {
+    return count;
+}
+
+size_t StructuralIndex::findControl(size_t begin, size_t end) const {
+    if (controls.empty()) return npos;
+    auto it = std::lower_bound(controls.begin(), controls.end(), (uint32_t)begin);
+    if (it == controls.end() || *it >= end) return npos;
+    return *it;
+}
+
+bool StructuralIndex::endsInString() const {
+    return unterminated;
+}
+
+} // namespace json
+} // namespace box